@@ -0,0 +1,177 @@
+/*
+ * Copyright 2004, 2005 Andrew De Ponte
+ *
+ * This file is part of zsrep.
+ *
+ * zsrep is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * zsrep is distributed in the hopes that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with zsrep; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @file Arena.cc
+ * @brief An implementation file for the session arena allocator.
+ * @author Andrew De Ponte
+ *
+ * An implementation file for a bump allocator handing out the temporary
+ * buffers of a synchronization session from a few large chunks.
+ */
+
+#include "Arena.hh"
+
+#include <stdlib.h>
+
+/**
+ * Construct an ArenaType object.
+ *
+ * Construct an arena without any chunks, the first is allocated along with
+ * the first allocation.
+ */
+ArenaType::ArenaType(void) {
+    curChunk = 0;
+    curOffset = 0;
+    numAllocs = 0;
+    numChunkAllocs = 0;
+}
+
+/**
+ * Destruct an ArenaType object.
+ *
+ * Free the chunks of the arena.
+ */
+ArenaType::~ArenaType(void) {
+    size_t i;
+
+    for (i = 0; i < chunks.size(); i++)
+	free(chunks[i].pData);
+}
+
+/**
+ * Allocate memory from the arena.
+ *
+ * Hand out the given number of bytes, aligned to ARENA_ALIGN, from the
+ * current chunk, moving on to the next chunk, or allocating one, when it is
+ * full.
+ * @param size The number of bytes to allocate.
+ * @return Pointer to the allocated memory.
+ * @retval NULL Failed to allocate a chunk.
+ */
+void *ArenaType::Alloc(size_t size) {
+    ChunkType chunk;
+    void *pMem;
+
+    size = (size + (ARENA_ALIGN - 1)) & ~(size_t)(ARENA_ALIGN - 1);
+    if (size == 0)
+	size = ARENA_ALIGN;
+
+    // Chunks kept from before a rewind are reused before new ones are
+    // allocated, skipping any too small for this allocation.
+    while ((curChunk < chunks.size()) &&
+	   ((chunks[curChunk].size - curOffset) < size)) {
+	curChunk++;
+	curOffset = 0;
+    }
+
+    if (curChunk == chunks.size()) {
+	chunk.size = (size > ARENA_CHUNK_SIZE) ? size : ARENA_CHUNK_SIZE;
+	chunk.pData = (char *)malloc(chunk.size);
+	if (!chunk.pData)
+	    return NULL;
+	chunks.push_back(chunk);
+	curOffset = 0;
+	numChunkAllocs++;
+    }
+
+    pMem = chunks[curChunk].pData + curOffset;
+    curOffset += size;
+    numAllocs++;
+    return pMem;
+}
+
+/**
+ * Mark the position of the arena.
+ *
+ * @return The current position of the arena, for Rewind().
+ */
+ArenaMarkType ArenaType::Mark(void) const {
+    ArenaMarkType mark;
+
+    mark.chunk = curChunk;
+    mark.offset = curOffset;
+    return mark;
+}
+
+/**
+ * Rewind the arena.
+ *
+ * Give back everything handed out since the given mark was taken, keeping
+ * the chunks for the allocations that follow.
+ * @param mark A position returned by Mark() since the arena was last reset.
+ */
+void ArenaType::Rewind(const ArenaMarkType &mark) {
+    curChunk = mark.chunk;
+    curOffset = mark.offset;
+}
+
+/**
+ * Reset the arena.
+ *
+ * Give back everything handed out, and free all the chunks but the first,
+ * so an arena that grew large during a session doesn't hold on to the
+ * memory afterwards.
+ */
+void ArenaType::Reset(void) {
+    size_t i;
+
+    for (i = 1; i < chunks.size(); i++)
+	free(chunks[i].pData);
+    if (chunks.size() > 1)
+	chunks.resize(1);
+    curChunk = 0;
+    curOffset = 0;
+    numAllocs = 0;
+    numChunkAllocs = 0;
+}
+
+/**
+ * Get the number of allocations.
+ *
+ * @return The number of allocations handed out since the arena was last
+ * reset.
+ */
+uint64_t ArenaType::GetNumAllocs(void) const {
+    return numAllocs;
+}
+
+/**
+ * Get the number of chunk allocations.
+ *
+ * @return The number of chunks allocated since the arena was last reset.
+ */
+uint64_t ArenaType::GetNumChunkAllocs(void) const {
+    return numChunkAllocs;
+}
+
+/**
+ * Get the size of the arena.
+ *
+ * @return The number of bytes held in the chunks of the arena.
+ */
+size_t ArenaType::GetSize(void) const {
+    size_t size = 0;
+    size_t i;
+
+    for (i = 0; i < chunks.size(); i++)
+	size += chunks[i].size;
+    return size;
+}
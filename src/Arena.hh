@@ -0,0 +1,104 @@
+/*
+ * Copyright 2004, 2005 Andrew De Ponte
+ *
+ * This file is part of zsrep.
+ *
+ * zsrep is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * zsrep is distributed in the hopes that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with zsrep; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @file Arena.hh
+ * @brief A specifications file for the session arena allocator.
+ * @author Andrew De Ponte
+ *
+ * A specifications file for a bump allocator handing out the temporary
+ * buffers of a synchronization session from a few large chunks.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+// The size of each chunk of an arena, larger requests get a chunk of their
+// own size.
+#define ARENA_CHUNK_SIZE 65536
+
+// The alignment of everything handed out by an arena.
+#define ARENA_ALIGN 8
+
+/**
+ * @struct ArenaMarkType
+ * @brief A position within an arena.
+ *
+ * A position within an arena, as returned by ArenaType::Mark(), which the
+ * arena can later be rewound to.
+ */
+struct ArenaMarkType {
+    size_t chunk;
+    size_t offset;
+};
+
+/**
+ * @class ArenaType
+ * @brief A type handing out memory by bumping a pointer.
+ *
+ * The ArenaType class hands out memory from large chunks by moving a
+ * pointer along them. Nothing handed out is freed on its own: the arena is
+ * rewound to a mark once the buffers handed out after it are no longer
+ * needed, and reset at the end of the session. The chunks are kept when the
+ * arena is rewound, so a session converting items one after the other
+ * keeps reusing the same memory instead of calling the allocator for each
+ * of them. Only what is trivially destructible may be placed in an arena.
+ *
+ * An arena may only be used by one thread at a time.
+ */
+class ArenaType {
+public:
+    ArenaType(void);
+    ~ArenaType(void);
+
+    void *Alloc(size_t size);
+    ArenaMarkType Mark(void) const;
+    void Rewind(const ArenaMarkType &mark);
+    void Reset(void);
+
+    uint64_t GetNumAllocs(void) const;
+    uint64_t GetNumChunkAllocs(void) const;
+    size_t GetSize(void) const;
+private:
+    struct ChunkType {
+	char *pData;
+	size_t size;
+    };
+
+    ArenaType(const ArenaType &arena);
+    ArenaType &operator=(const ArenaType &arena);
+
+    // The chunks of the arena, and the position of the next allocation.
+    std::vector<ChunkType> chunks;
+    size_t curChunk;
+    size_t curOffset;
+
+    // The number of allocations handed out, and of chunks allocated, since
+    // the arena was last reset.
+    uint64_t numAllocs;
+    uint64_t numChunkAllocs;
+};
+
+#endif
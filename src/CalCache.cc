@@ -0,0 +1,517 @@
+/*
+ * Copyright 2004, 2005 Andrew De Ponte
+ *
+ * This file is part of zsrep.
+ *
+ * zsrep is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * zsrep is distributed in the hopes that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with zsrep; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @file CalCache.cc
+ * @brief An implementation file for the parsed calendar cache.
+ * @author Andrew De Ponte
+ *
+ * An implementation file for the parsed calendar cache, which holds the todo
+ * items of the calendar file as parsed by the last session so that an
+ * unchanged calendar file doesn't have to be parsed again.
+ */
+
+#include "CalCache.hh"
+#include "TimeConv.hh"
+
+#include <qstringlist.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+
+// The local seconds stored for a time that isn't valid.
+#define CALCACHE_NO_TIME ((int64_t)(-0x7fffffffffffffffLL - 1))
+
+static void PutU32(std::string &buff, uint32_t val) {
+    buff.append((const char *)&val, sizeof(val));
+}
+
+static void PutU64(std::string &buff, uint64_t val) {
+    buff.append((const char *)&val, sizeof(val));
+}
+
+static void PutTime(std::string &buff, const QDateTime &dateTime) {
+    if (dateTime.isValid())
+	PutU64(buff, (uint64_t)TimeConvType::LocalSecs(dateTime));
+    else
+	PutU64(buff, (uint64_t)CALCACHE_NO_TIME);
+}
+
+static void PutString(std::string &buff, const QString &str) {
+    const QChar *pChars = str.unicode();
+    uint32_t len = str.length();
+    uint16_t unit;
+    uint32_t i;
+
+    PutU32(buff, len);
+    for (i = 0; i < len; i++) {
+	unit = pChars[i].unicode();
+	buff.append((const char *)&unit, sizeof(unit));
+    }
+}
+
+static bool GetBytes(const char *&pData, const char *pEnd, void *pVal,
+		     size_t valSize) {
+    if ((size_t)(pEnd - pData) < valSize)
+	return false;
+    memcpy(pVal, pData, valSize);
+    pData += valSize;
+    return true;
+}
+
+static QDateTime GetTime(int64_t localSecs) {
+    if (localSecs == CALCACHE_NO_TIME)
+	return QDateTime();
+    return TimeConvType::LocalDateTime(localSecs);
+}
+
+static bool GetString(const char *&pData, const char *pEnd,
+		      std::vector<QChar> &chars, QString &str) {
+    uint32_t len;
+    uint16_t unit;
+    uint32_t i;
+
+    if (!GetBytes(pData, pEnd, &len, sizeof(len)) ||
+	((size_t)(pEnd - pData) < (len * sizeof(unit))))
+	return false;
+    chars.resize(len);
+    for (i = 0; i < len; i++) {
+	GetBytes(pData, pEnd, &unit, sizeof(unit));
+	chars[i] = QChar(unit);
+    }
+    str = QString(len ? &chars[0] : NULL, len);
+    return true;
+}
+
+/**
+ * Construct a default CalCacheType object.
+ *
+ * Construct a default CalCacheType object, which has loaded nothing.
+ */
+CalCacheType::CalCacheType(void) {
+    memset(&loadedKey, 0, sizeof(loadedKey));
+    loadedChecksum = 0;
+    loadedFlag = false;
+}
+
+/**
+ * Load the parsed calendar cache.
+ *
+ * Load the parsed calendar cache at the given path and rebuild the todo
+ * items it holds, provided it was saved for the calendar file with the
+ * given key. The todo items are allocated with new and belong to the
+ * caller, they hold only the fields the plugin synchronizes. Nothing is
+ * rebuilt when the cache can't be used, the calendar file then has to be
+ * parsed.
+ * @param cachePath The path of the parsed calendar cache file.
+ * @param fileKey The key of the calendar file, as obtained by FileKey().
+ * @param todos Set to the rebuilt todo items.
+ * @param unwrittenUIDs The UIDs of the rebuilt todo items whose SyncID isn't
+ * in the calendar file yet are inserted into it.
+ * @return An integer representing success (zero) or failure (non-zero).
+ * @retval 0 Success.
+ * @retval 1 Failed to open the cache file, as happens before the first sync.
+ * @retval 2 Failed to memory map the cache file.
+ * @retval 3 The cache file is truncated or its checksum doesn't match.
+ * @retval 4 The cache file was written by a newer version of the plugin.
+ * @retval 5 The cache file was written for another calendar file, time zone
+ * or byte order.
+ */
+int CalCacheType::Load(const std::string &cachePath,
+		       const CalCacheKeyType &fileKey,
+		       std::vector<KCal::Todo *> &todos,
+		       std::set<QString> &unwrittenUIDs) {
+    int fd;
+    struct stat cacheStat;
+    void *pMap;
+    size_t mapSize;
+    const CalCacheHeader *pHeader;
+    const char *pData;
+    const char *pEnd;
+    std::vector<QChar> chars;
+    std::vector<QString> unwritten;
+    uint32_t flags;
+    int32_t vals[4];
+    int64_t times[5];
+    QString strs[3];
+    QString category;
+    QStringList categories;
+    uint32_t numCategories;
+    KCal::Todo *pKCalTodo;
+    uint64_t i;
+    uint32_t j;
+    int retval = 0;
+
+    todos.clear();
+    loadedFlag = false;
+
+    fd = open(cachePath.c_str(), O_RDONLY);
+    if (fd == -1)
+	return 1;
+
+    if ((fstat(fd, &cacheStat) != 0) ||
+	((size_t)cacheStat.st_size < sizeof(CalCacheHeader))) {
+	close(fd);
+	return 3;
+    }
+
+    mapSize = (size_t)cacheStat.st_size;
+    pMap = mmap(NULL, mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (pMap == MAP_FAILED)
+	return 2;
+
+    pHeader = (const CalCacheHeader *)pMap;
+    pData = (const char *)(pHeader + 1);
+    pEnd = (const char *)pMap + mapSize;
+
+    if (pHeader->magic != CALCACHE_MAGIC) {
+	retval = (pHeader->byteOrder != CALCACHE_BYTE_ORDER) ? 5 : 3;
+    } else if (pHeader->version > CALCACHE_VERSION) {
+	retval = 4;
+    } else if (!SameKey(pHeader->key, fileKey)) {
+	retval = 5;
+    } else if (Checksum(pData, pEnd - pData) != pHeader->checksum) {
+	retval = 3;
+    }
+
+    if (retval == 0)
+	todos.reserve((size_t)pHeader->numEntries);
+
+    for (i = 0; (retval == 0) && (i < pHeader->numEntries); i++) {
+	if (!GetBytes(pData, pEnd, &flags, sizeof(flags)) ||
+	    !GetBytes(pData, pEnd, vals, sizeof(vals)) ||
+	    !GetBytes(pData, pEnd, times, sizeof(times)) ||
+	    !GetString(pData, pEnd, chars, strs[0]) ||
+	    !GetString(pData, pEnd, chars, strs[1]) ||
+	    !GetString(pData, pEnd, chars, strs[2]) ||
+	    !GetBytes(pData, pEnd, &numCategories, sizeof(numCategories))) {
+	    retval = 3;
+	    break;
+	}
+
+	categories.clear();
+	for (j = 0; j < numCategories; j++) {
+	    if (!GetString(pData, pEnd, chars, category)) {
+		retval = 3;
+		break;
+	    }
+	    categories << category;
+	}
+	if (retval != 0)
+	    break;
+
+	// The last modified time goes last, as every other setter updates
+	// it.
+	pKCalTodo = new KCal::Todo();
+	pKCalTodo->setUid(strs[0]);
+	pKCalTodo->setSummary(strs[1]);
+	pKCalTodo->setDescription(strs[2]);
+	pKCalTodo->setCategories(categories);
+	pKCalTodo->setCreated(GetTime(times[0]));
+	pKCalTodo->setFloats((flags & CALCACHE_FLOATS) != 0);
+	if (flags & CALCACHE_HAS_START_DATE)
+	    pKCalTodo->setDtStart(GetTime(times[2]));
+	pKCalTodo->setHasStartDate((flags & CALCACHE_HAS_START_DATE) != 0);
+	if (flags & CALCACHE_HAS_DUE_DATE)
+	    pKCalTodo->setDtDue(GetTime(times[3]));
+	pKCalTodo->setHasDueDate((flags & CALCACHE_HAS_DUE_DATE) != 0);
+	pKCalTodo->setPercentComplete((int)vals[2]);
+	if (flags & CALCACHE_HAS_COMPLETED_DATE)
+	    pKCalTodo->setCompleted(GetTime(times[4]));
+	pKCalTodo->setPriority((int)vals[3]);
+	pKCalTodo->setPilotId((int)vals[0]);
+	pKCalTodo->setSyncStatus((int)vals[1]);
+	pKCalTodo->setLastModified(GetTime(times[1]));
+	todos.push_back(pKCalTodo);
+
+	if (flags & CALCACHE_UNWRITTEN_SYNCID)
+	    unwritten.push_back(strs[0]);
+    }
+
+    if ((retval == 0) && (pData != pEnd))
+	retval = 3;
+
+    if (retval == 0) {
+	loadedKey = pHeader->key;
+	loadedChecksum = pHeader->checksum;
+	loadedFlag = true;
+	unwrittenUIDs.insert(unwritten.begin(), unwritten.end());
+    }
+
+    munmap(pMap, mapSize);
+
+    if (retval != 0) {
+	for (i = 0; i < todos.size(); i++)
+	    delete todos[i];
+	todos.clear();
+    }
+
+    return retval;
+}
+
+/**
+ * Save the parsed calendar cache.
+ *
+ * Save the given todo items to the parsed calendar cache at the given path,
+ * for the calendar file with the given key. The cache is written to a
+ * temporary file which then replaces the cache file. Nothing is written
+ * when the cache as loaded already holds the same todo items for the same
+ * calendar file.
+ * @param cachePath The path of the parsed calendar cache file.
+ * @param fileKey The key of the calendar file, as obtained by FileKey().
+ * @param todos The todo items of the calendar file.
+ * @param unwrittenUIDs The UIDs of the todo items whose SyncID isn't in the
+ * calendar file yet.
+ * @return An integer representing success (zero) or failure (non-zero).
+ * @retval 0 Success.
+ * @retval 1 Failed to open the temporary file for output.
+ * @retval 2 Failed to write the temporary file.
+ * @retval 3 Failed to replace the cache file with the temporary file.
+ */
+int CalCacheType::Save(const std::string &cachePath,
+		       const CalCacheKeyType &fileKey,
+		       const std::vector<KCal::Todo *> &todos,
+		       const std::set<QString> &unwrittenUIDs) {
+    std::vector<KCal::Todo *>::const_iterator it;
+    std::string tmpPath;
+    std::string payload;
+    CalCacheHeader header;
+    KCal::Todo *pKCalTodo;
+    QStringList categories;
+    QStringList::ConstIterator catIt;
+    uint32_t flags;
+    FILE *pFile;
+
+    for (it = todos.begin(); it != todos.end(); it++) {
+	pKCalTodo = *it;
+
+	flags = 0;
+	if (pKCalTodo->hasStartDate())
+	    flags |= CALCACHE_HAS_START_DATE;
+	if (pKCalTodo->hasDueDate())
+	    flags |= CALCACHE_HAS_DUE_DATE;
+	if (pKCalTodo->hasCompletedDate())
+	    flags |= CALCACHE_HAS_COMPLETED_DATE;
+	if (pKCalTodo->doesFloat())
+	    flags |= CALCACHE_FLOATS;
+	if (unwrittenUIDs.find(pKCalTodo->uid()) != unwrittenUIDs.end())
+	    flags |= CALCACHE_UNWRITTEN_SYNCID;
+
+	PutU32(payload, flags);
+	PutU32(payload, (uint32_t)pKCalTodo->pilotId());
+	PutU32(payload, (uint32_t)pKCalTodo->syncStatus());
+	PutU32(payload, (uint32_t)pKCalTodo->percentComplete());
+	PutU32(payload, (uint32_t)pKCalTodo->priority());
+	PutTime(payload, pKCalTodo->created());
+	PutTime(payload, pKCalTodo->lastModified());
+	PutTime(payload, pKCalTodo->dtStart());
+	PutTime(payload, pKCalTodo->dtDue());
+	PutTime(payload, pKCalTodo->completed());
+	PutString(payload, pKCalTodo->uid());
+	PutString(payload, pKCalTodo->summary());
+	PutString(payload, pKCalTodo->description());
+
+	categories = pKCalTodo->categories();
+	PutU32(payload, (uint32_t)categories.count());
+	for (catIt = categories.begin(); catIt != categories.end(); catIt++)
+	    PutString(payload, *catIt);
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic = CALCACHE_MAGIC;
+    header.version = CALCACHE_VERSION;
+    header.byteOrder = CALCACHE_BYTE_ORDER;
+    header.checksum = Checksum(payload.data(), payload.size());
+    header.numEntries = todos.size();
+    header.key = fileKey;
+
+    if (loadedFlag && SameKey(loadedKey, fileKey) &&
+	(loadedChecksum == header.checksum))
+	return 0;
+
+    tmpPath = cachePath;
+    tmpPath.append(".tmp");
+
+    pFile = fopen(tmpPath.c_str(), "wb");
+    if (!pFile)
+	return 1;
+
+    if ((fwrite(&header, sizeof(header), 1, pFile) != 1) ||
+	(fwrite(payload.data(), 1, payload.size(), pFile) != payload.size())) {
+	fclose(pFile);
+	unlink(tmpPath.c_str());
+	return 2;
+    }
+
+    if (fclose(pFile) != 0) {
+	unlink(tmpPath.c_str());
+	return 2;
+    }
+
+    if (rename(tmpPath.c_str(), cachePath.c_str()) != 0) {
+	unlink(tmpPath.c_str());
+	return 3;
+    }
+
+    loadedKey = fileKey;
+    loadedChecksum = header.checksum;
+    loadedFlag = true;
+
+    return 0;
+}
+
+/**
+ * Obtain the key of a calendar file.
+ *
+ * Obtain the key of the calendar file at the given path from its status and
+ * the given contents of it. The contents are passed in as the plugin already
+ * has the file mapped. Should the file be replaced in between, the inode or
+ * the hash won't match the key the cache was saved with.
+ * @param filePath The path of the calendar file.
+ * @param pData Pointer to the contents of the calendar file.
+ * @param dataSize The size of the contents in bytes.
+ * @param timeKey The time key of the current time zone, as returned by
+ * ConvCacheType::TimeKey().
+ * @param fileKey Set to the key of the calendar file.
+ * @return An integer representing success (zero) or failure (non-zero).
+ * @retval 0 Success.
+ * @retval 1 Failed to obtain the status of the calendar file.
+ */
+int CalCacheType::FileKey(const std::string &filePath, const char *pData,
+			  size_t dataSize, uint64_t timeKey,
+			  CalCacheKeyType &fileKey) {
+    struct stat fileStat;
+
+    if (stat(filePath.c_str(), &fileStat) != 0)
+	return 1;
+
+    memset(&fileKey, 0, sizeof(fileKey));
+    fileKey.timeKey = timeKey;
+    fileKey.inode = (uint64_t)fileStat.st_ino;
+    fileKey.size = (uint64_t)dataSize;
+    fileKey.mtime = (int64_t)fileStat.st_mtime;
+    fileKey.hash = Hash(pData, dataSize);
+
+    return 0;
+}
+
+/**
+ * Copy the synchronized fields of a todo item.
+ *
+ * Copy the fields the plugin synchronizes from one todo item to another,
+ * as it takes to complete a todo item rebuilt by Load() with the todo item
+ * parsed from the calendar file.
+ * @param pFrom Pointer to the todo item to copy the fields from.
+ * @param pTo Pointer to the todo item to copy the fields to.
+ */
+void CalCacheType::CopyFields(KCal::Todo *pFrom, KCal::Todo *pTo) {
+    pTo->setSummary(pFrom->summary());
+    pTo->setDescription(pFrom->description());
+    pTo->setCategories(pFrom->categories());
+    pTo->setCreated(pFrom->created());
+    pTo->setFloats(pFrom->doesFloat());
+    if (pFrom->hasStartDate())
+	pTo->setDtStart(pFrom->dtStart());
+    pTo->setHasStartDate(pFrom->hasStartDate());
+    if (pFrom->hasDueDate())
+	pTo->setDtDue(pFrom->dtDue());
+    pTo->setHasDueDate(pFrom->hasDueDate());
+    pTo->setPercentComplete(pFrom->percentComplete());
+    if (pFrom->hasCompletedDate())
+	pTo->setCompleted(pFrom->completed());
+    pTo->setPriority(pFrom->priority());
+    pTo->setPilotId(pFrom->pilotId());
+    pTo->setSyncStatus(pFrom->syncStatus());
+    pTo->setLastModified(pFrom->lastModified());
+}
+
+/**
+ * Compare the keys of two calendar files.
+ *
+ * @param key1 The first key.
+ * @param key2 The second key.
+ * @return A boolean representing whether the keys are equal (true) or not
+ * (false).
+ */
+bool CalCacheType::SameKey(const CalCacheKeyType &key1,
+			   const CalCacheKeyType &key2) {
+    return ((key1.timeKey == key2.timeKey) && (key1.inode == key2.inode) &&
+	    (key1.size == key2.size) && (key1.mtime == key2.mtime) &&
+	    (key1.hash == key2.hash));
+}
+
+/**
+ * Calculate the hash of the contents of a calendar file.
+ *
+ * Calculate FNV-1a over the contents of a calendar file, taking eight bytes
+ * at a time rather than one, as the whole file is hashed at the start of
+ * every session.
+ * @param pData Pointer to the contents of the calendar file.
+ * @param dataSize The size of the contents in bytes.
+ * @return The hash of the contents.
+ */
+uint64_t CalCacheType::Hash(const char *pData, size_t dataSize) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    uint64_t word;
+    size_t i;
+
+    for (i = 0; (i + sizeof(word)) <= dataSize; i += sizeof(word)) {
+	memcpy(&word, pData + i, sizeof(word));
+	hash ^= word;
+	hash *= 0x100000001b3ULL;
+    }
+
+    for (; i < dataSize; i++) {
+	hash ^= (unsigned char)pData[i];
+	hash *= 0x100000001b3ULL;
+    }
+
+    hash ^= (uint64_t)dataSize;
+    hash *= 0x100000001b3ULL;
+
+    return hash;
+}
+
+/**
+ * Calculate the checksum of the entries.
+ *
+ * Calculate the checksum stored in the cache header, FNV-1a over the bytes
+ * of the entries folded down to 32 bits.
+ * @param pData Pointer to the entries.
+ * @param dataSize The size of the entries in bytes.
+ * @return The checksum of the entries.
+ */
+uint32_t CalCacheType::Checksum(const char *pData, size_t dataSize) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t i;
+
+    for (i = 0; i < dataSize; i++) {
+	hash ^= (unsigned char)pData[i];
+	hash *= 0x100000001b3ULL;
+    }
+
+    return (uint32_t)(hash ^ (hash >> 32));
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright 2004, 2005 Andrew De Ponte
+ *
+ * This file is part of zsrep.
+ *
+ * zsrep is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * zsrep is distributed in the hopes that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with zsrep; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @file CalCache.hh
+ * @brief A specifications file for the parsed calendar cache.
+ * @author Andrew De Ponte
+ *
+ * A specifications file for the parsed calendar cache, which holds the todo
+ * items of the calendar file as parsed by the last session so that an
+ * unchanged calendar file doesn't have to be parsed again.
+ */
+
+#ifndef CALCACHE_H
+#define CALCACHE_H
+
+#include <qstring.h>
+#include <libkcal/todo.h>
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+#include <set>
+
+#define CALCACHE_MAGIC 0x4c43544b
+#define CALCACHE_VERSION 1
+#define CALCACHE_BYTE_ORDER 0x01020304
+
+// The flags of a cached todo item.
+#define CALCACHE_HAS_START_DATE 0x01
+#define CALCACHE_HAS_DUE_DATE 0x02
+#define CALCACHE_HAS_COMPLETED_DATE 0x04
+#define CALCACHE_FLOATS 0x08
+#define CALCACHE_UNWRITTEN_SYNCID 0x10
+
+/**
+ * @struct CalCacheKeyType
+ * @brief The identity of a calendar file.
+ *
+ * The identity of a calendar file, as far as the parsed calendar cache is
+ * concerned. Besides the inode, size and modification time of the file it
+ * holds a hash of its contents, as the modification time only has a
+ * resolution of a second, and the time key of the time zone its times were
+ * parsed in.
+ */
+struct CalCacheKeyType {
+    uint64_t timeKey;
+    uint64_t inode;
+    uint64_t size;
+    int64_t mtime;
+    uint64_t hash;
+};
+
+/**
+ * @struct CalCacheHeader
+ * @brief The header at the start of a parsed calendar cache file.
+ *
+ * The header at the start of a parsed calendar cache file. It is followed
+ * directly by numEntries entries, each holding the fields of one todo item
+ * the plugin synchronizes. The key identifies the calendar file the todo
+ * items were parsed from. All values are stored in the byte order of the
+ * host that wrote the file, which byteOrder records.
+ */
+struct CalCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t checksum;
+    uint64_t numEntries;
+    CalCacheKeyType key;
+};
+
+/**
+ * @class CalCacheType
+ * @brief A type caching the parsed todo items of the calendar file.
+ *
+ * The CalCacheType class saves the todo items of the calendar at the end of
+ * a session, along with the identity of the calendar file as written, and
+ * rebuilds them at the start of the next one when the calendar file still
+ * has that identity. The rebuilt todo items only hold the fields the plugin
+ * synchronizes; everything else stays in the calendar file, and CopyFields()
+ * carries the synchronized fields over to a todo item parsed from it when
+ * the whole todo item is needed.
+ */
+class CalCacheType {
+public:
+    CalCacheType(void);
+
+    int Load(const std::string &cachePath, const CalCacheKeyType &fileKey,
+	     std::vector<KCal::Todo *> &todos,
+	     std::set<QString> &unwrittenUIDs);
+    int Save(const std::string &cachePath, const CalCacheKeyType &fileKey,
+	     const std::vector<KCal::Todo *> &todos,
+	     const std::set<QString> &unwrittenUIDs);
+
+    static int FileKey(const std::string &filePath, const char *pData,
+		       size_t dataSize, uint64_t timeKey,
+		       CalCacheKeyType &fileKey);
+    static void CopyFields(KCal::Todo *pFrom, KCal::Todo *pTo);
+private:
+    static bool SameKey(const CalCacheKeyType &key1,
+			const CalCacheKeyType &key2);
+    static uint64_t Hash(const char *pData, size_t dataSize);
+    static uint32_t Checksum(const char *pData, size_t dataSize);
+
+    // The key and checksum of the cache as loaded, so that saving the same
+    // todo items for the same calendar file writes nothing.
+    CalCacheKeyType loadedKey;
+    uint32_t loadedChecksum;
+    bool loadedFlag;
+};
+
+#endif
@@ -0,0 +1,156 @@
+/*
+ * Copyright 2004, 2005 Andrew De Ponte
+ *
+ * This file is part of zsrep.
+ *
+ * zsrep is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * zsrep is distributed in the hopes that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with zsrep; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @file CategoryTable.cc
+ * @brief An implementation file for the interned category table.
+ * @author Andrew De Ponte
+ *
+ * An implementation file for the interned category table, which gives each
+ * distinct todo item category an ID and keeps its QString and UTF-8 forms.
+ */
+
+#include "CategoryTable.hh"
+
+/**
+ * Construct a CategoryTableType object.
+ *
+ * Construct a table holding only the empty category.
+ */
+CategoryTableType::CategoryTableType(void) {
+    Clear();
+}
+
+/**
+ * Clear the table.
+ *
+ * Forget every category but the empty one. The IDs handed out before are no
+ * longer valid.
+ */
+void CategoryTableType::Clear(void) {
+    strings.clear();
+    utf8s.clear();
+    stringIDs.clear();
+    utf8IDs.clear();
+
+    // The empty category is never looked up, Intern() and InternUtf8()
+    // answer it themselves.
+    strings.push_back(QString());
+    utf8s.push_back(std::string());
+}
+
+/**
+ * Intern a KOrganizer category.
+ *
+ * @param category The category, as KOrganizer holds it.
+ * @return The ID of the category.
+ */
+uint32_t CategoryTableType::Intern(const QString &category) {
+    std::map<QString, uint32_t>::const_iterator it;
+    uint32_t id;
+
+    if (category.isEmpty())
+	return CATEGORYTABLE_NO_CATEGORY;
+
+    it = stringIDs.find(category);
+    if (it != stringIDs.end())
+	return it->second;
+
+    id = AddEntry(category, (std::string)category.utf8());
+    stringIDs[category] = id;
+    return id;
+}
+
+/**
+ * Intern a Zaurus category.
+ *
+ * @param category The category, as UTF-8.
+ * @return The ID of the category.
+ */
+uint32_t CategoryTableType::InternUtf8(const std::string &category) {
+    std::map<std::string, uint32_t>::const_iterator it;
+    uint32_t id;
+
+    if (category.empty())
+	return CATEGORYTABLE_NO_CATEGORY;
+
+    it = utf8IDs.find(category);
+    if (it != utf8IDs.end())
+	return it->second;
+
+    id = AddEntry(QString::fromUtf8(category.c_str()), category);
+    utf8IDs[category] = id;
+    return id;
+}
+
+/**
+ * Get the KOrganizer form of a category.
+ *
+ * @param id The ID of the category.
+ * @return The category as a QString, sharing its data with the table.
+ */
+const QString &CategoryTableType::GetString(uint32_t id) const {
+    return strings[id];
+}
+
+/**
+ * Get the Zaurus form of a category.
+ *
+ * @param id The ID of the category.
+ * @return The category as UTF-8.
+ */
+const std::string &CategoryTableType::GetUtf8(uint32_t id) const {
+    return utf8s[id];
+}
+
+/**
+ * Get the number of categories in the table.
+ *
+ * @return The number of categories, including the empty one.
+ */
+size_t CategoryTableType::GetNumCategories(void) const {
+    return strings.size();
+}
+
+/**
+ * Add a category to the table.
+ *
+ * Add a category under a new ID, and index it by whichever of its forms
+ * converts into the other exactly as the plugin would convert it, so that
+ * the category is found under the same ID from either side.
+ * @param category The QString form of the category.
+ * @param utf8 The UTF-8 form of the category.
+ * @return The ID of the category.
+ */
+uint32_t CategoryTableType::AddEntry(const QString &category,
+				     const std::string &utf8) {
+    uint32_t id = (uint32_t)strings.size();
+
+    strings.push_back(category);
+    utf8s.push_back(utf8);
+
+    if ((stringIDs.find(category) == stringIDs.end()) &&
+	((std::string)category.utf8() == utf8))
+	stringIDs[category] = id;
+    if ((utf8IDs.find(utf8) == utf8IDs.end()) &&
+	(QString::fromUtf8(utf8.c_str()) == category))
+	utf8IDs[utf8] = id;
+    return id;
+}
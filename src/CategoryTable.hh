@@ -0,0 +1,84 @@
+/*
+ * Copyright 2004, 2005 Andrew De Ponte
+ *
+ * This file is part of zsrep.
+ *
+ * zsrep is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * zsrep is distributed in the hopes that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with zsrep; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @file CategoryTable.hh
+ * @brief A specifications file for the interned category table.
+ * @author Andrew De Ponte
+ *
+ * A specifications file for the interned category table, which gives each
+ * distinct todo item category an ID and keeps its QString and UTF-8 forms.
+ */
+
+#ifndef CATEGORYTABLE_H
+#define CATEGORYTABLE_H
+
+#include <qstring.h>
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+#include <map>
+
+// The ID of the empty category, which todo items without one have.
+#define CATEGORYTABLE_NO_CATEGORY 0
+
+/**
+ * @class CategoryTableType
+ * @brief A type interning the categories of todo items.
+ *
+ * The CategoryTableType class gives each distinct category an ID the first
+ * time it is seen, from either side of the synchronization, and keeps the
+ * category both as the QString KOrganizer uses and as the UTF-8 the Zaurus
+ * uses. A calendar holds few distinct categories, so converting the
+ * category of a todo item comes down to a lookup in a small table and a
+ * copy of a string that shares its data, and two categories can be compared
+ * by their IDs.
+ *
+ * Each direction converts a category the same way the plugin converts the
+ * other text of a todo item: a QString becomes its UTF-8 encoding up to the
+ * first NUL character, and UTF-8 up to the first NUL character is decoded
+ * into a QString. Where those two conversions aren't each other's inverse,
+ * the two forms get IDs of their own.
+ */
+class CategoryTableType {
+public:
+    CategoryTableType(void);
+
+    void Clear(void);
+    uint32_t Intern(const QString &category);
+    uint32_t InternUtf8(const std::string &category);
+
+    const QString &GetString(uint32_t id) const;
+    const std::string &GetUtf8(uint32_t id) const;
+    size_t GetNumCategories(void) const;
+private:
+    uint32_t AddEntry(const QString &category, const std::string &utf8);
+
+    // The QString and UTF-8 forms of each category, by ID, and the IDs of
+    // the categories by each of the forms.
+    std::vector<QString> strings;
+    std::vector<std::string> utf8s;
+    std::map<QString, uint32_t> stringIDs;
+    std::map<std::string, uint32_t> utf8IDs;
+};
+
+#endif
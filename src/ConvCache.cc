@@ -0,0 +1,446 @@
+/*
+ * Copyright 2004, 2005 Andrew De Ponte
+ *
+ * This file is part of zsrep.
+ *
+ * zsrep is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * zsrep is distributed in the hopes that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with zsrep; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @file ConvCache.cc
+ * @brief An implementation file for the todo item conversion cache.
+ * @author Andrew De Ponte
+ *
+ * An implementation file for the conversion cache, which remembers the
+ * TodoItemType each KOrganizer todo item converted to across sessions.
+ */
+
+#include "ConvCache.hh"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+static void PutU32(std::string &buff, uint32_t val) {
+    buff.append((const char *)&val, sizeof(val));
+}
+
+static void PutU64(std::string &buff, uint64_t val) {
+    buff.append((const char *)&val, sizeof(val));
+}
+
+static void PutString(std::string &buff, const std::string &str) {
+    PutU32(buff, (uint32_t)str.size());
+    buff.append(str);
+}
+
+static bool GetBytes(const char *&pData, const char *pEnd, void *pVal,
+		     size_t valSize) {
+    if ((size_t)(pEnd - pData) < valSize)
+	return false;
+    memcpy(pVal, pData, valSize);
+    pData += valSize;
+    return true;
+}
+
+static bool GetString(const char *&pData, const char *pEnd,
+		      std::string &str) {
+    uint32_t len;
+
+    if (!GetBytes(pData, pEnd, &len, sizeof(len)))
+	return false;
+    if ((size_t)(pEnd - pData) < len)
+	return false;
+    str.assign(pData, len);
+    pData += len;
+    return true;
+}
+
+/**
+ * Construct a default ConvCacheType object.
+ *
+ * Construct a default ConvCacheType object holding no entries.
+ */
+ConvCacheType::ConvCacheType(void) {
+    timeKey = 0;
+    dirtyFlag = false;
+}
+
+/**
+ * Load the conversion cache.
+ *
+ * Load the conversion cache at the given path. A cache written for another
+ * time zone, or on a host of the opposite byte order, is discarded, as are
+ * damaged ones; the cache then starts out empty and fills up again as todo
+ * items are converted.
+ * @param cachePath The path of the conversion cache file.
+ * @param curTimeKey The time key of the current time zone, as returned by
+ * TimeKey().
+ * @return An integer representing success (zero) or failure (non-zero).
+ * @retval 0 Success.
+ * @retval 1 Failed to open the cache file, as happens before the first sync.
+ * @retval 2 Failed to memory map the cache file.
+ * @retval 3 The cache file is truncated or its checksum doesn't match.
+ * @retval 4 The cache file was written by a newer version of the plugin.
+ * @retval 5 The cache file was written for another time zone or byte order.
+ */
+int ConvCacheType::Load(const std::string &cachePath, uint64_t curTimeKey) {
+    int fd;
+    struct stat cacheStat;
+    void *pMap;
+    size_t mapSize;
+    const ConvCacheHeader *pHeader;
+    const char *pData;
+    const char *pEnd;
+    std::vector<QChar> uidChars;
+    uint32_t uidLen;
+    uint16_t uidUnit;
+    int64_t times[5];
+    unsigned char status[2];
+    std::string strs[4];
+    EntryType entry;
+    uint64_t i;
+    uint32_t j;
+    int retval = 0;
+
+    Clear();
+    timeKey = curTimeKey;
+
+    fd = open(cachePath.c_str(), O_RDONLY);
+    if (fd == -1)
+	return 1;
+
+    if ((fstat(fd, &cacheStat) != 0) ||
+	((size_t)cacheStat.st_size < sizeof(ConvCacheHeader))) {
+	close(fd);
+	return 3;
+    }
+
+    mapSize = (size_t)cacheStat.st_size;
+    pMap = mmap(NULL, mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (pMap == MAP_FAILED)
+	return 2;
+
+    pHeader = (const ConvCacheHeader *)pMap;
+    pData = (const char *)(pHeader + 1);
+    pEnd = (const char *)pMap + mapSize;
+
+    if (pHeader->magic != CONVCACHE_MAGIC) {
+	retval = (pHeader->byteOrder != CONVCACHE_BYTE_ORDER) ? 5 : 3;
+    } else if (pHeader->version > CONVCACHE_VERSION) {
+	retval = 4;
+    } else if (pHeader->timeKey != curTimeKey) {
+	retval = 5;
+    } else if (Checksum(pData, pEnd - pData) != pHeader->checksum) {
+	retval = 3;
+    }
+
+    for (i = 0; (retval == 0) && (i < pHeader->numEntries); i++) {
+	if (!GetBytes(pData, pEnd, &uidLen, sizeof(uidLen)) ||
+	    ((size_t)(pEnd - pData) < (uidLen * sizeof(uidUnit)))) {
+	    retval = 3;
+	    break;
+	}
+	uidChars.resize(uidLen);
+	for (j = 0; j < uidLen; j++) {
+	    GetBytes(pData, pEnd, &uidUnit, sizeof(uidUnit));
+	    uidChars[j] = QChar(uidUnit);
+	}
+
+	if (!GetBytes(pData, pEnd, times, sizeof(times)) ||
+	    !GetBytes(pData, pEnd, status, sizeof(status)) ||
+	    !GetString(pData, pEnd, strs[0]) ||
+	    !GetString(pData, pEnd, strs[1]) ||
+	    !GetString(pData, pEnd, strs[2]) ||
+	    !GetString(pData, pEnd, strs[3])) {
+	    retval = 3;
+	    break;
+	}
+
+	entry.lastModified = (time_t)times[0];
+	entry.todoItem = TodoItemType();
+	entry.todoItem.SetAttribute((unsigned char)0);
+	entry.todoItem.SetModifiedTime((time_t)times[0]);
+	entry.todoItem.SetCreatedTime((time_t)times[1]);
+	entry.todoItem.SetStartDate((time_t)times[2]);
+	entry.todoItem.SetDueDate((time_t)times[3]);
+	entry.todoItem.SetCompletedDate((time_t)times[4]);
+	entry.todoItem.SetProgressStatus(status[0]);
+	entry.todoItem.SetPriority(status[1]);
+	entry.todoItem.SetAppID(strs[0]);
+	entry.todoItem.SetCategory(strs[1]);
+	entry.todoItem.SetDescription(strs[2]);
+	entry.todoItem.SetNotes(strs[3]);
+
+	entries[QString(uidLen ? &uidChars[0] : NULL, uidLen)] = entry;
+    }
+
+    munmap(pMap, mapSize);
+
+    // A damaged cache, or one of another time zone, is replaced by the next
+    // save even if nothing is converted in the meantime.
+    if (retval != 0)
+	entries.clear();
+    dirtyFlag = ((retval == 3) || (retval == 5));
+
+    return retval;
+}
+
+/**
+ * Save the conversion cache.
+ *
+ * Save the conversion cache to the given path, leaving out the entries of
+ * todo items no longer in the calendar. The cache is written to a temporary
+ * file which then replaces the cache file. Nothing is written if no entry
+ * changed since the cache was loaded.
+ * @param cachePath The path of the conversion cache file.
+ * @param liveUIDs The todo items in the calendar, by UID.
+ * @return An integer representing success (zero) or failure (non-zero).
+ * @retval 0 Success.
+ * @retval 1 Failed to open the temporary file for output.
+ * @retval 2 Failed to write the temporary file.
+ * @retval 3 Failed to replace the cache file with the temporary file.
+ */
+int ConvCacheType::Save(const std::string &cachePath,
+			const QDict<KCal::Todo> &liveUIDs) {
+    std::map<QString, EntryType>::iterator it;
+    std::string tmpPath;
+    std::string payload;
+    ConvCacheHeader header;
+    const TodoItemType *pTodoItem;
+    const QChar *pUidChars;
+    uint32_t uidLen;
+    uint16_t uidUnit;
+    uint32_t i;
+    FILE *pFile;
+
+    for (it = entries.begin(); it != entries.end(); ) {
+	if (!liveUIDs.find(it->first)) {
+	    entries.erase(it++);
+	    dirtyFlag = true;
+	} else {
+	    ++it;
+	}
+    }
+
+    if (!dirtyFlag)
+	return 0;
+
+    for (it = entries.begin(); it != entries.end(); it++) {
+	pTodoItem = &it->second.todoItem;
+
+	uidLen = it->first.length();
+	pUidChars = it->first.unicode();
+	PutU32(payload, uidLen);
+	for (i = 0; i < uidLen; i++) {
+	    uidUnit = pUidChars[i].unicode();
+	    payload.append((const char *)&uidUnit, sizeof(uidUnit));
+	}
+
+	PutU64(payload, (uint64_t)(int64_t)it->second.lastModified);
+	PutU64(payload, (uint64_t)(int64_t)pTodoItem->GetCreatedTime());
+	PutU64(payload, (uint64_t)(int64_t)pTodoItem->GetStartDate());
+	PutU64(payload, (uint64_t)(int64_t)pTodoItem->GetDueDate());
+	PutU64(payload, (uint64_t)(int64_t)pTodoItem->GetCompletedDate());
+	payload.push_back((char)pTodoItem->GetProgressStatus());
+	payload.push_back((char)pTodoItem->GetPriority());
+	PutString(payload, pTodoItem->GetAppID());
+	PutString(payload, pTodoItem->GetCategory());
+	PutString(payload, pTodoItem->GetDescription());
+	PutString(payload, pTodoItem->GetNotes());
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic = CONVCACHE_MAGIC;
+    header.version = CONVCACHE_VERSION;
+    header.byteOrder = CONVCACHE_BYTE_ORDER;
+    header.checksum = Checksum(payload.data(), payload.size());
+    header.numEntries = entries.size();
+    header.timeKey = timeKey;
+
+    tmpPath = cachePath;
+    tmpPath.append(".tmp");
+
+    pFile = fopen(tmpPath.c_str(), "wb");
+    if (!pFile)
+	return 1;
+
+    if ((fwrite(&header, sizeof(header), 1, pFile) != 1) ||
+	(fwrite(payload.data(), 1, payload.size(), pFile) != payload.size())) {
+	fclose(pFile);
+	unlink(tmpPath.c_str());
+	return 2;
+    }
+
+    if (fclose(pFile) != 0) {
+	unlink(tmpPath.c_str());
+	return 2;
+    }
+
+    if (rename(tmpPath.c_str(), cachePath.c_str()) != 0) {
+	unlink(tmpPath.c_str());
+	return 3;
+    }
+
+    dirtyFlag = false;
+
+    return 0;
+}
+
+/**
+ * Clear the conversion cache.
+ *
+ * Remove all the entries from the conversion cache.
+ */
+void ConvCacheType::Clear(void) {
+    if (!entries.empty())
+	dirtyFlag = true;
+    entries.clear();
+}
+
+/**
+ * Find the converted todo item.
+ *
+ * Find the TodoItemType the todo item with the given UID converted to, as
+ * long as the todo item wasn't modified since.
+ * @param uid The UID of the todo item.
+ * @param lastModified The last modified time of the todo item.
+ * @param todoItem Set to the converted todo item when found. Its SyncID is
+ * not set.
+ * @return A boolean representing whether the todo item was found (true) or
+ * not (false).
+ */
+bool ConvCacheType::Find(const QString &uid, time_t lastModified,
+			 TodoItemType &todoItem) const {
+    std::map<QString, EntryType>::const_iterator it;
+
+    it = entries.find(uid);
+    if ((it == entries.end()) || (it->second.lastModified != lastModified))
+	return false;
+
+    todoItem = it->second.todoItem;
+    return true;
+}
+
+/**
+ * Insert a converted todo item.
+ *
+ * Insert the TodoItemType the todo item with the given UID converted to,
+ * replacing any previous entry of the todo item.
+ * @param uid The UID of the todo item.
+ * @param lastModified The last modified time of the todo item.
+ * @param todoItem The converted todo item.
+ */
+void ConvCacheType::Insert(const QString &uid, time_t lastModified,
+			   const TodoItemType &todoItem) {
+    EntryType &entry = entries[uid];
+
+    entry.lastModified = lastModified;
+    entry.todoItem = todoItem;
+    dirtyFlag = true;
+}
+
+/**
+ * Erase a converted todo item.
+ *
+ * Erase the entry of the todo item with the given UID, if there is one.
+ * This is done whenever the plugin changes a todo item, as the last
+ * modified time it is given may match the one it had before.
+ * @param uid The UID of the todo item.
+ */
+void ConvCacheType::Erase(const QString &uid) {
+    if (entries.erase(uid) != 0)
+	dirtyFlag = true;
+}
+
+/**
+ * Get the number of entries.
+ *
+ * @return The number of todo items in the conversion cache.
+ */
+size_t ConvCacheType::GetNumEntries(void) const {
+    return entries.size();
+}
+
+/**
+ * Calculate the time key of a time zone.
+ *
+ * Calculate a key identifying the time zone times are converted in. It
+ * covers the time zone of the calendar and the local time zone, through
+ * the local time of a winter and a summer date, as QDateTime::toTime_t()
+ * depends on both.
+ * @param timeZoneId The time zone ID of the calendar.
+ * @return The time key.
+ */
+uint64_t ConvCacheType::TimeKey(const QString &timeZoneId) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    const QChar *pChars = timeZoneId.unicode();
+    struct tm refTime;
+    time_t refTimes[2];
+    uint i;
+
+    for (i = 0; i < timeZoneId.length(); i++) {
+	hash ^= pChars[i].unicode();
+	hash *= 0x100000001b3ULL;
+    }
+
+    memset(&refTime, 0, sizeof(refTime));
+    refTime.tm_year = 100;
+    refTime.tm_mday = 1;
+    refTime.tm_isdst = -1;
+    refTimes[0] = mktime(&refTime);
+
+    memset(&refTime, 0, sizeof(refTime));
+    refTime.tm_year = 100;
+    refTime.tm_mon = 6;
+    refTime.tm_mday = 1;
+    refTime.tm_isdst = -1;
+    refTimes[1] = mktime(&refTime);
+
+    for (i = 0; i < 2; i++) {
+	hash ^= (uint64_t)(int64_t)refTimes[i];
+	hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+/**
+ * Calculate the checksum of the entries.
+ *
+ * Calculate the checksum stored in the cache header, FNV-1a over the bytes
+ * of the entries folded down to 32 bits.
+ * @param pData Pointer to the entries.
+ * @param dataSize The size of the entries in bytes.
+ * @return The checksum of the entries.
+ */
+uint32_t ConvCacheType::Checksum(const char *pData, size_t dataSize) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t i;
+
+    for (i = 0; i < dataSize; i++) {
+	hash ^= (unsigned char)pData[i];
+	hash *= 0x100000001b3ULL;
+    }
+
+    return (uint32_t)(hash ^ (hash >> 32));
+}
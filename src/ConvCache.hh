@@ -0,0 +1,111 @@
+/*
+ * Copyright 2004, 2005 Andrew De Ponte
+ *
+ * This file is part of zsrep.
+ *
+ * zsrep is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * zsrep is distributed in the hopes that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with zsrep; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @file ConvCache.hh
+ * @brief A specifications file for the todo item conversion cache.
+ * @author Andrew De Ponte
+ *
+ * A specifications file for the conversion cache, which remembers the
+ * TodoItemType each KOrganizer todo item converted to across sessions.
+ */
+
+#ifndef CONVCACHE_H
+#define CONVCACHE_H
+
+#include <zync/TodoPluginType.hh>
+
+#include <qstring.h>
+#include <qdict.h>
+#include <libkcal/todo.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#include <string>
+#include <map>
+
+#define CONVCACHE_MAGIC 0x43544f4b
+#define CONVCACHE_VERSION 1
+#define CONVCACHE_BYTE_ORDER 0x01020304
+
+/**
+ * @struct ConvCacheHeader
+ * @brief The header at the start of a conversion cache file.
+ *
+ * The header at the start of a conversion cache file. It is followed
+ * directly by numEntries entries, each holding the UID (as UTF-16), the last
+ * modified time and the converted fields of one todo item. The timeKey
+ * identifies the time zone the times were converted in. All values are
+ * stored in the byte order of the host that wrote the file, which byteOrder
+ * records.
+ */
+struct ConvCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t checksum;
+    uint64_t numEntries;
+    uint64_t timeKey;
+};
+
+/**
+ * @class ConvCacheType
+ * @brief A type caching the conversion of todo items.
+ *
+ * The ConvCacheType class maps the UID and last modified time of a
+ * KOrganizer todo item to the TodoItemType it converted to, so an unchanged
+ * todo item costs a lookup instead of a conversion. It is loaded at the
+ * start of a session and saved at the end of it. The cached items don't
+ * carry a SyncID, as the pilotId of a todo item changes without its last
+ * modified time changing.
+ */
+class ConvCacheType {
+public:
+    ConvCacheType(void);
+
+    int Load(const std::string &cachePath, uint64_t curTimeKey);
+    int Save(const std::string &cachePath, const QDict<KCal::Todo> &liveUIDs);
+    void Clear(void);
+
+    bool Find(const QString &uid, time_t lastModified,
+	      TodoItemType &todoItem) const;
+    void Insert(const QString &uid, time_t lastModified,
+		const TodoItemType &todoItem);
+    void Erase(const QString &uid);
+
+    size_t GetNumEntries(void) const;
+
+    static uint64_t TimeKey(const QString &timeZoneId);
+private:
+    struct EntryType {
+	time_t lastModified;
+	TodoItemType todoItem;
+    };
+
+    static uint32_t Checksum(const char *pData, size_t dataSize);
+
+    std::map<QString, EntryType> entries;
+    uint64_t timeKey;
+    bool dirtyFlag;
+};
+
+#endif
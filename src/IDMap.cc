@@ -0,0 +1,512 @@
+/*
+ * Copyright 2004, 2005 Andrew De Ponte
+ *
+ * This file is part of zsrep.
+ *
+ * zsrep is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * zsrep is distributed in the hopes that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with zsrep; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @file IDMap.cc
+ * @brief An implementation file for the UID to SyncID map.
+ * @author Andrew De Ponte
+ *
+ * An implementation file for the ID map, the file recording which KOrganizer
+ * UID each SyncID is mapped to, independently of the calendar file.
+ */
+
+#include "IDMap.hh"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+#include <algorithm>
+
+// Orders the indexes of the entries being saved by the UID of each.
+class UIDOrderType {
+public:
+    UIDOrderType(const std::vector<std::pair<uint64_t, std::string> > &entries)
+	: orderEntries(entries) {
+    }
+
+    bool operator()(uint32_t left, uint32_t right) const {
+	return orderEntries[left].second < orderEntries[right].second;
+    }
+private:
+    const std::vector<std::pair<uint64_t, std::string> > &orderEntries;
+};
+
+static int CompareUID(const char *pUID, size_t uidLength,
+		      const std::string &uid) {
+    size_t len = (uidLength < uid.size()) ? uidLength : uid.size();
+    int retval;
+
+    retval = memcmp(pUID, uid.data(), len);
+    if (retval != 0)
+	return retval;
+    if (uidLength < uid.size())
+	return -1;
+    return (uidLength > uid.size()) ? 1 : 0;
+}
+
+/**
+ * Construct a default IDMapType object.
+ *
+ * Construct a default IDMapType object holding no mappings.
+ */
+IDMapType::IDMapType(void) {
+    pMap = NULL;
+    mapSize = 0;
+    pEntries = NULL;
+    pUIDOrder = NULL;
+    pStrings = NULL;
+    numEntries = 0;
+    dirtyFlag = false;
+}
+
+/**
+ * Destruct the IDMapType object.
+ *
+ * Destruct the IDMapType object, unmapping the ID map file if it is mapped.
+ */
+IDMapType::~IDMapType(void) {
+    Close();
+}
+
+/**
+ * Load the ID map.
+ *
+ * Load the ID map at the given path by memory mapping it. The mappings stay
+ * in the mapping and are looked up in place until Close() is called. Any
+ * mappings set before are discarded.
+ * @param mapPath The path of the ID map file.
+ * @return An integer representing success (zero) or failure (non-zero).
+ * @retval 0 Success.
+ * @retval 1 Failed to open the ID map file, as happens before the first
+ * sync.
+ * @retval 2 Failed to memory map the ID map file.
+ * @retval 3 The ID map file is truncated, inconsistent or its checksum
+ * doesn't match.
+ * @retval 4 The ID map file was written by a newer version of the plugin, or
+ * on a host of the opposite byte order.
+ */
+int IDMapType::Load(const std::string &mapPath) {
+    int fd;
+    struct stat mapStat;
+    const IDMapHeader *pHeader;
+    size_t arraysSize;
+    size_t i;
+
+    Close();
+
+    fd = open(mapPath.c_str(), O_RDONLY);
+    if (fd == -1)
+	return 1;
+
+    if (fstat(fd, &mapStat) != 0) {
+	close(fd);
+	return 1;
+    }
+
+    if ((size_t)mapStat.st_size < sizeof(IDMapHeader)) {
+	close(fd);
+	return 3;
+    }
+
+    mapSize = (size_t)mapStat.st_size;
+    pMap = mmap(NULL, mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (pMap == MAP_FAILED) {
+	pMap = NULL;
+	mapSize = 0;
+	return 2;
+    }
+
+    pHeader = (const IDMapHeader *)pMap;
+    if (pHeader->magic != IDMAP_MAGIC) {
+	Close();
+	return (pHeader->byteOrder == IDMAP_BYTE_ORDER) ? 3 : 4;
+    }
+    if ((pHeader->version > IDMAP_VERSION) ||
+	(pHeader->byteOrder != IDMAP_BYTE_ORDER)) {
+	Close();
+	return 4;
+    }
+
+    if (pHeader->numEntries > ((mapSize - sizeof(IDMapHeader)) /
+			       (sizeof(IDMapEntry) + sizeof(uint32_t)))) {
+	Close();
+	return 3;
+    }
+    arraysSize = (size_t)pHeader->numEntries *
+	(sizeof(IDMapEntry) + sizeof(uint32_t));
+    if (pHeader->stringsSize !=
+	(mapSize - sizeof(IDMapHeader) - arraysSize)) {
+	Close();
+	return 3;
+    }
+
+    if (Checksum((const char *)(pHeader + 1), mapSize - sizeof(IDMapHeader))
+	!= pHeader->checksum) {
+	Close();
+	return 3;
+    }
+
+    numEntries = (size_t)pHeader->numEntries;
+    pEntries = (const IDMapEntry *)(pHeader + 1);
+    pUIDOrder = (const uint32_t *)(pEntries + numEntries);
+    pStrings = (const char *)(pUIDOrder + numEntries);
+
+    // The lookups trust the offsets and indexes, so they are checked once
+    // here.
+    for (i = 0; i < numEntries; i++) {
+	if ((pEntries[i].uidOffset > pHeader->stringsSize) ||
+	    (pEntries[i].uidLength >
+	     (pHeader->stringsSize - pEntries[i].uidOffset)) ||
+	    (pUIDOrder[i] >= numEntries)) {
+	    Close();
+	    return 3;
+	}
+    }
+
+    return 0;
+}
+
+/**
+ * Save the ID map.
+ *
+ * Save the mappings as the ID map at the given path, leaving out those of
+ * the UIDs no longer in the calendar. Nothing is written when no mapping
+ * changed. The ID map is written to a temporary file which then replaces
+ * the ID map, so an interrupted save leaves the previous one intact.
+ * @param mapPath The path of the ID map file.
+ * @param liveUIDs The todo items currently in the calendar, by UID.
+ * @return An integer representing success (zero) or failure (non-zero).
+ * @retval 0 Success.
+ * @retval 1 Failed to open the temporary file for output.
+ * @retval 2 Failed to write the temporary file.
+ * @retval 3 Failed to replace the ID map with the temporary file.
+ */
+int IDMapType::Save(const std::string &mapPath,
+		    const QDict<KCal::Todo> &liveUIDs) {
+    std::vector<std::pair<uint64_t, std::string> > entries;
+    std::map<std::string, uint64_t>::const_iterator uidIt;
+    std::vector<IDMapEntry> outEntries;
+    std::vector<uint32_t> uidOrder;
+    std::string strings;
+    std::string body;
+    std::string uid;
+    std::string tmpPath;
+    IDMapHeader header;
+    size_t i;
+    FILE *pFile;
+
+    // Gather the mappings of the file that weren't replaced, and those set
+    // since, dropping the UIDs that left the calendar.
+    entries.reserve(numEntries + uidChanges.size());
+    for (i = 0; i < numEntries; i++) {
+	uid.assign(pStrings + pEntries[i].uidOffset, pEntries[i].uidLength);
+	if ((uidChanges.find(uid) != uidChanges.end()) ||
+	    (syncIDChanges.find(pEntries[i].syncID) != syncIDChanges.end()))
+	    continue;
+	if (!liveUIDs.find(QString::fromUtf8(uid.data(), uid.size()))) {
+	    dirtyFlag = true;
+	    continue;
+	}
+	entries.push_back(std::make_pair(pEntries[i].syncID, uid));
+    }
+    for (uidIt = uidChanges.begin(); uidIt != uidChanges.end(); uidIt++) {
+	if (uidIt->second == 0)
+	    continue;
+	if (!liveUIDs.find(QString::fromUtf8(uidIt->first.data(),
+					     uidIt->first.size())))
+	    continue;
+	entries.push_back(std::make_pair(uidIt->second, uidIt->first));
+    }
+
+    if (!dirtyFlag)
+	return 0;
+
+    std::sort(entries.begin(), entries.end());
+
+    outEntries.resize(entries.size());
+    uidOrder.resize(entries.size());
+    for (i = 0; i < entries.size(); i++) {
+	memset(&outEntries[i], 0, sizeof(IDMapEntry));
+	outEntries[i].syncID = entries[i].first;
+	outEntries[i].uidOffset = (uint32_t)strings.size();
+	outEntries[i].uidLength = (uint32_t)entries[i].second.size();
+	strings.append(entries[i].second);
+	uidOrder[i] = (uint32_t)i;
+    }
+    std::sort(uidOrder.begin(), uidOrder.end(), UIDOrderType(entries));
+
+    // The checksum runs over everything after the header, in file order.
+    body.reserve((outEntries.size() * sizeof(IDMapEntry)) +
+		 (uidOrder.size() * sizeof(uint32_t)) + strings.size());
+    if (!outEntries.empty())
+	body.append((const char *)&outEntries[0],
+		    outEntries.size() * sizeof(IDMapEntry));
+    if (!uidOrder.empty())
+	body.append((const char *)&uidOrder[0],
+		    uidOrder.size() * sizeof(uint32_t));
+    body.append(strings);
+
+    memset(&header, 0, sizeof(header));
+    header.magic = IDMAP_MAGIC;
+    header.version = IDMAP_VERSION;
+    header.byteOrder = IDMAP_BYTE_ORDER;
+    header.checksum = Checksum(body.data(), body.size());
+    header.numEntries = entries.size();
+    header.stringsSize = strings.size();
+
+    tmpPath = mapPath;
+    tmpPath.append(".tmp");
+
+    pFile = fopen(tmpPath.c_str(), "wb");
+    if (!pFile)
+	return 1;
+
+    if ((fwrite(&header, sizeof(header), 1, pFile) != 1) ||
+	(fwrite(body.data(), 1, body.size(), pFile) != body.size())) {
+	fclose(pFile);
+	unlink(tmpPath.c_str());
+	return 2;
+    }
+
+    if (fclose(pFile) != 0) {
+	unlink(tmpPath.c_str());
+	return 2;
+    }
+
+    if (rename(tmpPath.c_str(), mapPath.c_str()) != 0) {
+	unlink(tmpPath.c_str());
+	return 3;
+    }
+
+    dirtyFlag = false;
+    return 0;
+}
+
+/**
+ * Close the ID map.
+ *
+ * Close the ID map, unmapping it and discarding the mappings set since it
+ * was loaded.
+ */
+void IDMapType::Close(void) {
+    if (pMap)
+	munmap(pMap, mapSize);
+    pMap = NULL;
+    mapSize = 0;
+    pEntries = NULL;
+    pUIDOrder = NULL;
+    pStrings = NULL;
+    numEntries = 0;
+    uidChanges.clear();
+    syncIDChanges.clear();
+    dirtyFlag = false;
+}
+
+/**
+ * Find the SyncID of a UID.
+ *
+ * @param uid The KOrganizer UID, as UTF-8.
+ * @param syncID Set to the SyncID the UID is mapped to.
+ * @return A boolean representing whether the UID is mapped (true) or not
+ * (false).
+ */
+bool IDMapType::FindSyncID(const std::string &uid, uint64_t &syncID) const {
+    std::map<std::string, uint64_t>::const_iterator it;
+
+    it = uidChanges.find(uid);
+    if (it != uidChanges.end()) {
+	syncID = it->second;
+	return (syncID != 0);
+    }
+    return FindMappedSyncID(uid, syncID);
+}
+
+/**
+ * Find the UID of a SyncID.
+ *
+ * @param syncID The SyncID.
+ * @param uid Set to the KOrganizer UID, as UTF-8, the SyncID is mapped to.
+ * @return A boolean representing whether the SyncID is mapped (true) or not
+ * (false).
+ */
+bool IDMapType::FindUID(uint64_t syncID, std::string &uid) const {
+    std::map<uint64_t, std::string>::const_iterator it;
+
+    it = syncIDChanges.find(syncID);
+    if (it != syncIDChanges.end()) {
+	uid = it->second;
+	return !uid.empty();
+    }
+    return FindMappedUID(syncID, uid);
+}
+
+/**
+ * Map a UID to a SyncID.
+ *
+ * Map the given UID to the given SyncID, replacing any mapping either of
+ * them had.
+ * @param uid The KOrganizer UID, as UTF-8.
+ * @param syncID The SyncID, zero to remove the mapping of the UID.
+ */
+void IDMapType::Set(const std::string &uid, uint64_t syncID) {
+    uint64_t oldSyncID;
+    std::string oldUID;
+
+    if (FindSyncID(uid, oldSyncID)) {
+	if (oldSyncID == syncID)
+	    return;
+	syncIDChanges[oldSyncID] = std::string();
+    } else if (syncID == 0) {
+	return;
+    }
+
+    if ((syncID != 0) && FindUID(syncID, oldUID))
+	uidChanges[oldUID] = 0;
+
+    uidChanges[uid] = syncID;
+    if (syncID != 0)
+	syncIDChanges[syncID] = uid;
+    dirtyFlag = true;
+}
+
+/**
+ * Remove the mapping of a UID.
+ *
+ * @param uid The KOrganizer UID, as UTF-8.
+ */
+void IDMapType::Erase(const std::string &uid) {
+    Set(uid, 0);
+}
+
+/**
+ * Get the number of mappings.
+ *
+ * Obtain the number of UIDs currently mapped to a SyncID.
+ * @return The number of mappings.
+ */
+size_t IDMapType::GetNumEntries(void) const {
+    std::map<std::string, uint64_t>::const_iterator it;
+    std::string uid;
+    size_t count = 0;
+    size_t i;
+
+    for (i = 0; i < numEntries; i++) {
+	uid.assign(pStrings + pEntries[i].uidOffset, pEntries[i].uidLength);
+	if ((uidChanges.find(uid) == uidChanges.end()) &&
+	    (syncIDChanges.find(pEntries[i].syncID) == syncIDChanges.end()))
+	    count++;
+    }
+    for (it = uidChanges.begin(); it != uidChanges.end(); it++) {
+	if (it->second != 0)
+	    count++;
+    }
+
+    return count;
+}
+
+/**
+ * Find the SyncID of a UID within the ID map file.
+ *
+ * @param uid The KOrganizer UID, as UTF-8.
+ * @param syncID Set to the SyncID the UID is mapped to.
+ * @return A boolean representing whether the UID is mapped (true) or not
+ * (false).
+ */
+bool IDMapType::FindMappedSyncID(const std::string &uid,
+				 uint64_t &syncID) const {
+    const IDMapEntry *pEntry;
+    size_t low = 0;
+    size_t high = numEntries;
+    size_t mid;
+    int cmp;
+
+    while (low < high) {
+	mid = low + ((high - low) / 2);
+	pEntry = &pEntries[pUIDOrder[mid]];
+	cmp = CompareUID(pStrings + pEntry->uidOffset, pEntry->uidLength, uid);
+	if (cmp == 0) {
+	    syncID = pEntry->syncID;
+	    return true;
+	}
+	if (cmp < 0)
+	    low = mid + 1;
+	else
+	    high = mid;
+    }
+
+    return false;
+}
+
+/**
+ * Find the UID of a SyncID within the ID map file.
+ *
+ * @param syncID The SyncID.
+ * @param uid Set to the KOrganizer UID, as UTF-8, the SyncID is mapped to.
+ * @return A boolean representing whether the SyncID is mapped (true) or not
+ * (false).
+ */
+bool IDMapType::FindMappedUID(uint64_t syncID, std::string &uid) const {
+    size_t low = 0;
+    size_t high = numEntries;
+    size_t mid;
+
+    while (low < high) {
+	mid = low + ((high - low) / 2);
+	if (pEntries[mid].syncID == syncID) {
+	    uid.assign(pStrings + pEntries[mid].uidOffset,
+		       pEntries[mid].uidLength);
+	    return true;
+	}
+	if (pEntries[mid].syncID < syncID)
+	    low = mid + 1;
+	else
+	    high = mid;
+    }
+
+    return false;
+}
+
+/**
+ * Calculate the checksum of the ID map.
+ *
+ * Calculate the checksum of everything following the header of the ID map
+ * file.
+ * @param pData Pointer to the data to checksum.
+ * @param dataSize The size of the data.
+ * @return The checksum of the data.
+ */
+uint32_t IDMapType::Checksum(const char *pData, size_t dataSize) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t i;
+
+    for (i = 0; i < dataSize; i++) {
+	hash ^= (unsigned char)pData[i];
+	hash *= 0x100000001b3ULL;
+    }
+
+    return (uint32_t)(hash ^ (hash >> 32));
+}
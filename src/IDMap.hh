@@ -0,0 +1,124 @@
+/*
+ * Copyright 2004, 2005 Andrew De Ponte
+ *
+ * This file is part of zsrep.
+ *
+ * zsrep is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * zsrep is distributed in the hopes that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with zsrep; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @file IDMap.hh
+ * @brief A specifications file for the UID to SyncID map.
+ * @author Andrew De Ponte
+ *
+ * A specifications file for the ID map, the file recording which KOrganizer
+ * UID each SyncID is mapped to, independently of the calendar file.
+ */
+
+#ifndef IDMAP_H
+#define IDMAP_H
+
+#include <qstring.h>
+#include <qdict.h>
+#include <libkcal/todo.h>
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+#include <map>
+
+#define IDMAP_MAGIC 0x4d494f4b
+#define IDMAP_VERSION 1
+#define IDMAP_BYTE_ORDER 0x01020304
+
+/**
+ * @struct IDMapHeader
+ * @brief The header at the start of an ID map file.
+ *
+ * The header at the start of an ID map file. It is followed directly by
+ * numEntries IDMapEntry records in ascending order of SyncID, then by
+ * numEntries 32 bit indexes of those records in ascending order of UID, and
+ * then by stringsSize bytes holding the UIDs as UTF-8. All values are stored
+ * in the byte order of the host that wrote the file, which byteOrder
+ * records.
+ */
+struct IDMapHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t checksum;
+    uint64_t numEntries;
+    uint64_t stringsSize;
+};
+
+/**
+ * @struct IDMapEntry
+ * @brief A single entry of the ID map.
+ *
+ * A single entry of the ID map, pairing a SyncID with the location of its
+ * UID within the strings of the ID map file.
+ */
+struct IDMapEntry {
+    uint64_t syncID;
+    uint32_t uidOffset;
+    uint32_t uidLength;
+};
+
+/**
+ * @class IDMapType
+ * @brief A type providing access to the ID map.
+ *
+ * The IDMapType class maps KOrganizer UIDs to SyncIDs and back. Loading
+ * memory maps the ID map file and looks both ways up in place with a binary
+ * search. Mappings set during a session are kept aside and take precedence
+ * over those of the file until the ID map is saved. Each UID maps to at most
+ * one SyncID and each SyncID to at most one UID.
+ */
+class IDMapType {
+public:
+    IDMapType(void);
+    ~IDMapType(void);
+
+    int Load(const std::string &mapPath);
+    int Save(const std::string &mapPath, const QDict<KCal::Todo> &liveUIDs);
+    void Close(void);
+
+    bool FindSyncID(const std::string &uid, uint64_t &syncID) const;
+    bool FindUID(uint64_t syncID, std::string &uid) const;
+    void Set(const std::string &uid, uint64_t syncID);
+    void Erase(const std::string &uid);
+
+    size_t GetNumEntries(void) const;
+private:
+    bool FindMappedSyncID(const std::string &uid, uint64_t &syncID) const;
+    bool FindMappedUID(uint64_t syncID, std::string &uid) const;
+    static uint32_t Checksum(const char *pData, size_t dataSize);
+
+    void *pMap;
+    size_t mapSize;
+    const IDMapEntry *pEntries;
+    const uint32_t *pUIDOrder;
+    const char *pStrings;
+    size_t numEntries;
+
+    // The mappings set since the file was loaded. A SyncID of zero, or an
+    // empty UID, records that the mapping was removed.
+    std::map<std::string, uint64_t> uidChanges;
+    std::map<uint64_t, std::string> syncIDChanges;
+    bool dirtyFlag;
+};
+
+#endif
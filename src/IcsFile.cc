@@ -0,0 +1,332 @@
+/*
+ * Copyright 2004, 2005 Andrew De Ponte
+ *
+ * This file is part of zsrep.
+ *
+ * zsrep is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * zsrep is distributed in the hopes that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with zsrep; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @file IcsFile.cc
+ * @brief An implementation file for the iCalendar file scanner.
+ * @author Andrew De Ponte
+ *
+ * An implementation file for the scanner that splits an iCalendar (ICS) file
+ * into its top level components without parsing them.
+ */
+
+#include "IcsFile.hh"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <strings.h>
+
+/**
+ * Construct a default IcsFileType object.
+ *
+ * Construct a default IcsFileType object holding no file.
+ */
+IcsFileType::IcsFileType(void) {
+    pMap = NULL;
+    mapSize = 0;
+    pData = NULL;
+    dataSize = 0;
+    footerOffset = 0;
+}
+
+/**
+ * Destruct the IcsFileType object.
+ *
+ * Destruct the IcsFileType object, unmapping the file if it is mapped.
+ */
+IcsFileType::~IcsFileType(void) {
+    Close();
+}
+
+/**
+ * Open an iCalendar file.
+ *
+ * Open the iCalendar file at the given path by memory mapping it, and scan
+ * it for its components. The file stays mapped until Close() is called.
+ * @param filePath The path of the iCalendar file.
+ * @return An integer representing success (zero) or failure (non-zero).
+ * @retval 0 Success.
+ * @retval 1 Failed to open the file.
+ * @retval 2 Failed to memory map the file.
+ * @retval 3 The file does not hold a complete VCALENDAR.
+ */
+int IcsFileType::Open(const std::string &filePath) {
+    struct stat fileStat;
+    int fd;
+
+    Close();
+
+    fd = open(filePath.c_str(), O_RDONLY);
+    if (fd == -1)
+	return 1;
+
+    if (fstat(fd, &fileStat) != 0) {
+	close(fd);
+	return 1;
+    }
+
+    if (fileStat.st_size == 0) {
+	close(fd);
+	return 3;
+    }
+
+    mapSize = (size_t)fileStat.st_size;
+    pMap = mmap(NULL, mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (pMap == MAP_FAILED) {
+	pMap = NULL;
+	mapSize = 0;
+	return 2;
+    }
+
+    // The file is read front to back exactly once.
+    madvise(pMap, mapSize, MADV_SEQUENTIAL);
+
+    return Scan((const char *)pMap, mapSize);
+}
+
+/**
+ * Scan a buffer holding an iCalendar file.
+ *
+ * Scan the given buffer for the top level components of its VCALENDAR. The
+ * buffer is not copied, so it has to stay around while this object is used.
+ * Lines may end in either CRLF or LF, and folded lines never start with
+ * BEGIN: or END: so they need no special handling.
+ * @param pBuf Pointer to the buffer holding the iCalendar file.
+ * @param bufSize The size of the buffer.
+ * @return An integer representing success (zero) or failure (non-zero).
+ * @retval 0 Success.
+ * @retval 3 The buffer does not hold a complete VCALENDAR.
+ */
+int IcsFileType::Scan(const char *pBuf, size_t bufSize) {
+    const char *pLine;
+    const char *pEol;
+    size_t lineStart, lineLen, nextStart;
+    size_t compStart = 0;
+    int compKind = ICS_COMP_OTHER;
+    int depth = 0;
+
+    pData = pBuf;
+    dataSize = bufSize;
+    footerOffset = 0;
+    components.clear();
+
+    for (lineStart = 0; lineStart < dataSize; lineStart = nextStart) {
+	pLine = pData + lineStart;
+	pEol = (const char *)memchr(pLine, '\n', dataSize - lineStart);
+	if (pEol) {
+	    lineLen = pEol - pLine;
+	    nextStart = lineStart + lineLen + 1;
+	} else {
+	    lineLen = dataSize - lineStart;
+	    nextStart = dataSize;
+	}
+	if ((lineLen > 0) && (pLine[lineLen - 1] == '\r'))
+	    lineLen--;
+
+	if (MatchLine(pLine, lineLen, "BEGIN:")) {
+	    if (depth == 0) {
+		if (MatchLine(pLine, lineLen, "BEGIN:VCALENDAR"))
+		    depth = 1;
+	    } else if (depth == 1) {
+		compStart = lineStart;
+		compKind = ComponentKind(pLine + 6, lineLen - 6);
+		depth = 2;
+	    } else {
+		depth++;
+	    }
+	} else if (MatchLine(pLine, lineLen, "END:")) {
+	    if (depth == 2) {
+		IcsComponentType comp;
+
+		comp.offset = compStart;
+		comp.length = nextStart - compStart;
+		comp.kind = compKind;
+		components.push_back(comp);
+		depth = 1;
+	    } else if (depth == 1) {
+		footerOffset = lineStart;
+		return 0;
+	    } else if (depth > 2) {
+		depth--;
+	    }
+	}
+    }
+
+    return 3;
+}
+
+/**
+ * Close the iCalendar file.
+ *
+ * Close the iCalendar file, unmapping it and forgetting its components.
+ */
+void IcsFileType::Close(void) {
+    if (pMap)
+	munmap(pMap, mapSize);
+    pMap = NULL;
+    mapSize = 0;
+    pData = NULL;
+    dataSize = 0;
+    footerOffset = 0;
+    components.clear();
+}
+
+/**
+ * Get the content of the iCalendar file.
+ *
+ * @return A pointer to the content of the iCalendar file.
+ */
+const char *IcsFileType::GetData(void) const {
+    return pData;
+}
+
+/**
+ * Get the size of the iCalendar file.
+ *
+ * @return The size of the content of the iCalendar file.
+ */
+size_t IcsFileType::GetSize(void) const {
+    return dataSize;
+}
+
+/**
+ * Get the offset of the VCALENDAR footer.
+ *
+ * Obtain the offset of the END:VCALENDAR line, which is where components
+ * added to the calendar are written.
+ * @return The offset of the END:VCALENDAR line.
+ */
+size_t IcsFileType::GetFooterOffset(void) const {
+    return footerOffset;
+}
+
+/**
+ * Get the components of the iCalendar file.
+ *
+ * @return The top level components of the VCALENDAR, in file order.
+ */
+const std::vector<IcsComponentType> &IcsFileType::GetComponents(void) const {
+    return components;
+}
+
+/**
+ * Get a property of a component.
+ *
+ * Get the value of the first property with the given name that belongs to
+ * the component itself, as opposed to one of the components nested within
+ * it. Folded lines of the value are unfolded. Property parameters are not
+ * supported, which is fine for the properties this is used for, like UID.
+ * @param comp The component to get the property of.
+ * @param pName The name of the property.
+ * @param value The string the value of the property is stored in.
+ * @return A boolean representing whether the property was found (true) or
+ * not (false).
+ */
+bool IcsFileType::GetProperty(const IcsComponentType &comp, const char *pName,
+			      std::string &value) const {
+    const char *pComp = pData + comp.offset;
+    const char *pLine;
+    const char *pEol;
+    size_t lineStart, lineLen, nextStart;
+    size_t nameLen = strlen(pName);
+    int depth = 0;
+    bool foundFlag = false;
+
+    value.clear();
+
+    for (lineStart = 0; lineStart < comp.length; lineStart = nextStart) {
+	pLine = pComp + lineStart;
+	pEol = (const char *)memchr(pLine, '\n', comp.length - lineStart);
+	if (pEol) {
+	    lineLen = pEol - pLine;
+	    nextStart = lineStart + lineLen + 1;
+	} else {
+	    lineLen = comp.length - lineStart;
+	    nextStart = comp.length;
+	}
+	if ((lineLen > 0) && (pLine[lineLen - 1] == '\r'))
+	    lineLen--;
+
+	if (foundFlag) {
+	    // A folded line continues the value when it starts with a space
+	    // or a tab, which is not part of the value.
+	    if ((lineLen == 0) || ((pLine[0] != ' ') && (pLine[0] != '\t')))
+		return true;
+	    value.append(pLine + 1, lineLen - 1);
+	    continue;
+	}
+
+	if (MatchLine(pLine, lineLen, "BEGIN:")) {
+	    depth++;
+	} else if (MatchLine(pLine, lineLen, "END:")) {
+	    depth--;
+	} else if ((depth == 1) && (lineLen > nameLen) &&
+		   (pLine[nameLen] == ':') &&
+		   (strncasecmp(pLine, pName, nameLen) == 0)) {
+	    value.assign(pLine + nameLen + 1, lineLen - nameLen - 1);
+	    foundFlag = true;
+	}
+    }
+
+    return foundFlag;
+}
+
+/**
+ * Check if a line starts with a prefix.
+ *
+ * Check if the given line starts with the given prefix, ignoring case as
+ * iCalendar property names and values of BEGIN and END are case insensitive.
+ * @param pLine Pointer to the line.
+ * @param lineLen The length of the line, excluding its line break.
+ * @param pPrefix The prefix to check for.
+ * @return A boolean representing whether the line starts with the prefix.
+ */
+bool IcsFileType::MatchLine(const char *pLine, size_t lineLen,
+			    const char *pPrefix) {
+    size_t prefixLen = strlen(pPrefix);
+
+    return ((lineLen >= prefixLen) &&
+	    (strncasecmp(pLine, pPrefix, prefixLen) == 0));
+}
+
+/**
+ * Obtain the kind of a component.
+ *
+ * @param pName Pointer to the name of the component, as given on its BEGIN
+ * line.
+ * @param nameLen The length of the name.
+ * @return The kind of the component, one of the ICS_COMP_ defines.
+ */
+int IcsFileType::ComponentKind(const char *pName, size_t nameLen) {
+    if ((nameLen == 5) && (strncasecmp(pName, "VTODO", 5) == 0))
+	return ICS_COMP_VTODO;
+    if ((nameLen == 6) && (strncasecmp(pName, "VEVENT", 6) == 0))
+	return ICS_COMP_VEVENT;
+    if ((nameLen == 8) && (strncasecmp(pName, "VJOURNAL", 8) == 0))
+	return ICS_COMP_VJOURNAL;
+    if ((nameLen == 9) && (strncasecmp(pName, "VTIMEZONE", 9) == 0))
+	return ICS_COMP_VTIMEZONE;
+    return ICS_COMP_OTHER;
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright 2004, 2005 Andrew De Ponte
+ *
+ * This file is part of zsrep.
+ *
+ * zsrep is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * zsrep is distributed in the hopes that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with zsrep; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @file IcsFile.hh
+ * @brief A specifications file for the iCalendar file scanner.
+ * @author Andrew De Ponte
+ *
+ * A specifications file for the scanner that splits an iCalendar (ICS) file
+ * into its top level components without parsing them.
+ */
+
+#ifndef ICSFILE_H
+#define ICSFILE_H
+
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#define ICS_COMP_VTODO 0
+#define ICS_COMP_VEVENT 1
+#define ICS_COMP_VJOURNAL 2
+#define ICS_COMP_VTIMEZONE 3
+#define ICS_COMP_OTHER 4
+
+/**
+ * @struct IcsComponentType
+ * @brief The location of one top level component of an iCalendar file.
+ *
+ * The location of one top level component of an iCalendar file, from the
+ * start of its BEGIN line up to and including the line break of its END
+ * line.
+ */
+struct IcsComponentType {
+    size_t offset;
+    size_t length;
+    int kind;
+};
+
+/**
+ * @class IcsFileType
+ * @brief A type splitting an iCalendar file into its components.
+ *
+ * The IcsFileType class memory maps an iCalendar file, or takes a buffer
+ * holding one, and records where each of the top level components of its
+ * VCALENDAR starts and ends. The content of the components is not parsed,
+ * so the components the plugin isn't interested in cost no more than a scan
+ * for their BEGIN and END lines.
+ */
+class IcsFileType {
+public:
+    IcsFileType(void);
+    ~IcsFileType(void);
+
+    int Open(const std::string &filePath);
+    int Scan(const char *pBuf, size_t bufSize);
+    void Close(void);
+
+    const char *GetData(void) const;
+    size_t GetSize(void) const;
+    size_t GetFooterOffset(void) const;
+    const std::vector<IcsComponentType> &GetComponents(void) const;
+    bool GetProperty(const IcsComponentType &comp, const char *pName,
+		     std::string &value) const;
+private:
+    static bool MatchLine(const char *pLine, size_t lineLen,
+			  const char *pPrefix);
+    static int ComponentKind(const char *pName, size_t nameLen);
+
+    void *pMap;
+    size_t mapSize;
+    const char *pData;
+    size_t dataSize;
+    size_t footerOffset;
+    std::vector<IcsComponentType> components;
+};
+
+#endif
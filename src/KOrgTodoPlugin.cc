@@ -38,6 +38,14 @@ void destroyTodoPlugin(TodoPluginType *pTodoPlugin) {
     delete pTodoPlugin;
 }
 
+TodoPluginV2Type *createTodoPluginV2(void) {
+    return (TodoPluginV2Type *)new KOrgTodoPlugin;
+}
+
+void destroyTodoPluginV2(TodoPluginV2Type *pTodoPlugin) {
+    delete pTodoPlugin;
+}
+
 /**
  * Construct a default KOrgTodoPlugin object.
  *
@@ -45,58 +53,90 @@ void destroyTodoPlugin(TodoPluginType *pTodoPlugin) {
  * initialization.
  */
 KOrgTodoPlugin::KOrgTodoPlugin(void) {
+    pKAboutData = NULL;
+    pKInstance = NULL;
+    pDefaultCal = NULL;
     openedCalFlag = false;
+    calLoadRetval = -1;
+    prefetchFlag = false;
+    prefetchTimeout = DEFAULT_PREFETCH_TIMEOUT;
+    prefetchRunningFlag = false;
+    prefetchDoneFlag = false;
+    pthread_mutex_init(&prefetchMutex, NULL);
+    pthread_cond_init(&prefetchCond, NULL);
     openedConfFlag = true;
+    todoOnlyFlag = false;
+    scannedCalsFlag = false;
     obtainedSyncLists = false;
+    takenNewItems = false;
+    takenModItems = false;
+    takenDelItemIDs = false;
+    loadedSyncIDLog = false;
+    syncIDLogRetval = 1;
+    syncIDJournalRetval = 1;
+    numJournalRecords = 0;
+    journalMaxRecords = DEFAULT_JOURNAL_MAX_RECORDS;
+    todoSnapshotValid = false;
+    convThreads = 0;
+}
+
+/**
+ * Destruct the KOrgTodoPlugin object.
+ *
+ * Wait for the prefetch thread, if CleanUp() gave up waiting for it, since
+ * it works on the members of this object. It only reads files, so it
+ * finishes on its own, whatever the host does meanwhile.
+ */
+KOrgTodoPlugin::~KOrgTodoPlugin(void) {
+    if (prefetchRunningFlag)
+	JoinPrefetch(0);
+    ClearCalendars();
+    pthread_cond_destroy(&prefetchCond);
+    pthread_mutex_destroy(&prefetchMutex);
 }
 
 /**
  * Initialize the KOrgTodoPlugin object.
  *
  * Initialize the KOrgTodoPlugin object by loading in its configuration from
- * the config file and preparing it for synchronization.
+ * the config file and preparing it for synchronization. The calendar itself
+ * isn't loaded until its todo items are first needed, see
+ * EnsureCalendarLoaded(), unless the prefetch mode is on, in which case the
+ * calendar objects are created here and the calendar files start being read
+ * on a thread of its own before this returns.
  * @return An integer representing success (zero) or failure (non-zero).
  * @retval 0 Successfully initialized the KOrgTodo plugin.
  * @retval 1 Failed to obtain the value of the HOME environment variable.
- * @retval 2 Failed to open the plugin's associated KOrg calendar file.
  */
 int KOrgTodoPlugin::Initialize(void) {
     char *pEnvVarVal;
     std::string confPath;
+    std::vector<std::string> calPaths;
     std::string calPath;
+    std::string defaultCalPath;
     std::string korgConfPath;
+    CalendarType *pCalendar;
+    size_t i;
     int retval;
+    int logLevel;
     char optVal[256];
+    char pathsVal[4096];
     ConfigManagerType confManager;
 
+    syncStats.Reset();
+    SyncStatsTimerType timer(syncStats, SYNCSTATS_PHASE_INITIALIZE);
+
     // Obtain the value of the HOME environment variable and build the path to
     // the config file so that it can be loaded.
     pEnvVarVal = getenv("HOME");
     if (!pEnvVarVal) {
-	std::cout << "KOrgTodoPlugin: Error: Failed to obtain the HOME " \
-	    "environment variable.\n";
+	KOTP_LOG_ERROR("KOrgTodoPlugin: Error: Failed to obtain the HOME " \
+	    "environment variable.");
 	return 1;
     }
 
     homeDir.assign(pEnvVarVal);
 
-    pKAboutData = new KAboutData("KOrgTodoPlugin",
-				 "Zync KOrganizer Todo Plugin",
-				 GetPluginVersion().c_str());
-    if (!pKAboutData) {
-	std::cout << "KOrgTodoPlugin::Initialize - ";
-	std::cout << "Failed to allocate mem for KAboutData object.\n";
-	return 1;
-    }
-
-    pKInstance = new KInstance(pKAboutData);
-    if (!pKInstance) {
-	std::cout << "KOrgTodoPlugin::Initialize - ";
-	std::cout << "Failed to allocate mem for KInstance object.\n";
-	delete pKAboutData;
-	return 2;
-    }
-
     confPath.assign(pEnvVarVal);
     confPath.append("/.KOrgTodoPlugin.conf");
 
@@ -104,41 +144,61 @@ int KOrgTodoPlugin::Initialize(void) {
     retval = confManager.Open((char *)confPath.c_str());
     if (retval != 0) {
 	if (retval == -1) {
-	    std::cout << "KOrgTodoPlugin: Error: Failed to open " << confPath
-		      << " for reading.\n";
+	    KOTP_LOG_ERROR("KOrgTodoPlugin: Error: Failed to open " <<
+			   confPath << " for reading.");
 	} else if (retval == -2) {
-	    std::cout << "KOrgTodoPlugin: Error: Failed to find an equals" \
+	    KOTP_LOG_ERROR("KOrgTodoPlugin: Error: Failed to find an equals" \
 		" on atleast one non comment line in the config file. These" \
 		" lines of the config file have been ignored and the config" \
 		" file has been loaded. Fix your config file, it is probably" \
-		" a typo.\n";
+		" a typo.");
 	} else {
-	    std::cout << "KOrgTodoPlugin: Error: An unhandled error occured" \
-		" while trying to open the config file.\n";
+	    KOTP_LOG_ERROR("KOrgTodoPlugin: Error: An unhandled error " \
+		"occured while trying to open the config file.");
 	}
 	openedConfFlag = false;
     }
 
-    // Here I attempt to load the path to the calendar file from the config.
+    // Here I attempt to load the log level and start the log. Messages are
+    // written directly until the log is started.
+    logLevel = LOG_DEFAULT_LEVEL;
+    if (openedConfFlag) {
+	retval = confManager.GetValue("log_level", optVal, 256);
+	if ((retval == 0) && !LogType::ParseLevel(optVal, logLevel)) {
+	    KOTP_LOG_WARNING("KOrgTodoPlugin: Warning: Unknown value (" <<
+		optVal << ") of the item with the title (log_level) in " \
+		"the config file (" << confPath << "). Using the default " \
+		"value (info).");
+	}
+    }
+    retval = LogType::Start(logLevel);
+    if (retval != 0) {
+	KOTP_LOG_WARNING("KOrgTodoPlugin: Warning: Failed to start the " \
+	    "log writer (" << retval << "). Messages are written directly.");
+    }
+
+    // Here I attempt to load the paths to the calendar files from the config.
+    // Several calendar files are separated by commas.
     if (openedConfFlag) {
-	retval = confManager.GetValue("korg_cal_path", optVal, 256);
+	retval = confManager.GetValue("korg_cal_path", pathsVal, 4096);
 	if (retval == 0) {
-	    calPath.assign(optVal);
-	} else {
+	    SplitList(pathsVal, calPaths);
+	}
+	if (calPaths.empty()) {
 	    calPath.assign(pEnvVarVal);
 	    calPath.append("/.kde/share/apps/korganizer/std.ics");
-	    std::cout << "KOrgTodoPlugin: Warning: Failed to find an item" \
-		" with the title " \
+	    KOTP_LOG_WARNING("KOrgTodoPlugin: Warning: Failed to find an " \
+		"item with the title " \
 		"(korg_cal_path) in the config file (" << confPath << ")." \
-		" Using the default value (" << calPath << ").\n";
+		" Using the default value (" << calPath << ").");
 	}
     } else {
 	calPath.assign(pEnvVarVal);
 	calPath.append("/.kde/share/apps/korganizer/std.ics");
-	std::cout << "KOrgTodoPlugin: Warning: The above described error " \
-	    " states that there was a failure in opening the config" \
+	KOTP_LOG_WARNING("KOrgTodoPlugin: Warning: The above described " \
+	    "error states that there was a failure in opening the config" \
 	    " file (" << confPath << "). Due, to this failure the KOrganizer" \
-	    " Config path is now assumed to be (" << calPath << ").\n";
+	    " Config path is now assumed to be (" << calPath << ").");
     }
 
     // Here I attempt to load the path to the korganizer config.
@@ -149,42 +209,154 @@ int KOrgTodoPlugin::Initialize(void) {
 	} else {
 	    korgConfPath.assign(pEnvVarVal);
 	    korgConfPath.append("/.kde/share/config/korganizer/korganizerrc");
-	    std::cout << "KOrgTodoPlugin: Warning: Failed to find an item" \
-		" with the title " \
+	    KOTP_LOG_WARNING("KOrgTodoPlugin: Warning: Failed to find an " \
+		"item with the title " \
 		"(korg_conf_path) in the config file (" << confPath << ")." \
-		" Using the default value (" << korgConfPath << ").\n";
+		" Using the default value (" << korgConfPath << ").");
 	}
     } else {
 	korgConfPath.assign(pEnvVarVal);
 	korgConfPath.append("/.kde/share/config/korganizer/korganizerrc");
-	std::cout << "KOrgTodoPlugin: Warning: The above described error " \
-	    " states that there was a failure in opening the config" \
+	KOTP_LOG_WARNING("KOrgTodoPlugin: Warning: The above described " \
+	    "error states that there was a failure in opening the config" \
 	    " file (" << confPath << "). Due, to this failure the KOrganizer" \
-	    " Calendar path is now assumed to be (" << korgConfPath << ").\n";
+	    " Calendar path is now assumed to be (" << korgConfPath << ").");
     }
 
-    KConfig korgcfg(korgConfPath.c_str());
-    korgcfg.setGroup("Time & Date");
-    
-    pCal = new KCal::CalendarLocal(korgcfg.readEntry("TimeZoneId"));
-    if (!pCal) {
-	std::cout << "KOrgTodoPlugin::Initialize - ";
-	std::cout << "Failed to allocate mem for CalendarLocal object.\n";
-	delete pKAboutData;
-	return 3;
+    // Here I attempt to load the calendar load mode. In the todo_only mode
+    // only the todo items of the calendar file are parsed.
+    if (openedConfFlag) {
+	retval = confManager.GetValue("korg_load_mode", optVal, 256);
+	if (retval == 0) {
+	    if (strcmp(optVal, "todo_only") == 0) {
+		todoOnlyFlag = true;
+	    } else if (strcmp(optVal, "full") != 0) {
+		KOTP_LOG_WARNING("KOrgTodoPlugin: Warning: Unknown value (" <<
+		    optVal << ") of the item with the title " \
+		    "(korg_load_mode) in the config file (" << confPath <<
+		    "). Using the default value (full).");
+	    }
+	}
     }
 
-    // Load the file located at calPath into the calendar object.
-    qCalPath = calPath;
-    if (pCal->load(qCalPath)) {
-	openedCalFlag = true;
-    } else {
-	std::cout << "KOrgTodoPlugin: Error: Failed to load the KOrganizer" \
-	    " Calendar file (" << calPath << ")." \
-	    " Please edit the config file in your home directory, or" \
-	    " the permisions on the calendar file to fix this problem.\n";
-	return 4;
+    // Here I attempt to load the number of entries the sync ID journal may
+    // hold before it is folded back into the sync ID log.
+    if (openedConfFlag) {
+	retval = confManager.GetValue("syncid_journal_max", optVal, 256);
+	if ((retval == 0) && (!ParseCount(optVal, journalMaxRecords) ||
+			      (journalMaxRecords == 0))) {
+	    journalMaxRecords = DEFAULT_JOURNAL_MAX_RECORDS;
+	    KOTP_LOG_WARNING("KOrgTodoPlugin: Warning: Unknown value (" <<
+		optVal << ") of the item with the title " \
+		"(syncid_journal_max) in the config file (" << confPath <<
+		"). Using the default value (" << journalMaxRecords << ").");
+	}
+    }
+
+    // Here I attempt to load the number of threads converting todo items.
+    if (openedConfFlag) {
+	retval = confManager.GetValue("conv_threads", optVal, 256);
+	if ((retval == 0) && !ParseCount(optVal, convThreads)) {
+	    convThreads = 0;
+	    KOTP_LOG_WARNING("KOrgTodoPlugin: Warning: Unknown value (" <<
+		optVal << ") of the item with the title (conv_threads) in " \
+		"the config file (" << confPath << "). Using the default " \
+		"value (0).");
+	} else if ((retval == 0) && (convThreads > MAX_CONV_THREADS)) {
+	    convThreads = MAX_CONV_THREADS;
+	    KOTP_LOG_WARNING("KOrgTodoPlugin: Warning: The value (" <<
+		optVal << ") of the item with the title (conv_threads) in " \
+		"the config file (" << confPath << ") is too large. Using " \
+		"the largest value allowed (" << convThreads << ").");
+	}
+    }
+
+    // Here I attempt to load whether the calendar is prefetched, and how
+    // long the first call needing it waits for the prefetch.
+    if (openedConfFlag) {
+	retval = confManager.GetValue("korg_prefetch", optVal, 256);
+	if (retval == 0) {
+	    if (strcmp(optVal, "on") == 0) {
+		prefetchFlag = true;
+	    } else if (strcmp(optVal, "off") != 0) {
+		KOTP_LOG_WARNING("KOrgTodoPlugin: Warning: Unknown value (" <<
+		    optVal << ") of the item with the title " \
+		    "(korg_prefetch) in the config file (" << confPath <<
+		    "). Using the default value (off).");
+	    }
+	}
+	// A timeout of zero waits as long as it takes, which has to be asked
+	// for by name so that a typo can't hang the synchronization.
+	retval = confManager.GetValue("korg_prefetch_timeout", optVal, 256);
+	if (retval == 0) {
+	    if (strcmp(optVal, "none") == 0) {
+		prefetchTimeout = 0;
+	    } else if (!ParseCount(optVal, prefetchTimeout) ||
+		       (prefetchTimeout == 0) ||
+		       (prefetchTimeout > MAX_PREFETCH_TIMEOUT)) {
+		prefetchTimeout = DEFAULT_PREFETCH_TIMEOUT;
+		KOTP_LOG_WARNING("KOrgTodoPlugin: Warning: Unknown value (" <<
+		    optVal << ") of the item with the title " \
+		    "(korg_prefetch_timeout) in the config file (" <<
+		    confPath << "). Using the default value (" <<
+		    prefetchTimeout << ").");
+	    }
+	}
+    }
+
+    // Here I attempt to load the path of the calendar new todo items are
+    // added to.
+    if (openedConfFlag) {
+	retval = confManager.GetValue("korg_default_cal_path", optVal, 256);
+	if (retval == 0) {
+	    defaultCalPath.assign(optVal);
+	}
+    }
+
+    if (calPaths.empty())
+	calPaths.push_back(calPath);
+
+    // The calendars are loaded from these paths once they are first needed.
+    ClearCalendars();
+    for (i = 0; i < calPaths.size(); i++) {
+	pCalendar = new CalendarType;
+	pCalendar->filePath = calPaths[i];
+	pCalendar->qFilePath = calPaths[i];
+	pCalendar->cachePath = homeDir;
+	pCalendar->cachePath.append("/.KOrgTodoPlugin.calcache");
+	if (i > 0) {
+	    snprintf(optVal, 256, ".%lu", (unsigned long int)i);
+	    pCalendar->cachePath.append(optVal);
+	}
+	pCalendar->pCal = NULL;
+	pCalendar->timeKey = 0;
+	pCalendar->scanRetval = 1;
+	pCalendar->keyedFlag = false;
+	pCalendar->wroteCalFlag = false;
+	pCalendar->loadedFlag = false;
+	pCalendar->pPlugin = this;
+	calendars.push_back(pCalendar);
+
+	if (calPaths[i] == defaultCalPath)
+	    pDefaultCal = pCalendar;
+    }
+    if (!pDefaultCal) {
+	pDefaultCal = calendars[0];
+	if (!defaultCalPath.empty()) {
+	    KOTP_LOG_WARNING("KOrgTodoPlugin: Warning: Unknown value (" <<
+		defaultCalPath << ") of the item with the title " \
+		"(korg_default_cal_path) in the config file (" <<
+		confPath << "). Using the default value (" <<
+		pDefaultCal->filePath << ").");
+	}
     }
+    korgConfFilePath = korgConfPath;
+
+    // The KDE objects are created on the calling thread, the prefetch thread
+    // only reads files. If they can't be created the calendar is loaded when
+    // it is first needed, which fails the same way.
+    if (prefetchFlag && (CreateCalendars() == 0))
+	StartPrefetch();
 
     /*
     pCal = new KCal::CalendarResources();
@@ -206,6 +378,252 @@ int KOrgTodoPlugin::Initialize(void) {
     return 0;
 }
 
+/**
+ * Ensure the calendar is loaded.
+ *
+ * Load the KOrganizer calendar and everything that goes along with it the
+ * first time the todo items are needed, rather than in Initialize(), so that
+ * a host only asking for the name or version of the plugin, or giving up
+ * before synchronizing, doesn't wait for it. Every entry point touching the
+ * todo items calls this first. The result of the first call is kept, so a
+ * calendar that failed to load isn't tried again. In the prefetch mode the
+ * calendar files and the SyncID log are already being read on a thread
+ * started by Initialize(), and this first waits up to prefetchTimeout
+ * seconds for that thread.
+ * @return An integer representing success (zero) or failure (non-zero).
+ * @retval 0 The calendar is loaded.
+ * @retval 4 Failed to load the KOrganizer calendar files, for whatever
+ * reason OpenCalendar() failed with.
+ * @retval 5 Timed out waiting for the prefetch thread to load the calendar.
+ */
+int KOrgTodoPlugin::EnsureCalendarLoaded(void) {
+    uint64_t startTime;
+    int retval;
+
+    if (calLoadRetval != -1)
+	return calLoadRetval;
+
+    if (prefetchRunningFlag) {
+	startTime = SyncStatsType::Now();
+	if (!JoinPrefetch(prefetchTimeout)) {
+	    syncStats.AddTime(SYNCSTATS_PHASE_PREFETCH_WAIT, startTime);
+	    KOTP_LOG_ERROR("KOrgTodoPlugin: Error: Timed out after " <<
+			   prefetchTimeout << " seconds waiting for the " \
+			   "KOrganizer Calendar files to load.");
+	    calLoadRetval = 5;
+	    return calLoadRetval;
+	}
+	syncStats.AddTime(SYNCSTATS_PHASE_PREFETCH_WAIT, startTime);
+    }
+
+    retval = OpenCalendar();
+
+    // The entry points return this as it is, so the codes OpenCalendar()
+    // fails with, which it logs, are all reported as a failure to load the
+    // calendar file rather than clash with their own.
+    if (retval != 0) {
+	KOTP_LOG_ERROR("KOrgTodoPlugin: Error: Failed to open the " \
+		       "KOrganizer Calendar files (" << retval << ").");
+	retval = 4;
+    }
+    calLoadRetval = retval;
+    return calLoadRetval;
+}
+
+/**
+ * Open the calendar.
+ *
+ * Create the KDE objects the calendars need, unless Initialize() already
+ * did, load the calendar files along with the ID map and the conversion
+ * cache, and start the conversion threads. This is only ever called once,
+ * by EnsureCalendarLoaded(), after the prefetch thread if any finished.
+ * @return An integer representing success (zero) or failure (non-zero).
+ * @retval 0 The calendar is loaded.
+ * @retval 1 Failed to allocate mem for the KAboutData object.
+ * @retval 2 Failed to allocate mem for the KInstance object.
+ * @retval 3 Failed to allocate mem for a CalendarLocal object.
+ * @retval 4 Failed to load one of the KOrganizer calendar files.
+ */
+int KOrgTodoPlugin::OpenCalendar(void) {
+    int retval;
+    SyncStatsTimerType timer(syncStats, SYNCSTATS_PHASE_CALENDAR_OPEN);
+
+    retval = CreateCalendars();
+    if (retval != 0)
+	return retval;
+
+    LoadTimeConv();
+
+    // Load the files located at the calendar paths into the calendar
+    // objects.
+    if (LoadCalendars()) {
+	openedCalFlag = true;
+	LoadIDMap();
+	BuildTodoIndex();
+	LoadConvCache();
+    } else {
+	return 4;
+    }
+
+    // The calling thread converts todo items too, so the pool holds one
+    // thread less than asked for.
+    if (convThreads == 0) {
+	long numProcs = sysconf(_SC_NPROCESSORS_ONLN);
+	convThreads = (numProcs > 0) ? (unsigned long int)numProcs : 1;
+	if (convThreads > MAX_CONV_THREADS)
+	    convThreads = MAX_CONV_THREADS;
+    }
+    if (convThreads > 1) {
+	if (convPool.Start((unsigned int)(convThreads - 1)) != 0) {
+	    KOTP_LOG_WARNING("KOrgTodoPlugin: Warning: Failed to start " \
+			     "the conversion threads, converting todo " \
+			     "items on one thread.");
+	}
+    }
+
+    return 0;
+}
+
+/**
+ * Create the calendar objects.
+ *
+ * Create the KDE objects the calendars need: the KAboutData and KInstance
+ * objects, and a CalendarLocal object in the time zone KOrganizer is set to
+ * for each calendar file. These are only ever touched by the thread the
+ * host calls the plugin on. Nothing is done when they were already created.
+ * @return An integer representing success (zero) or failure (non-zero).
+ * @retval 0 The calendar objects were created.
+ * @retval 1 Failed to allocate mem for the KAboutData object.
+ * @retval 2 Failed to allocate mem for the KInstance object.
+ * @retval 3 Failed to allocate mem for a CalendarLocal object.
+ */
+int KOrgTodoPlugin::CreateCalendars(void) {
+    size_t i;
+
+    // The calendar objects are created in order, so they all exist once
+    // the last one does.
+    if (calendars.back()->pCal)
+	return 0;
+
+    pKAboutData = new KAboutData("KOrgTodoPlugin",
+				 "Zync KOrganizer Todo Plugin",
+				 GetPluginVersion().c_str());
+    if (!pKAboutData) {
+	KOTP_LOG_ERROR("KOrgTodoPlugin::CreateCalendars - " \
+	    "Failed to allocate mem for KAboutData object.");
+	return 1;
+    }
+
+    pKInstance = new KInstance(pKAboutData);
+    if (!pKInstance) {
+	KOTP_LOG_ERROR("KOrgTodoPlugin::CreateCalendars - " \
+	    "Failed to allocate mem for KInstance object.");
+	return 2;
+    }
+
+    KConfig korgcfg(korgConfFilePath.c_str());
+    korgcfg.setGroup("Time & Date");
+    
+    for (i = 0; i < calendars.size(); i++) {
+	calendars[i]->pCal =
+	    new KCal::CalendarLocal(korgcfg.readEntry("TimeZoneId"));
+	if (!calendars[i]->pCal) {
+	    KOTP_LOG_ERROR("KOrgTodoPlugin::CreateCalendars - " \
+		"Failed to allocate mem for CalendarLocal object.");
+	    return 3;
+	}
+	calendars[i]->timeKey =
+	    ConvCacheType::TimeKey(calendars[i]->pCal->timeZoneId());
+    }
+
+    return 0;
+}
+
+/**
+ * Start the prefetch thread.
+ *
+ * Start reading and scanning the calendar files, and reading the SyncID
+ * log, on a thread of its own so that it overlaps with the host setting up
+ * its connection to the Zaurus. The calendar files aren't parsed until
+ * OpenCalendar(), so this mostly helps when the parsed calendar cache can
+ * be used. The calendar objects must already exist.
+ * If the thread can't be started the calendar files are read when they are
+ * first needed, as without the prefetch mode.
+ */
+void KOrgTodoPlugin::StartPrefetch(void) {
+    prefetchDoneFlag = false;
+    prefetchStats.Reset();
+    if (pthread_create(&prefetchThread, NULL, PrefetchMain, this) != 0) {
+	KOTP_LOG_WARNING("KOrgTodoPlugin: Warning: Failed to start the " \
+			 "prefetch thread, the calendar is loaded when " \
+			 "it is first needed.");
+	return;
+    }
+    prefetchRunningFlag = true;
+}
+
+/**
+ * Wait for the prefetch thread.
+ *
+ * Wait for the prefetch thread to finish and join it. Once it has been
+ * joined, the statistics it kept are added to those of the session.
+ * @param timeout The number of seconds to wait at most, or zero to wait as
+ * long as it takes.
+ * @return A boolean representing whether the thread finished and was joined
+ * (true), or is still running (false).
+ */
+bool KOrgTodoPlugin::JoinPrefetch(unsigned long int timeout) {
+    struct timespec deadline;
+    bool doneFlag;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += (time_t)timeout;
+
+    pthread_mutex_lock(&prefetchMutex);
+    while (!prefetchDoneFlag) {
+	if (timeout == 0) {
+	    pthread_cond_wait(&prefetchCond, &prefetchMutex);
+	} else if (pthread_cond_timedwait(&prefetchCond, &prefetchMutex,
+					  &deadline) == ETIMEDOUT) {
+	    break;
+	}
+    }
+    doneFlag = prefetchDoneFlag;
+    pthread_mutex_unlock(&prefetchMutex);
+
+    if (!doneFlag)
+	return false;
+
+    pthread_join(prefetchThread, NULL);
+    prefetchRunningFlag = false;
+    syncStats.Merge(prefetchStats);
+    prefetchStats.Reset();
+    return true;
+}
+
+/**
+ * Run the prefetch thread.
+ *
+ * Scan the calendar files and read the SyncID log, then signal whoever is
+ * waiting in JoinPrefetch(). Neither touches a Qt or libkcal object, the
+ * calendar files are parsed by OpenCalendar() once the thread was joined.
+ * @param pArg Pointer to the KOrgTodoPlugin to prefetch the calendar of.
+ * @return Always NULL.
+ */
+void *KOrgTodoPlugin::PrefetchMain(void *pArg) {
+    KOrgTodoPlugin *pPlugin = (KOrgTodoPlugin *)pArg;
+
+    pPlugin->ScanCalendars();
+    pPlugin->ReadSyncIDLog(pPlugin->prefetchStats);
+
+    pthread_mutex_lock(&pPlugin->prefetchMutex);
+    pPlugin->prefetchDoneFlag = true;
+    pthread_cond_broadcast(&pPlugin->prefetchCond);
+    pthread_mutex_unlock(&pPlugin->prefetchMutex);
+
+    return NULL;
+}
+
 /**
  * Clean up the KOrgTodoPlugin instance.
  *
@@ -216,27 +634,82 @@ int KOrgTodoPlugin::Initialize(void) {
  * @retval 2 Failed to save Calendar file.
  */
 int KOrgTodoPlugin::CleanUp(void) {
+    uint64_t startTime = SyncStatsType::Now();
+    std::string statsPath = homeDir;
+    int statsRetval;
     int retval = 0;
 
+    // A prefetch thread that was given up on, or never waited for, is
+    // given as long again to finish. If it still hasn't, the calendar was
+    // never loaded and nothing below touches what it works on, so it is
+    // left running and the destructor waits for it.
+    if (prefetchRunningFlag && !JoinPrefetch(prefetchTimeout)) {
+	KOTP_LOG_WARNING("KOrgTodoPlugin: Warning: The prefetch thread " \
+			 "is still reading the KOrganizer Calendar files, " \
+			 "leaving it running.");
+    }
+
     // Here, I try to save the synchronization ID log so that the next time I
     // a synchronization is performed I can load it and determine the sync IDs
     // of the items which have been deleted since the last synchronization.
-    retval = SaveSyncIDLog();
-    if (retval != 0) {
-	std::cout << "KOrgTodoPlugin: Error: Failed to save sync ID log (";
-	std::cout << retval << ")." << std::endl;
-	retval = 1;
+    // A session that never got hold of the calendar leaves it as it was, even
+    // when the prefetch thread loaded it.
+    if (calLoadRetval == 0) {
+	retval = SaveSyncIDLog();
+	if (retval != 0) {
+	    KOTP_LOG_ERROR("KOrgTodoPlugin: Error: Failed to save sync ID " \
+			   "log (" << retval << ").");
+	    retval = 1;
+	}
     }
-
-    // Here I attempt to save and close the Calendar file.
-    if (openedCalFlag) {
-	if (!pCal->save(qCalPath)) {
-	    std::cout << "KOrgTodoPlugin: Error: Failed to save calendar. ";
-	    std::cout << "This means that your synchronization on the ";
-	    std::cout << "Desktop side didn't happen.\n";
-	    retval = 2;
+    todoStore.Clear();
+
+    // The temporary buffers of the session are given back along with the
+    // calendar.
+    syncStats.AddCount(SYNCSTATS_ARENA_ALLOCS, convArena.GetNumAllocs());
+    syncStats.AddCount(SYNCSTATS_ARENA_CHUNKS, convArena.GetNumChunkAllocs());
+    convArena.Reset();
+
+    // Here I attempt to save and close the Calendar files, leaving the ones
+    // that didn't change alone. The conversion cache is only saved along
+    // with the calendars, so it never describes todo items the calendar
+    // files don't hold. The SyncIDs mapped this session only go into a
+    // calendar file when it is written anyway, or when the ID map can't hold
+    // them.
+    if (calLoadRetval == 0) {
+	std::set<QString>::const_iterator uidIt;
+	KCal::Todo *pKCalTodo;
+	bool savedMapFlag;
+	bool savedCalsFlag = true;
+	size_t i;
+
+	savedMapFlag = SaveIDMap();
+	for (uidIt = unwrittenSyncIDs.begin();
+	     uidIt != unwrittenSyncIDs.end(); uidIt++) {
+	    pKCalTodo = uidIndex.find(*uidIt);
+	    if (pKCalTodo &&
+		(!savedMapFlag ||
+		 !FindTodoCalendar(pKCalTodo)->changedUIDs.empty()))
+		MarkTodoChanged(pKCalTodo);
 	}
-	pCal->close();
+	idMap.Close();
+
+	for (i = 0; i < calendars.size(); i++) {
+	    if (!SaveCalendar(*calendars[i])) {
+		KOTP_LOG_ERROR("KOrgTodoPlugin: Error: Failed to save " \
+		    "calendar (" << calendars[i]->filePath << "). This " \
+		    "means that your synchronization on the Desktop side " \
+		    "didn't happen.");
+		retval = 2;
+		savedCalsFlag = false;
+	    } else {
+		SaveCalCache(*calendars[i]);
+	    }
+	}
+	if (savedCalsFlag)
+	    SaveConvCache();
+	for (i = 0; i < calendars.size(); i++)
+	    calendars[i]->pCal->close();
     }
 
     /*
@@ -246,8 +719,23 @@ int KOrgTodoPlugin::CleanUp(void) {
     }
     */
 
-    if (pKAboutData)
+    if (pKAboutData) {
 	delete pKAboutData;
+	pKAboutData = NULL;
+    }
+
+    convPool.Stop();
+
+    // Here I save the statistics of the session next to the sync ID log.
+    syncStats.AddTime(SYNCSTATS_PHASE_CLEAN_UP, startTime);
+    statsPath.append("/.KOrgTodoPlugin.stats");
+    statsRetval = syncStats.Save(statsPath);
+    if (statsRetval != 0) {
+	KOTP_LOG_WARNING("KOrgTodoPlugin: Warning: Failed to save sync " \
+			 "statistics (" << statsRetval << ").");
+    }
+
+    LogType::Stop();
 
     return retval;
 }
@@ -259,43 +747,35 @@ int KOrgTodoPlugin::CleanUp(void) {
  * @return A list of all the Todo Items.
  */
 TodoItemType::List KOrgTodoPlugin::GetAllTodoItems(void) {
-    std::cout << "Entered the GetAllTodoItems() function.\n";
     TodoItemType::List todoItemList;
-    KCal::Todo::List kcalTodoList;
-    KCal::Todo::List::iterator kcalIt;
-    TodoItemType newItem;
-    std::cout << "Created all function scoped variables.\n";
+    std::vector<KCal::Todo *>::const_iterator kcalIt;
+    std::vector<TodoItemType *> todoItems;
+    SyncStatsTimerType timer(syncStats, SYNCSTATS_PHASE_GET_ALL_ITEMS);
+
+    // If the calendar can't be loaded there are no todo items to return.
+    if (EnsureCalendarLoaded() != 0)
+	return todoItemList;
 
     // Obtain a list of all the Todo items within the KCal object.
     //kcalTodoList = calendar.rawTodos();
-    kcalTodoList = pCal->rawTodos();
-
-    std::cout << "Obtained todo list from calendar.\n";
-
-    kcalIt = kcalTodoList.begin();
+    const std::vector<KCal::Todo *> &kcalTodoList = GetTodoSnapshot();
+    syncStats.AddCount(SYNCSTATS_ITEMS_SCANNED, kcalTodoList.size());
 
-    std::cout << "Got the beginning of the list.\n";
+    KOTP_LOG_DEBUG("KOrgTodoPlugin::GetAllTodoItems - Converting " <<
+		   kcalTodoList.size() << " todo items.");
 
-    // Here I handle the creation of the modified and new item lists. I do so
-    // by iterating through the todo items in the calendar and comparing their
-    // time of creation and time of last modification to the last time of
-    // synchronization to see if they are newer, or newly modified. Then given
-    // the case I add the items to the proper list so that it may be returned
-    // later.
-    if (!kcalTodoList.empty()) {
-	std::cout << "Calendar list is not empty.\n";
-	for (kcalIt = kcalTodoList.begin(); kcalIt != kcalTodoList.end();
-	     ++kcalIt)
-	{
-	    std::cout << "Setting pKcalTodo to the item pointer.\n";
-	    KCal::Todo *pKcalTodo = *kcalIt;
-	    std::cout << "Set the pKcalTodo item.\n";
-	    newItem = ConvKCalTodo(pKcalTodo);
-	    todoItemList.push_front(newItem);
-	}
+    // Here I make room in the list for each of the todo items, and then
+    // convert them all straight into it in one go.
+    todoItems.reserve(kcalTodoList.size());
+    for (kcalIt = kcalTodoList.begin(); kcalIt != kcalTodoList.end();
+	 ++kcalIt)
+    {
+	KOTP_LOG_TRACE("KOrgTodoPlugin::GetAllTodoItems - Converting " <<
+		       (*kcalIt)->uid() << ".");
+	todoItemList.push_front(TodoItemType());
+	todoItems.push_back(&todoItemList.front());
     }
-
-    std::cout << "Exiting the GetAllTodoItems() function.\n";
+    ConvKCalTodos(kcalTodoList, todoItems);
 
     return todoItemList;
 }
@@ -306,18 +786,23 @@ TodoItemType::List KOrgTodoPlugin::GetAllTodoItems(void) {
  * Get the Todo items that are newer than the last time of synchronized.
  * @param lastTimeSynced last time synchronized, as seconds since Epoch.
  * @return List of the Todo items which are new (created after the last
- * synchronization).
+ * synchronization). It is empty once they were taken with TakeNewTodoItems().
  */
 TodoItemType::List KOrgTodoPlugin::GetNewTodoItems(time_t lastTimeSynced) {
+    SyncStatsTimerType timer(syncStats, SYNCSTATS_PHASE_GET_NEW_ITEMS);
     int retval;
 
+    if (takenNewItems)
+	KOTP_LOG_ERROR("KOrgTodoPlugin::GetNewTodoItems - The new items were " \
+		       "already taken with TakeNewTodoItems().");
+
     if (obtainedSyncLists)
 	return newTodoItemList;
     else {
-	std::cout << "GetNewTodoItems: Called GetAllTodoSyncItems.\n";
 	retval = GetAllTodoSyncItems(lastTimeSynced, newTodoItemList,
 				     modTodoItemList, delTodoItemIdList);
-	std::cout << "GetNewTodoItems: GetAllTodoSyncItems returned.\n";
+	KOTP_LOG_DEBUG("KOrgTodoPlugin::GetNewTodoItems - " \
+		       "GetAllTodoSyncItems returned (" << retval << ").");
     }
 
     return newTodoItemList;
@@ -329,11 +814,16 @@ TodoItemType::List KOrgTodoPlugin::GetNewTodoItems(time_t lastTimeSynced) {
  * Obtain the Todo items that were modified after the last synchronization.
  * @param lastTimeSynced last time synchronized, as seconds since Epoch.
  * @return List of the Todo items that have been modified since the last
- * synchronization.
+ * synchronization. It is empty once they were taken with TakeModTodoItems().
  */
 TodoItemType::List KOrgTodoPlugin::GetModTodoItems(time_t lastTimeSynced) {
+    SyncStatsTimerType timer(syncStats, SYNCSTATS_PHASE_GET_MOD_ITEMS);
     int retval;
 
+    if (takenModItems)
+	KOTP_LOG_ERROR("KOrgTodoPlugin::GetModTodoItems - The modified " \
+		       "items were already taken with TakeModTodoItems().");
+
     if (obtainedSyncLists)
 	return modTodoItemList;
     else {
@@ -351,11 +841,18 @@ TodoItemType::List KOrgTodoPlugin::GetModTodoItems(time_t lastTimeSynced) {
  * last synchronization.
  * @param lastTimeSynced last time synchronized, as seconds since Epoch.
  * @return List of the Todo item IDs of items that have been deleted since the
- * last synchronization.
+ * last synchronization. It is empty once they were taken with
+ * TakeDelTodoItemIDs().
  */
 SyncIDListType KOrgTodoPlugin::GetDelTodoItemIDs(time_t lastTimeSynced) {
+    SyncStatsTimerType timer(syncStats, SYNCSTATS_PHASE_GET_DEL_ITEM_IDS);
     int retval;
 
+    if (takenDelItemIDs)
+	KOTP_LOG_ERROR("KOrgTodoPlugin::GetDelTodoItemIDs - The deleted " \
+		       "item IDs were already taken with " \
+		       "TakeDelTodoItemIDs().");
+
     if (obtainedSyncLists)
 	return delTodoItemIdList;
     else {
@@ -367,55 +864,51 @@ SyncIDListType KOrgTodoPlugin::GetDelTodoItemIDs(time_t lastTimeSynced) {
 }
 
 /**
- * Add the Todo items.
+ * Visit all the Todo items.
  *
- * Add the possed Todo items to the KOrganizer Todo list.
- * @param todoItems List of Todo items to add.
+ * Hand each of the Todo items existing within KOrganizer to the given
+ * visitor in turn, without building a list of them. The todo items are
+ * converted in chunks of VISIT_CHUNK_SIZE, each in one batch like
+ * GetAllTodoItems() converts them, into the same buffer every time.
+ * @param visitor The visitor to hand the Todo items to.
  * @return An integer representing success (zero) or failure (non-zero).
- * @retval 0 Successfully added the items to the KOrg Todo list.
- * @retval 1 Failed to allocate memory for one of the todo items.
- * @retval 2 Failed to add on of the todo items to the KOrg Todo list.
- * @retval 3 Failed to open the calendar file, hence, no adding.
+ * @retval 0 Success, including when the visitor stopped early.
+ * @retval 4 Failed to load the calendar file.
+ * @retval 5 Timed out waiting for the calendar file to load.
  */
-int KOrgTodoPlugin::AddTodoItems(TodoItemType::List todoItems) {
-    TodoItemType::List::iterator it;
-    TodoItemType curItem;
-    KCal::Todo *pKCalTodo;
-    bool tmpBool;
-    std::string funcName;
-
-    funcName = "KOrgTodoPlugin::AddTodoItems - ";
-
-    std::cout << funcName << "Created the function scoped variables.\n";
-
-    // If the calendar was not opened then I want to return notifying the
-    // client application of it.
-    /*
-    if (!openedCalFlag)
-	return 3;
-    */
-
-    for (it = todoItems.begin(); it != todoItems.end(); it++) {
-	std::cout << funcName << "Began an iter of one of the todo items.\n";
-	curItem = *it;
-	std::cout << funcName << "Set current item using iterator.\n";
-
-	pKCalTodo = ConvTodoItemType(&curItem);
-	std::cout << funcName << "Converted the TodoItem to KCal Todo Item.\n";
-	if (pKCalTodo) {
-	    std::cout << funcName << "Adding " << pKCalTodo->description() << \
-		".\n";
-	    tmpBool = pCal->addTodo(pKCalTodo);
-	    if (!tmpBool) {
-		std::cout << funcName << "Failed to add item to calendar.\n";
-		delete pKCalTodo;
-		return 2;
-	    } else {
-		std::cout << funcName << "Added Todo item to calendar.\n";
-	    }
-	} else {
-	    std::cout << funcName << "Failed to alloc space for todo item.\n";
-	    return 1;
+int KOrgTodoPlugin::VisitAllTodoItems(TodoItemVisitorType &visitor) {
+    std::vector<KCal::Todo *> chunkTodos;
+    std::vector<TodoItemType> chunkItems;
+    std::vector<TodoItemType *> chunkItemPtrs;
+    size_t chunkStart, chunkSize;
+    size_t i;
+    int retval;
+    SyncStatsTimerType timer(syncStats, SYNCSTATS_PHASE_GET_ALL_ITEMS);
+
+    retval = EnsureCalendarLoaded();
+    if (retval != 0)
+	return retval;
+
+    const std::vector<KCal::Todo *> &kcalTodoList = GetTodoSnapshot();
+    syncStats.AddCount(SYNCSTATS_ITEMS_SCANNED, kcalTodoList.size());
+
+    chunkItems.resize(std::min(kcalTodoList.size(),
+			       (size_t)VISIT_CHUNK_SIZE));
+    for (i = 0; i < chunkItems.size(); i++)
+	chunkItemPtrs.push_back(&chunkItems[i]);
+
+    for (chunkStart = 0; chunkStart < kcalTodoList.size();
+	 chunkStart += chunkSize) {
+	chunkSize = std::min(kcalTodoList.size() - chunkStart,
+			     (size_t)VISIT_CHUNK_SIZE);
+	chunkTodos.assign(kcalTodoList.begin() + chunkStart,
+			  kcalTodoList.begin() + chunkStart + chunkSize);
+	chunkItemPtrs.resize(chunkSize);
+	ConvKCalTodos(chunkTodos, chunkItemPtrs);
+
+	for (i = 0; i < chunkSize; i++) {
+	    if (!visitor.VisitTodoItem(chunkItems[i]))
+		return 0;
 	}
     }
 
@@ -423,149 +916,405 @@ int KOrgTodoPlugin::AddTodoItems(TodoItemType::List todoItems) {
 }
 
 /**
- * Modify the Todo items.
+ * Take the new Todo items.
  *
- * Modify the Todo items of the KOrganizer Todo list with the values contained
- * in the list of passed Todo items.
- * @param todoItems List of Todo items to use as new data for update.
+ * Obtain the Todo items that are newer than the last time of synchronized by
+ * swapping them into the given list, which saves copying them. The plugin
+ * keeps no copy, so they can only be taken once.
+ * @param lastTimeSynced last time synchronized, as seconds since Epoch.
+ * @param todoItems The list the new Todo items are swapped into. Anything it
+ * held before is discarded.
  * @return An integer representing success (zero) or failure (non-zero).
  * @retval 0 Success.
- * @retval 3 Failed to open the calendar file, hence, no modifying.
+ * @retval 3 Failed to read the sync IDs from the sync ID log.
+ * @retval 4 Failed to load the calendar file.
+ * @retval 5 Timed out waiting for the calendar file to load.
+ * @retval 6 The list was already taken.
  */
-int KOrgTodoPlugin::ModTodoItems(TodoItemType::List todoItems) {
-    TodoItemType::List::iterator it;
-    TodoItemType curTodoItem;
-    KCal::Todo::List kcalTodoList;
-    KCal::Todo::List::iterator kcalIt;
-
-    /*
-    // If the calendar was not opened then I want to return notifying the
-    // client application of it.
-    if (!openedCalFlag)
-	return 3;
-    */
+int KOrgTodoPlugin::TakeNewTodoItems(time_t lastTimeSynced,
+				     TodoItemType::List &todoItems) {
+    SyncStatsTimerType timer(syncStats, SYNCSTATS_PHASE_GET_NEW_ITEMS);
+    int retval = 0;
 
-//    kcalTodoList = calendar.rawTodos();
-    kcalTodoList = pCal->rawTodos();
+    if (takenNewItems)
+	return 6;
 
-    for (it = todoItems.begin(); it != todoItems.end(); it++) {
-	curTodoItem = (*it);
+    if (!obtainedSyncLists)
+	retval = GetAllTodoSyncItems(lastTimeSynced, newTodoItemList,
+				     modTodoItemList, delTodoItemIdList);
 
-	for (kcalIt = kcalTodoList.begin(); kcalIt != kcalTodoList.end();
-	     kcalIt++)
-	{
-	    KCal::Todo *pKcalTodo = *kcalIt;
-
-	    // If the SyncID mathes then I want to remove this item from the
-	    // KOrganizer todo calendar file.
-	    if ((unsigned long int)pKcalTodo->pilotId() == 
-		curTodoItem.GetSyncID()) {
-		// Perform the actual modification of the item now that it
-		// has been found.
-		UpdateKCalTodoItem(pKcalTodo, curTodoItem);
-	    }
-	}
-    }
+    todoItems.clear();
+    todoItems.swap(newTodoItemList);
+    takenNewItems = true;
 
-    return 0;
+    return retval;
 }
 
 /**
- * Delete the Todo items.
+ * Take the modified Todo items.
  *
- * Delete the Todo items that have sync IDs contained in the passed list.
- * @param todoItemIDs The Todo Item IDs of the items to remove.
+ * Obtain the Todo items that were modified after the last synchronization
+ * by swapping them into the given list, which saves copying them. The plugin
+ * keeps no copy, so they can only be taken once.
+ * @param lastTimeSynced last time synchronized, as seconds since Epoch.
+ * @param todoItems The list the modified Todo items are swapped into.
+ * Anything it held before is discarded.
  * @return An integer representing success (zero) or failure (non-zero).
  * @retval 0 Success.
- * @retval 3 Failed to open the calendar file. Hence, no deleting.
+ * @retval 3 Failed to read the sync IDs from the sync ID log.
+ * @retval 4 Failed to load the calendar file.
+ * @retval 5 Timed out waiting for the calendar file to load.
+ * @retval 6 The list was already taken.
  */
-int KOrgTodoPlugin::DelTodoItems(SyncIDListType todoItemIDs) {
-    std::cout << "Entered the DelTodoItems function.\n";
-    SyncIDListType::iterator it;
-    std::cout << "Created SyncIDListType iterator.\n";
-    //KCal::Todo::List kcalTodoList;
-    KCal::Todo::List *pKCalTodoList;
-    pKCalTodoList = NULL;
-    std::cout << "Created pKCalTodoList object.\n";
-    KCal::Todo::List::iterator kcalIt;
-    std::cout << "Created function scoped variables.\n";
-
-    // This line causes it to segfault, I am not sure if eliminating this is
-    //ok or not. Will have to test it.
-    pKCalTodoList = new KCal::Todo::List;
+int KOrgTodoPlugin::TakeModTodoItems(time_t lastTimeSynced,
+				     TodoItemType::List &todoItems) {
+    SyncStatsTimerType timer(syncStats, SYNCSTATS_PHASE_GET_MOD_ITEMS);
+    int retval = 0;
 
-    std::cout << "Attempting to check for opened calendar file.\n";
-    // If the calendar was not opened then I want to return notifying the
-    // client application of it.
-    /*
-    if (!openedCalFlag)
-	return 3;
-    std::cout << "Checked for open calendar file.\n";
-    */
+    if (takenModItems)
+	return 6;
 
-    std::cout << "Obtaining KOrg Todo List.\n";
-    //(*pKCalTodoList) = calendar.rawTodos();
-    (*pKCalTodoList) = pCal->rawTodos();
-    std::cout << "Obtained KOrg Todo List.\n";
+    if (!obtainedSyncLists)
+	retval = GetAllTodoSyncItems(lastTimeSynced, newTodoItemList,
+				     modTodoItemList, delTodoItemIdList);
 
-    if ((!todoItemIDs.empty()) && (!pKCalTodoList->empty())) {
-	std::cout << "Both lists are NOT empty.\n";
-	for (it = todoItemIDs.begin(); it != todoItemIDs.end(); it++) {
-	    for (kcalIt = pKCalTodoList->begin();
-		 kcalIt != pKCalTodoList->end();
-		 kcalIt++)
-	    {
-		KCal::Todo *pKcalTodo = *kcalIt;
-
-		// If the SyncID mathes then I want to remove this item from
-		// the KOrganizer todo calendar file.
-		if ((unsigned long int)pKcalTodo->pilotId() == (*it)) {
-		    //calendar.deleteTodo(pKcalTodo);
-		    pCal->deleteTodo(pKcalTodo);
-		}
-	    }
-	}
-    }
+    todoItems.clear();
+    todoItems.swap(modTodoItemList);
+    takenModItems = true;
 
-    return 0;
+    return retval;
 }
 
 /**
- * Map the item IDs.
+ * Take the deleted Todo Item IDs.
  *
- * Map the unique identifiers between the Zaurus and KOrganizer.
- * @return An integer representing sucess (zero) or failure (non-zero).
+ * Obtain the IDs of the Todo items that were deleted some point after the
+ * last synchronization by swapping them into the given list. The plugin
+ * keeps no copy, so they can only be taken once.
+ * @param lastTimeSynced last time synchronized, as seconds since Epoch.
+ * @param todoItemIDs The list the deleted Todo item IDs are swapped into.
+ * Anything it held before is discarded.
+ * @return An integer representing success (zero) or failure (non-zero).
+ * @retval 0 Success.
+ * @retval 3 Failed to read the sync IDs from the sync ID log.
+ * @retval 4 Failed to load the calendar file.
+ * @retval 5 Timed out waiting for the calendar file to load.
+ * @retval 6 The list was already taken.
  */
-int KOrgTodoPlugin::MapItemIDs(TodoItemType::List todoItems) {
-    TodoItemType::List::iterator it;
-    TodoItemType curTodoItem;
-    QString actAppId;
+int KOrgTodoPlugin::TakeDelTodoItemIDs(time_t lastTimeSynced,
+				       SyncIDListType &todoItemIDs) {
+    SyncStatsTimerType timer(syncStats, SYNCSTATS_PHASE_GET_DEL_ITEM_IDS);
+    int retval = 0;
+
+    if (takenDelItemIDs)
+	return 6;
+
+    if (!obtainedSyncLists)
+	retval = GetAllTodoSyncItems(lastTimeSynced, newTodoItemList,
+				     modTodoItemList, delTodoItemIdList);
+
+    todoItemIDs.clear();
+    todoItemIDs.swap(delTodoItemIdList);
+    takenDelItemIDs = true;
+
+    return retval;
+}
+
+/**
+ * Add the Todo items.
+ *
+ * Add the possed Todo items to the KOrganizer Todo list.
+ * @param todoItems List of Todo items to add.
+ * @return An integer representing success (zero) or failure (non-zero).
+ * @retval 0 Successfully added the items to the KOrg Todo list.
+ * @retval 1 Failed to allocate memory for one of the todo items.
+ * @retval 2 Failed to add on of the todo items to the KOrg Todo list.
+ * @retval 4 Failed to load the calendar file, hence, no adding.
+ * @retval 5 Timed out waiting for the calendar file to load, no adding.
+ */
+int KOrgTodoPlugin::AddTodoItems(TodoItemType::List todoItems) {
+    return AddTodoItemsRef(todoItems);
+}
+
+/**
+ * Add the Todo items, by reference.
+ *
+ * Add the possed Todo items to the KOrganizer Todo list, without copying
+ * them. The items are added as one batch: either all of them are added or,
+ * if any of them fails, none of them are. Each item that failed is logged
+ * along with its SyncID and position in the list.
+ * @param todoItems List of Todo items to add.
+ * @return An integer representing success (zero) or failure (non-zero).
+ * @retval 0 Successfully added the items to the KOrg Todo list.
+ * @retval 1 Failed to allocate memory for one or more of the todo items.
+ * @retval 2 Failed to add on of the todo items to the KOrg Todo list.
+ * @retval 4 Failed to load the calendar file, hence, no adding.
+ * @retval 5 Timed out waiting for the calendar file to load, no adding.
+ */
+int KOrgTodoPlugin::AddTodoItemsRef(const TodoItemType::List &todoItems) {
+    TodoItemType::List::const_iterator it;
+    std::vector<KCal::Todo *> kcalTodos;
+    KCal::Todo *pKCalTodo;
+    size_t numAdded;
+    size_t i;
+    int retval = 0;
+    SyncStatsTimerType timer(syncStats, SYNCSTATS_PHASE_ADD_ITEMS);
+
+    // If the calendar can't be loaded then I want to return notifying the
+    // client application of it.
+    retval = EnsureCalendarLoaded();
+    if (retval != 0)
+	return retval;
+
+    if (todoItems.empty())
+	return 0;
+
+    // Convert the whole batch before touching the calendar, so a failure
+    // leaves nothing to undo there.
+    kcalTodos.reserve(todoItems.size());
+    for (it = todoItems.begin(); it != todoItems.end(); it++) {
+	pKCalTodo = ConvTodoItemType(*it);
+	if (!pKCalTodo) {
+	    KOTP_LOG_ERROR("KOrgTodoPlugin::AddTodoItems - Failed to " \
+			   "alloc space for the todo item with SyncID " <<
+			   it->GetSyncID() << " (item " <<
+			   (kcalTodos.size() + 1) << " of " <<
+			   todoItems.size() << ").");
+	    retval = 1;
+	}
+	kcalTodos.push_back(pKCalTodo);
+    }
+
+    if (retval != 0) {
+	for (i = 0; i < kcalTodos.size(); i++)
+	    delete kcalTodos[i];
+	return retval;
+    }
+
+    // Insert the batch without the calendar notifying its observers of each
+    // item, and take any items added so far back out if one of them fails.
+    pDefaultCal->pCal->setObserversEnabled(false);
+    for (numAdded = 0; numAdded < kcalTodos.size(); numAdded++) {
+	KOTP_LOG_TRACE("KOrgTodoPlugin::AddTodoItems - Adding " <<
+		       kcalTodos[numAdded]->summary() << ".");
+	if (!pDefaultCal->pCal->addTodo(kcalTodos[numAdded])) {
+	    KOTP_LOG_ERROR("KOrgTodoPlugin::AddTodoItems - Failed to add " \
+			   "the todo item with SyncID " <<
+			   kcalTodos[numAdded]->pilotId() << " (item " <<
+			   (numAdded + 1) << " of " << kcalTodos.size() <<
+			   ") to the calendar. None of the " <<
+			   kcalTodos.size() << " items were added.");
+	    retval = 2;
+	    break;
+	}
+    }
+
+    if (retval != 0) {
+	// The calendar frees the items deleted from it, the rest are freed
+	// here.
+	for (i = 0; i < numAdded; i++)
+	    pDefaultCal->pCal->deleteTodo(kcalTodos[i]);
+	for (i = numAdded; i < kcalTodos.size(); i++)
+	    delete kcalTodos[i];
+	pDefaultCal->pCal->setObserversEnabled(true);
+	return retval;
+    }
+    pDefaultCal->pCal->setObserversEnabled(true);
+
+    ReserveTodoIndex(uidIndex.count() + kcalTodos.size());
+    if (todoSnapshotValid)
+	todoSnapshot.reserve(todoSnapshot.size() + kcalTodos.size());
+    for (i = 0; i < kcalTodos.size(); i++) {
+	if (calendars.size() > 1)
+	    todoCalendars.insert(kcalTodos[i], pDefaultCal);
+	IndexTodo(kcalTodos[i]);
+	SnapshotAddTodo(kcalTodos[i]);
+	MarkTodoChanged(kcalTodos[i]);
+	RecordTodoMapping(kcalTodos[i]);
+	RecordFingerprint(kcalTodos[i]);
+    }
+    syncStats.AddCount(SYNCSTATS_ITEMS_ADDED, kcalTodos.size());
+
+    return 0;
+}
+
+/**
+ * Modify the Todo items.
+ *
+ * Modify the Todo items of the KOrganizer Todo list with the values contained
+ * in the list of passed Todo items.
+ * @param todoItems List of Todo items to use as new data for update.
+ * @return An integer representing success (zero) or failure (non-zero).
+ * @retval 0 Success.
+ * @retval 4 Failed to load the calendar file, hence, no modifying.
+ * @retval 5 Timed out waiting for the calendar file to load, no modifying.
+ */
+int KOrgTodoPlugin::ModTodoItems(TodoItemType::List todoItems) {
+    return ModTodoItemsRef(todoItems);
+}
+
+/**
+ * Modify the Todo items, by reference.
+ *
+ * Modify the Todo items of the KOrganizer Todo list with the values contained
+ * in the list of passed Todo items, without copying them.
+ * @param todoItems List of Todo items to use as new data for update.
+ * @return An integer representing success (zero) or failure (non-zero).
+ * @retval 0 Success.
+ * @retval 4 Failed to load the calendar file, hence, no modifying.
+ * @retval 5 Timed out waiting for the calendar file to load, no modifying.
+ */
+int KOrgTodoPlugin::ModTodoItemsRef(const TodoItemType::List &todoItems) {
+    TodoItemType::List::const_iterator it;
     KCal::Todo *pKcalTodo;
+    int retval;
+    SyncStatsTimerType timer(syncStats, SYNCSTATS_PHASE_MOD_ITEMS);
 
-    // If the calendar was not opened then I want to return notifying the
+    // If the calendar can't be loaded then I want to return notifying the
     // client application of it.
-    /*
-    if (!openedCalFlag)
-	return 3;
-    */
+    retval = EnsureCalendarLoaded();
+    if (retval != 0)
+	return retval;
 
     for (it = todoItems.begin(); it != todoItems.end(); it++) {
-	curTodoItem = (*it);
+	// Look up the KOrganizer todo item with the matching SyncID and
+	// perform the actual modification of the item if it was found.
+	pKcalTodo = syncIDIndex.find((long)(int)it->GetSyncID());
+	if (pKcalTodo) {
+	    UpdateKCalTodoItem(pKcalTodo, *it);
+	    MarkTodoChanged(pKcalTodo);
+	    RecordFingerprint(pKcalTodo);
+	    syncStats.AddCount(SYNCSTATS_ITEMS_MODIFIED, 1);
+	}
+    }
 
-	actAppId = curTodoItem.GetAppID().c_str();
+    return 0;
+}
 
-	//pKcalTodo = calendar.todo(actAppId);
-	pKcalTodo = pCal->todo(actAppId);
+/**
+ * Delete the Todo items.
+ *
+ * Delete the Todo items that have sync IDs contained in the passed list.
+ * @param todoItemIDs The Todo Item IDs of the items to remove.
+ * @return An integer representing success (zero) or failure (non-zero).
+ * @retval 0 Success.
+ * @retval 4 Failed to load the calendar file. Hence, no deleting.
+ * @retval 5 Timed out waiting for the calendar file to load, no deleting.
+ */
+int KOrgTodoPlugin::DelTodoItems(SyncIDListType todoItemIDs) {
+    return DelTodoItemsRef(todoItemIDs);
+}
 
-	pKcalTodo->setPilotId(curTodoItem.GetSyncID());
+/**
+ * Delete the Todo items, by reference.
+ *
+ * Delete the Todo items that have sync IDs contained in the passed list,
+ * without copying the list.
+ * @param todoItemIDs The Todo Item IDs of the items to remove.
+ * @return An integer representing success (zero) or failure (non-zero).
+ * @retval 0 Success.
+ * @retval 4 Failed to load the calendar file. Hence, no deleting.
+ * @retval 5 Timed out waiting for the calendar file to load, no deleting.
+ */
+int KOrgTodoPlugin::DelTodoItemsRef(const SyncIDListType &todoItemIDs) {
+    SyncIDListType::const_iterator it;
+    KCal::Todo *pKcalTodo;
+    CalendarType *pCalendar;
+    int retval;
+    SyncStatsTimerType timer(syncStats, SYNCSTATS_PHASE_DEL_ITEMS);
 
-	std::cout << "Mapped KCal UID: " << curTodoItem.GetAppID();
-	std::cout << " to Zaurus UID: " << curTodoItem.GetSyncID();
-	std::cout << std::endl;
+    // If the calendar can't be loaded then I want to return notifying the
+    // client application of it.
+    retval = EnsureCalendarLoaded();
+    if (retval != 0)
+	return retval;
+
+    for (it = todoItemIDs.begin(); it != todoItemIDs.end(); it++) {
+	// If an item with a matching SyncID exists then I want to remove
+	// this item from the KOrganizer todo calendar file. It has to be
+	// removed from the indexes first since deleteTodo() frees it.
+	pKcalTodo = syncIDIndex.find((long)(int)(*it));
+	if (pKcalTodo) {
+	    KOTP_LOG_TRACE("KOrgTodoPlugin::DelTodoItems - Deleting " <<
+			   (*it) << ".");
+	    pCalendar = FindTodoCalendar(pKcalTodo);
+	    UnindexTodo(pKcalTodo);
+	    SnapshotDelTodo(pKcalTodo);
+	    MarkTodoChanged(pKcalTodo);
+	    idMap.Erase((const char *)pKcalTodo->uid().utf8());
+	    unwrittenSyncIDs.erase(pKcalTodo->uid());
+	    pCalendar->cachedTodos.erase(pKcalTodo);
+	    if (calendars.size() > 1)
+		todoCalendars.remove(pKcalTodo);
+	    pCalendar->pCal->deleteTodo(pKcalTodo);
+	    syncStats.AddCount(SYNCSTATS_ITEMS_DELETED, 1);
+	}
     }
 
     return 0;
+}
+
+/**
+ * Map the item IDs.
+ *
+ * Map the unique identifiers between the Zaurus and KOrganizer.
+ * @return An integer representing sucess (zero) or failure (non-zero).
+ * @retval 0 Success.
+ * @retval 1 Failed to find the KOrganizer todo item of one or more of the
+ * items. The remaining items were still mapped.
+ * @retval 4 Failed to load the calendar file, hence, no mapping.
+ * @retval 5 Timed out waiting for the calendar file to load, no mapping.
+ */
+int KOrgTodoPlugin::MapItemIDs(TodoItemType::List todoItems) {
+    return MapItemIDsRef(todoItems);
+}
+
+/**
+ * Map the item IDs, by reference.
+ *
+ * Map the unique identifiers between the Zaurus and KOrganizer, without
+ * copying the passed Todo items. The mappings are recorded in the ID map, so
+ * a session that only maps items doesn't have to rewrite the calendar file.
+ * @return An integer representing sucess (zero) or failure (non-zero).
+ * @retval 0 Success.
+ * @retval 1 Failed to find the KOrganizer todo item of one or more of the
+ * items. The remaining items were still mapped.
+ * @retval 4 Failed to load the calendar file, hence, no mapping.
+ * @retval 5 Timed out waiting for the calendar file to load, no mapping.
+ */
+int KOrgTodoPlugin::MapItemIDsRef(const TodoItemType::List &todoItems) {
+    TodoItemType::List::const_iterator it;
+    QString actAppId;
+    KCal::Todo *pKcalTodo;
+    int retval = 0;
+    SyncStatsTimerType timer(syncStats, SYNCSTATS_PHASE_MAP_ITEM_IDS);
+
+    // If the calendar can't be loaded then I want to return notifying the
+    // client application of it.
+    retval = EnsureCalendarLoaded();
+    if (retval != 0)
+	return retval;
+
+    for (it = todoItems.begin(); it != todoItems.end(); it++) {
+	actAppId = it->GetAppID().c_str();
+
+	pKcalTodo = uidIndex.find(actAppId);
+	if (!pKcalTodo) {
+	    KOTP_LOG_ERROR("KOrgTodoPlugin: Error: Failed to find KCal " \
+			   "UID: " << it->GetAppID() << " to map.");
+	    retval = 1;
+	    continue;
+	}
+
+	SetTodoSyncID(pKcalTodo, it->GetSyncID());
+	RecordFingerprint(pKcalTodo);
+	syncStats.AddCount(SYNCSTATS_ITEMS_MAPPED, 1);
+
+	KOTP_LOG_DEBUG("Mapped KCal UID: " << it->GetAppID() <<
+		       " to Zaurus UID: " << it->GetSyncID());
+    }
 
+    return retval;
 }
 
 /**
@@ -623,12 +1372,14 @@ std::string KOrgTodoPlugin::GetPluginVersion(void) const {
  *
  * Obtain all the sync data from KOrganizer for the Todo synchronization. This
  * includes all the New, Modified, and Deleted Todo item information so that
- * the synchronization can be performed.
+ * the synchronization can be performed. An item modified since the last
+ * synchronization is only reported as modified if its fingerprint differs
+ * from the one logged when it was last synchronized.
  * @return An integer representing success (zero) or failure (non-zero).
  * @retval 0 Success.
- * @retval 1 Failed because calendar file was never opened.
- * @retval 2 Failed to allocate memory for log file content.
- * @retval 3 Failed to read expected num of sync IDs.
+ * @retval 3 Failed to read the sync IDs from the sync ID log.
+ * @retval 4 Failed to load the calendar file.
+ * @retval 5 Timed out waiting for the calendar file to load.
  */
 int KOrgTodoPlugin::GetAllTodoSyncItems(time_t lastTimeSynced,
 					TodoItemType::List &newItemList,
@@ -636,265 +1387,1241 @@ int KOrgTodoPlugin::GetAllTodoSyncItems(time_t lastTimeSynced,
 					SyncIDListType &delItemIdList)
 {
     // Variables used to get the New, and Modified Todo Items.
-    KCal::Todo::List kcalTodoList;
-    KCal::Todo::List::iterator kcalIt;
 //    QDateTime lastSynced;
-    TodoItemType newItem;
+    std::vector<KCal::Todo *> convTodos;
+    std::vector<TodoItemType *> convItems;
+    KCal::Todo *pKcalTodo;
+    uint32_t syncID;
+    uint64_t fingerprint;
+    size_t numUnchanged;
+    size_t i;
 
     // Variables used to get the Deleted Todo Items.
-    std::fstream fin, fout;
-    bool foundSyncID = false;
+    int logRetval;
+    const uint64_t *pLoggedSyncIDs;
+    const uint64_t *pLoggedFingerprints;
+    size_t numLoggedSyncIDs;
+    std::vector<uint64_t> curSyncIDs;
+    std::vector<uint64_t> removedSyncIDs;
+    std::vector<uint64_t>::iterator syncIt;
+    uint64_t startTime;
+    int retval;
+
+    // If the calendar can't be loaded then return with no data so nothing is
+    // synchronized.
+    retval = EnsureCalendarLoaded();
+    if (retval != 0)
+	return retval;
+
+//    lastSynced.setTime_t(lastTimeSynced);
+
+    // Obtain a list of all the Todo items within the KCal object.
+    //kcalTodoList = calendar.rawTodos();
+    const std::vector<KCal::Todo *> &kcalTodoList = GetTodoSnapshot();
+    syncStats.AddCount(SYNCSTATS_ITEMS_SCANNED, kcalTodoList.size());
+
+    // Here I handle the creation of the modified and new item lists. I do so
+    // by iterating through the todo items in the calendar and comparing their
+    // time of creation and time of last modification to the last time of
+    // synchronization to see if they are newer, or newly modified. Then given
+    // the case I add the items to the proper list so that it may be returned
+    // later. The SyncIDs and times of the todo items are first copied into
+    // the todo store, so the scans below run over its columns. The other
+    // synchronized fields are only read for the modified items, to
+    // fingerprint them.
+    startTime = SyncStatsType::Now();
+    todoStore.Build(kcalTodoList, timeConv);
+
+    // KOrganizer updates the last modified time of items for changes that
+    // aren't synchronized, and so does updating an item from the Zaurus.
+    // The modified items whose synchronized fields are the same as when they
+    // were last synchronized are left out, and so never converted.
+    logRetval = LoadSyncIDLog(pLoggedSyncIDs, pLoggedFingerprints,
+			      numLoggedSyncIDs);
+    numUnchanged = 0;
+    for (i = 0; i < todoStore.GetNumTodos(); i++) {
+	pKcalTodo = todoStore.GetTodo(i);
+	syncID = todoStore.GetSyncID(i);
+
+	KOTP_LOG_TRACE("KOrgTodoPlugin::GetAllTodoSyncItems - " <<
+		       pKcalTodo->uid() << " created: " <<
+		       pKcalTodo->created().toString() <<
+		       " last modified: " <<
+		       pKcalTodo->lastModified().toString());
+	if ((todoStore.GetCreated(i) > lastTimeSynced) && (syncID == 0)) {
+	    newItemList.push_front(TodoItemType());
+	    convTodos.push_back(pKcalTodo);
+	    convItems.push_back(&newItemList.front());
+	} else if ((todoStore.GetLastModified(i) > lastTimeSynced) &&
+		   (syncID != 0)) {
+	    fingerprint = todoStore.Fingerprint(i, timeConv, categoryTable);
+	    if (fingerprint == LoggedFingerprint(syncID)) {
+		numUnchanged++;
+		continue;
+	    }
+	    newFingerprints[syncID] = fingerprint;
+	    modItemList.push_front(TodoItemType());
+	    convTodos.push_back(pKcalTodo);
+	    convItems.push_back(&modItemList.front());
+	}
+    }
+
+    // Record the SyncIDs so the deletion check below can work with the full
+    // set of SyncIDs currently in the calendar.
+    todoStore.GetSyncIDs(curSyncIDs);
+    todoStore.Clear();
+    syncStats.AddCount(SYNCSTATS_ITEMS_UNCHANGED, numUnchanged);
+    syncStats.AddTime(SYNCSTATS_PHASE_CLASSIFY, startTime);
+
+    // The new and modified items are converted together once they are all
+    // known, straight into the places made for them above.
+    ConvKCalTodos(convTodos, convItems);
+
+    KOTP_LOG_DEBUG("KOrgTodoPlugin::GetAllTodoSyncItems - Found " <<
+		   newItemList.size() << " new and " << modItemList.size() <<
+		   " modified items, " << numUnchanged << " items were " \
+		   "touched but unchanged.");
+
+    // Here I handle the creation of the deletion list. The idea behind the
+    // deletion list is that a list exist containing all the SyncIDs (UIDs) of
+    // the items that have been removed from the calendar since the last time
+    // of synchronization.
+    // 
+    // I do this by storeing a list of the SyncIDs contained within the
+    // current list of Todo items to a hidden file in the executing users home
+    // directory. The purpose for this is so that the next time they sync the
+    // file can be loaded and if I fail to find any of those SyncIDs in the
+    // current calendar Todo list then I know that, that I item has since been
+    // removed.
+
+    if (numLoggedSyncIDs != 0) {
+	KOTP_LOG_DEBUG("KOrgTodoPlugin::GetAllTodoSyncItems - Read in " <<
+		       numLoggedSyncIDs << " sync ids.");
+
+	// Any of the logged sync ids that are not found among the current
+	// sync ids belong to items that have since been removed. The log
+	// keeps its sync ids sorted, so only the current ones need sorting
+	// before the two sets are compared in a single pass.
+	SyncIDDiff::Sort(curSyncIDs);
+	SyncIDDiff::Difference(pLoggedSyncIDs, numLoggedSyncIDs,
+			       curSyncIDs.empty() ? NULL : &curSyncIDs[0],
+			       curSyncIDs.size(), removedSyncIDs);
+
+	for (syncIt = removedSyncIDs.begin(); syncIt != removedSyncIDs.end();
+	     syncIt++)
+	    delItemIdList.push_front((unsigned long int)(*syncIt));
+
+	KOTP_LOG_DEBUG("KOrgTodoPlugin::GetAllTodoSyncItems - Found " <<
+		       removedSyncIDs.size() << " deleted sync ids.");
+    }
+
+    obtainedSyncLists = true;
+
+    if (logRetval != 0) {
+	return 3;
+    }
+
+    // Return in succes.
+    return 0;
+}
+
+/**
+ * Load the calendar files.
+ *
+ * Load each of the calendar files into its calendar object. The calendar
+ * files are first scanned, see ScanCalendars(), and then loaded one after
+ * the other on the calling thread, as Qt and libkcal aren't safe to use
+ * from several threads at once. Once they are all loaded the statistics of
+ * each load are added to those of the session.
+ * @return A boolean representing whether all the calendar files were
+ * loaded (true) or not (false).
+ */
+bool KOrgTodoPlugin::LoadCalendars(void) {
+    size_t i;
+    bool okFlag = true;
+
+    unwrittenSyncIDs.clear();
+
+    // The prefetch thread may already have scanned them.
+    if (!scannedCalsFlag)
+	ScanCalendars();
+
+    for (i = 0; i < calendars.size(); i++) {
+	calendars[i]->loadedFlag = LoadCalendar(*calendars[i]);
+	syncStats.Merge(calendars[i]->loadStats);
+	calendars[i]->loadStats.Reset();
+	unwrittenSyncIDs.insert(calendars[i]->cachedUnwritten.begin(),
+				calendars[i]->cachedUnwritten.end());
+	calendars[i]->cachedUnwritten.clear();
+
+	if (!calendars[i]->loadedFlag) {
+	    KOTP_LOG_ERROR("KOrgTodoPlugin: Error: Failed to load the " \
+		"KOrganizer Calendar file (" << calendars[i]->filePath <<
+		"). Please edit the config file in your home directory, " \
+		"or the permisions on the calendar file to fix this " \
+		"problem.");
+	    okFlag = false;
+	}
+    }
+
+    return okFlag;
+}
+
+/**
+ * Scan the calendar files.
+ *
+ * Map and scan each of the calendar files and take its key for the parsed
+ * calendar cache. The calendar files beyond the first are scanned on
+ * threads of their own while the calling thread scans the first, so that
+ * reading and hashing them overlaps. This is either done by the prefetch
+ * thread or by LoadCalendars().
+ */
+void KOrgTodoPlugin::ScanCalendars(void) {
+    std::vector<bool> threadFlags(calendars.size(), false);
+    size_t i;
+
+    for (i = 1; i < calendars.size(); i++) {
+	threadFlags[i] = (pthread_create(&calendars[i]->loadThread, NULL,
+					 ScanCalendarMain,
+					 calendars[i]) == 0);
+    }
+
+    ScanCalendar(*calendars[0]);
+
+    // A calendar whose thread couldn't be started is scanned here instead.
+    for (i = 1; i < calendars.size(); i++) {
+	if (threadFlags[i])
+	    pthread_join(calendars[i]->loadThread, NULL);
+	else
+	    ScanCalendar(*calendars[i]);
+    }
+
+    scannedCalsFlag = true;
+}
+
+/**
+ * Run the scanning of a calendar file.
+ *
+ * The start routine of the threads started by ScanCalendars().
+ * @param pArg Pointer to the CalendarType to scan.
+ * @return Always NULL.
+ */
+void *KOrgTodoPlugin::ScanCalendarMain(void *pArg) {
+    CalendarType *pCalendar = (CalendarType *)pArg;
+
+    pCalendar->pPlugin->ScanCalendar(*pCalendar);
+    return NULL;
+}
+
+/**
+ * Scan the calendar file.
+ *
+ * Map the calendar file, split it into its components and take its key for
+ * the parsed calendar cache. Nothing here touches a Qt or libkcal object,
+ * so it may run on any thread; the time key of the calendar is taken
+ * beforehand by the thread that created it.
+ * @param cal The calendar to scan.
+ */
+void KOrgTodoPlugin::ScanCalendar(CalendarType &cal) {
+    SyncStatsTimerType timer(cal.loadStats, SYNCSTATS_PHASE_CALENDAR_LOAD);
+
+    cal.keyedFlag = false;
+    cal.scanRetval = cal.calFile.Open(cal.filePath);
+    if (cal.scanRetval != 0)
+	return;
+
+    cal.keyedFlag = (CalCacheType::FileKey(cal.filePath,
+					   cal.calFile.GetData(),
+					   cal.calFile.GetSize(), cal.timeKey,
+					   cal.fileKey) == 0);
+}
+
+/**
+ * Load the calendar file.
+ *
+ * Load the given calendar file into its calendar object. In the
+ * todo_only load mode the file is split into its components and only the
+ * todo items (along with the time zones they refer to) are parsed, the
+ * remaining components are left untouched in the mapped file so that they
+ * can be written back as they are. In either mode the location of each todo
+ * item within the file is recorded so that SaveCalendar() only has to
+ * rewrite the todo items that changed. A calendar file that hasn't changed
+ * since the last session isn't parsed at all, its todo items are taken from
+ * the parsed calendar cache instead. The calendar file must have been
+ * scanned by ScanCalendar() first. The statistics of the load are kept with
+ * the calendar along with those of the scan.
+ * @param cal The calendar to load.
+ * @return A boolean representing success (true) or failure (false).
+ */
+bool KOrgTodoPlugin::LoadCalendar(CalendarType &cal) {
+    KCal::ICalFormat format;
+    std::vector<IcsComponentType>::const_iterator compIt;
+    std::string icsText;
+    const char *pData;
+    size_t headerSize;
+    SyncStatsTimerType timer(cal.loadStats, SYNCSTATS_PHASE_CALENDAR_LOAD);
+
+    cal.changedUIDs.clear();
+    cal.cachedTodos.clear();
+    cal.cachedUnwritten.clear();
+
+    if (LoadCalCache(cal))
+	return true;
+
+    if (!todoOnlyFlag) {
+	if (!cal.pCal->load(cal.qFilePath))
+	    return false;
+	cal.loadStats.AddCount(SYNCSTATS_BYTES_READ, FileSize(cal.filePath));
+
+	// If the file couldn't be scanned then SaveCalendar() falls back to
+	// writing out the entire calendar.
+	if (cal.calFile.GetData())
+	    IndexCalFileTodos(cal);
+	return true;
+    }
+
+    if (!cal.calFile.GetData()) {
+	KOTP_LOG_ERROR("KOrgTodoPlugin: Error: Failed to scan the calendar " \
+		       "file " << cal.filePath << " (" << cal.scanRetval <<
+		       ").");
+	return false;
+    }
+
+    const std::vector<IcsComponentType> &comps = cal.calFile.GetComponents();
+    pData = cal.calFile.GetData();
+    cal.loadStats.AddCount(SYNCSTATS_BYTES_READ, cal.calFile.GetSize());
+
+    // Build a calendar holding only the header of the file, its time zones
+    // and its todo items, and hand that to the parser.
+    headerSize = comps.empty() ? cal.calFile.GetFooterOffset() :
+	comps[0].offset;
+    icsText.reserve(headerSize);
+    icsText.append(pData, headerSize);
+    for (compIt = comps.begin(); compIt != comps.end(); compIt++) {
+	if ((compIt->kind == ICS_COMP_VTODO) ||
+	    (compIt->kind == ICS_COMP_VTIMEZONE))
+	    icsText.append(pData + compIt->offset, compIt->length);
+    }
+    icsText.append("END:VCALENDAR\r\n");
+
+    format.setTimeZone(cal.pCal->timeZoneId(), !cal.pCal->isLocalTime());
+    if (!format.fromString(cal.pCal, QString::fromUtf8(icsText.data(),
+							icsText.size()))) {
+	cal.calFile.Close();
+	return false;
+    }
+
+    IndexCalFileTodos(cal);
+
+    return true;
+}
+
+/**
+ * Save the calendar file.
+ *
+ * Save the changes made to the given calendar object to its calendar file.
+ * Only the todo items that were added, modified or deleted are serialized.
+ * They are spliced into the bytes of the original file, which are otherwise
+ * copied unchanged, and the result is written next to the calendar file and
+ * then replaces it. Nothing is written when nothing changed.
+ * @param cal The calendar to save.
+ * @return A boolean representing success (true) or failure (false).
+ */
+bool KOrgTodoPlugin::SaveCalendar(CalendarType &cal) {
+    KCal::ICalFormat format;
+    std::vector<std::pair<size_t, QString> > replaced;
+    std::vector<QString> added;
+    std::vector<std::pair<size_t, QString> >::iterator repIt;
+    std::vector<QString>::iterator addIt;
+    std::set<QString>::iterator uidIt;
+    std::map<QString, size_t>::iterator fileIt;
+    std::map<QString, KCal::Todo *> fullTodos;
+    std::map<QString, KCal::Todo *>::iterator fullIt;
     std::string tmpPath;
-    unsigned long int numSyncIDs;
-    unsigned long int numSyncIDsRead = 0;
-    unsigned long int *pSyncIDs;
-    unsigned long int syncCount;
+    KCal::Todo *pKCalTodo;
+    const char *pData;
+    size_t pos;
+    FILE *pFile;
+    long fileSize;
+    bool writeFlag = true;
+    SyncStatsTimerType timer(syncStats, SYNCSTATS_PHASE_CALENDAR_SAVE);
+
+    if (cal.changedUIDs.empty())
+	return true;
+
+    // Without the locations of the todo items in the file the only option is
+    // to write out the entire calendar.
+    if (!cal.calFile.GetData()) {
+	if (!cal.pCal->save(cal.qFilePath))
+	    return false;
+	syncStats.AddCount(SYNCSTATS_BYTES_WRITTEN, FileSize(cal.filePath));
+	cal.wroteCalFlag = (stat(cal.filePath.c_str(),
+				 &cal.writtenCalStat) == 0);
+	for (uidIt = unwrittenSyncIDs.begin();
+	     uidIt != unwrittenSyncIDs.end(); ) {
+	    pKCalTodo = uidIndex.find(*uidIt);
+	    if (!pKCalTodo || (FindTodoCalendar(pKCalTodo) == &cal))
+		unwrittenSyncIDs.erase(uidIt++);
+	    else
+		++uidIt;
+	}
+	cal.changedUIDs.clear();
+	return true;
+    }
 
-    tmpPath = homeDir;
-    tmpPath.append("/.KOrgTodoPlugin.log");
+    // Sort the changed todo items into the ones found in the file, in file
+    // order, and the ones that are new.
+    for (uidIt = cal.changedUIDs.begin(); uidIt != cal.changedUIDs.end();
+	 uidIt++) {
+	fileIt = cal.calFileTodos.find(*uidIt);
+	if (fileIt != cal.calFileTodos.end())
+	    replaced.push_back(std::make_pair(fileIt->second, *uidIt));
+	else if (uidIndex.find(*uidIt))
+	    added.push_back(*uidIt);
+    }
+    std::sort(replaced.begin(), replaced.end());
+
+    format.setTimeZone(cal.pCal->timeZoneId(), !cal.pCal->isLocalTime());
+
+    tmpPath = cal.filePath;
+    tmpPath.append(".tmp");
+    pFile = fopen(tmpPath.c_str(), "w");
+    if (!pFile)
+	return false;
+
+    // The todo items taken from the parsed calendar cache are written as
+    // they were parsed from the file, with the synchronized fields on top.
+    writeFlag = HydrateTodos(cal, replaced, fullTodos);
+
+    // Copy the file up to each changed todo item, then write its current
+    // version in its place, or nothing at all if it was deleted.
+    const std::vector<IcsComponentType> &comps = cal.calFile.GetComponents();
+    pData = cal.calFile.GetData();
+    pos = 0;
+    for (repIt = replaced.begin(); repIt != replaced.end(); repIt++) {
+	const IcsComponentType &comp = comps[repIt->first];
+
+	pKCalTodo = uidIndex.find(repIt->second);
+	fullIt = fullTodos.find(repIt->second);
+	if (fullIt != fullTodos.end())
+	    pKCalTodo = fullIt->second;
+
+	writeFlag = writeFlag && WriteRange(pFile, pData + pos,
+					    comp.offset - pos);
+	writeFlag = writeFlag && WriteTodo(pFile, format, pKCalTodo);
+	pos = comp.offset + comp.length;
+    }
+    writeFlag = writeFlag && WriteRange(pFile, pData + pos,
+					cal.calFile.GetFooterOffset() - pos);
 
-    // If the calendar was never opened then return with no data so nothing is
-    // synchronized.
-    /*
-    if (!openedCalFlag)
+    // New todo items go at the end of the VCALENDAR.
+    for (addIt = added.begin(); addIt != added.end(); addIt++)
+	writeFlag = writeFlag &&
+	    WriteTodo(pFile, format, uidIndex.find(*addIt));
+
+    writeFlag = writeFlag &&
+	WriteRange(pFile, pData + cal.calFile.GetFooterOffset(),
+		   cal.calFile.GetSize() - cal.calFile.GetFooterOffset());
+
+    for (fullIt = fullTodos.begin(); fullIt != fullTodos.end(); fullIt++)
+	delete fullIt->second;
+
+    fileSize = ftell(pFile);
+    if ((fclose(pFile) != 0) || !writeFlag) {
+	unlink(tmpPath.c_str());
+	return false;
+    }
+
+    cal.wroteCalFlag = (stat(tmpPath.c_str(), &cal.writtenCalStat) == 0);
+    if (rename(tmpPath.c_str(), cal.filePath.c_str()) != 0) {
+	cal.wroteCalFlag = false;
+	unlink(tmpPath.c_str());
+	return false;
+    }
+
+    if (fileSize > 0)
+	syncStats.AddCount(SYNCSTATS_BYTES_WRITTEN, (uint64_t)fileSize);
+
+    // The mapped file no longer matches what is on disk, and it now holds
+    // the SyncIDs of the todo items written.
+    cal.calFile.Close();
+    cal.calFileTodos.clear();
+    for (uidIt = cal.changedUIDs.begin(); uidIt != cal.changedUIDs.end();
+	 uidIt++)
+	unwrittenSyncIDs.erase(*uidIt);
+    cal.changedUIDs.clear();
+
+    return true;
+}
+
+/**
+ * Complete the todo items taken from the parsed calendar cache.
+ *
+ * Parse the components of the calendar file about to be replaced that hold
+ * todo items taken from the parsed calendar cache, and copy the fields the
+ * plugin synchronizes from those todo items onto the parsed ones. This gives
+ * the todo items to write in their place, with everything the plugin
+ * doesn't synchronize (alarms, recurrence, attendees and so on) as it was in
+ * the calendar file.
+ * @param cal The calendar about to be saved.
+ * @param replaced The components about to be replaced, along with the UIDs
+ * of their todo items.
+ * @param fullTodos Set to the completed todo items, by UID. They are
+ * allocated with new and belong to the caller, even on failure.
+ * @return A boolean representing success (true) or failure (false).
+ */
+bool KOrgTodoPlugin::HydrateTodos(
+    CalendarType &cal,
+    const std::vector<std::pair<size_t, QString> > &replaced,
+    std::map<QString, KCal::Todo *> &fullTodos) {
+    KCal::ICalFormat format;
+    std::vector<std::pair<size_t, QString> >::const_iterator repIt;
+    std::vector<IcsComponentType>::const_iterator compIt;
+    std::map<QString, KCal::Todo *>::iterator fullIt;
+    std::string icsText;
+    KCal::Todo *pKCalTodo;
+    KCal::Todo *pParsedTodo;
+    const char *pData;
+    size_t headerSize;
+    bool okFlag = true;
+
+    if (cal.cachedTodos.empty())
+	return true;
+
+    // Build a calendar holding only the header of the file, its time zones
+    // and the todo items to complete, as LoadCalendar() does.
+    const std::vector<IcsComponentType> &comps = cal.calFile.GetComponents();
+    pData = cal.calFile.GetData();
+    headerSize = comps.empty() ? cal.calFile.GetFooterOffset() :
+	comps[0].offset;
+    icsText.append(pData, headerSize);
+    for (compIt = comps.begin(); compIt != comps.end(); compIt++) {
+	if (compIt->kind == ICS_COMP_VTIMEZONE)
+	    icsText.append(pData + compIt->offset, compIt->length);
+    }
+    for (repIt = replaced.begin(); repIt != replaced.end(); repIt++) {
+	pKCalTodo = uidIndex.find(repIt->second);
+	if (pKCalTodo &&
+	    (cal.cachedTodos.find(pKCalTodo) != cal.cachedTodos.end())) {
+	    icsText.append(pData + comps[repIt->first].offset,
+			   comps[repIt->first].length);
+	    fullTodos[repIt->second] = NULL;
+	}
+    }
+    if (fullTodos.empty())
+	return true;
+    icsText.append("END:VCALENDAR\r\n");
+
+    KCal::CalendarLocal tmpCal(cal.pCal->timeZoneId());
+    format.setTimeZone(cal.pCal->timeZoneId(), !cal.pCal->isLocalTime());
+    if (!format.fromString(&tmpCal, QString::fromUtf8(icsText.data(),
+						      icsText.size())))
+	okFlag = false;
+
+    for (fullIt = fullTodos.begin(); okFlag && (fullIt != fullTodos.end());
+	 fullIt++) {
+	pParsedTodo = tmpCal.todo(fullIt->first);
+	if (!pParsedTodo) {
+	    okFlag = false;
+	    break;
+	}
+	fullIt->second = pParsedTodo->clone();
+	CalCacheType::CopyFields(uidIndex.find(fullIt->first),
+				 fullIt->second);
+    }
+    tmpCal.close();
+
+    if (!okFlag) {
+	KOTP_LOG_ERROR("KOrgTodoPlugin: Error: Failed to parse the todo " \
+		       "items to write from the calendar file.");
+    }
+
+    return okFlag;
+}
+
+/**
+ * Write a todo item to a file.
+ *
+ * Serialize the given todo item and write its VTODO component to the given
+ * file.
+ * @param pFile The file to write to.
+ * @param format The format used to serialize the todo item.
+ * @param pKCalTodo Pointer to the todo item to write. When it is NULL
+ * nothing is written.
+ * @return A boolean representing success (true) or failure (false).
+ */
+bool KOrgTodoPlugin::WriteTodo(FILE *pFile, KCal::ICalFormat &format,
+			       KCal::Todo *pKCalTodo) {
+    IcsFileType todoFile;
+    QCString todoText;
+    std::vector<IcsComponentType>::const_iterator compIt;
+
+    if (!pKCalTodo)
+	return true;
+
+    // The todo item comes back wrapped in a VCALENDAR of its own.
+    todoText = format.toICalString(pKCalTodo).utf8();
+    if (todoFile.Scan(todoText.data(), todoText.length()) != 0)
+	return false;
+
+    const std::vector<IcsComponentType> &comps = todoFile.GetComponents();
+    for (compIt = comps.begin(); compIt != comps.end(); compIt++) {
+	if (compIt->kind == ICS_COMP_VTODO)
+	    return WriteRange(pFile, todoFile.GetData() + compIt->offset,
+			      compIt->length);
+    }
+
+    return false;
+}
+
+/**
+ * Obtain the size of a file.
+ *
+ * @param filePath The path of the file.
+ * @return The size of the file, or zero if it can't be obtained.
+ */
+uint64_t KOrgTodoPlugin::FileSize(const std::string &filePath) {
+    struct stat fileStat;
+
+    if (stat(filePath.c_str(), &fileStat) != 0)
+	return 0;
+    return (uint64_t)fileStat.st_size;
+}
+
+/**
+ * Index the todo items of the calendar file.
+ *
+ * Record which component of the scanned calendar file holds each todo item,
+ * by the UID of the todo item.
+ * @param cal The calendar whose file was scanned.
+ */
+void KOrgTodoPlugin::IndexCalFileTodos(CalendarType &cal) {
+    std::string uid;
+    size_t i;
+
+    cal.calFileTodos.clear();
+
+    const std::vector<IcsComponentType> &comps = cal.calFile.GetComponents();
+    for (i = 0; i < comps.size(); i++) {
+	if (comps[i].kind != ICS_COMP_VTODO)
+	    continue;
+	if (cal.calFile.GetProperty(comps[i], "UID", uid))
+	    cal.calFileTodos[QString::fromUtf8(uid.data(), uid.size())] = i;
+    }
+}
+
+/**
+ * Mark a todo item as changed.
+ *
+ * Record that the given todo item was added, modified or is about to be
+ * deleted, so that SaveCalendar() writes out the calendar holding it.
+ * @param pKCalTodo Pointer to the KCal::Todo item that changed.
+ */
+void KOrgTodoPlugin::MarkTodoChanged(KCal::Todo *pKCalTodo) {
+    FindTodoCalendar(pKCalTodo)->changedUIDs.insert(pKCalTodo->uid());
+    convCache.Erase(pKCalTodo->uid());
+}
+
+/**
+ * Write a range of bytes to a file.
+ *
+ * @param pFile The file to write to.
+ * @param pData Pointer to the bytes to write.
+ * @param dataSize The number of bytes to write.
+ * @return A boolean representing success (true) or failure (false).
+ */
+bool KOrgTodoPlugin::WriteRange(FILE *pFile, const char *pData,
+				size_t dataSize) {
+    if (dataSize == 0)
+	return true;
+    return (fwrite(pData, 1, dataSize, pFile) == dataSize);
+}
+
+/**
+ * Load the SyncID Log.
+ *
+ * Load the SyncID log and replay the SyncID journal on top of it, obtaining
+ * the SyncIDs of KOrganizer's Todo list, and the fingerprints of their items,
+ * as of the end of the last synchronization. This is only done once per
+ * session, see ReadSyncIDLog(), the result is kept until the SyncID log is
+ * saved.
+ * @param pSyncIDs Set to point to the logged SyncIDs, in ascending order.
+ * @param pFingerprints Set to point to the logged fingerprints, in the order
+ * of the SyncIDs, or NULL when the log has none.
+ * @param numSyncIDs Set to the number of logged SyncIDs.
+ * @return An integer representing success (zero) or failure (non-zero).
+ * @retval 0 Success, including when there has been no synchronization yet.
+ * @retval 1 Failed to read the SyncID log or the SyncID journal.
+ */
+int KOrgTodoPlugin::LoadSyncIDLog(const uint64_t *&pSyncIDs,
+				  const uint64_t *&pFingerprints,
+				  size_t &numSyncIDs) {
+    if (!loadedSyncIDLog)
+	ReadSyncIDLog(syncStats);
+
+    if (numJournalRecords != 0) {
+	pSyncIDs = journaledSyncIDs.empty() ? NULL : &journaledSyncIDs[0];
+	pFingerprints = journaledFingerprints.empty() ?
+	    NULL : &journaledFingerprints[0];
+	numSyncIDs = journaledSyncIDs.size();
+    } else {
+	pSyncIDs = syncIDLog.GetSyncIDs();
+	pFingerprints = syncIDLog.GetFingerprints();
+	numSyncIDs = syncIDLog.GetNumSyncIDs();
+    }
+
+    // A log that could not be opened just means that there has not been a
+    // synchronization yet, any other failure means it could not be read.
+    if ((syncIDLogRetval != 0) && (syncIDLogRetval != 1))
+	return 1;
+    if ((syncIDJournalRetval != 0) && (syncIDJournalRetval != 1))
 	return 1;
-    */
 
-//    lastSynced.setTime_t(lastTimeSynced);
+    return 0;
+}
+
+/**
+ * Read the SyncID log.
+ *
+ * Read the SyncID log and replay the SyncID journal on top of it, keeping
+ * the result for LoadSyncIDLog(). This touches no Qt object, so the
+ * prefetch thread does it too.
+ * @param stats The statistics to add the time and bytes read to.
+ */
+void KOrgTodoPlugin::ReadSyncIDLog(SyncStatsType &stats) {
+    std::string logPath = homeDir;
+    std::string journalPath = homeDir;
+    SyncStatsTimerType timer(stats, SYNCSTATS_PHASE_SYNCID_LOG_LOAD);
+
+    logPath.append("/.KOrgTodoPlugin.log");
+    journalPath.append("/.KOrgTodoPlugin.journal");
+
+    syncIDLogRetval = syncIDLog.Load(logPath);
+    if (syncIDLogRetval != 0) {
+	KOTP_LOG_INFO("KOrgTodoPlugin: Load of sync ID log returned (" <<
+		      syncIDLogRetval << ").");
+    }
+
+    // The journal only means something relative to the log it was started
+    // against, so it is only replayed on top of a good log.
+    syncIDJournalRetval = 1;
+    numJournalRecords = 0;
+    if (syncIDLogRetval == 0) {
+	syncIDJournalRetval = SyncIDJournalType::Replay(journalPath,
+	    syncIDLog.GetChecksum(), syncIDLog.GetSyncIDs(),
+	    syncIDLog.GetFingerprints(), syncIDLog.GetNumSyncIDs(),
+	    journaledSyncIDs, journaledFingerprints, numJournalRecords);
+	if ((syncIDJournalRetval != 0) && (syncIDJournalRetval != 1)) {
+	    KOTP_LOG_WARNING("KOrgTodoPlugin: Replay of sync ID journal " \
+			     "returned (" << syncIDJournalRetval << ").");
+	}
+    }
+
+    if (syncIDLogRetval == 0)
+	stats.AddCount(SYNCSTATS_BYTES_READ, sizeof(SyncIDLogHeader) +
+		       (syncIDLog.GetNumSyncIDs() * sizeof(uint64_t) *
+			(syncIDLog.GetFingerprints() ? 2 : 1)));
+    if (numJournalRecords != 0)
+	stats.AddCount(SYNCSTATS_BYTES_READ, sizeof(SyncIDJournalHeader) +
+		       (numJournalRecords * sizeof(SyncIDJournalRecord)));
+
+    loadedSyncIDLog = true;
+}
+
+/**
+ * Get a logged fingerprint.
+ *
+ * Look up the fingerprint logged for the todo item with the given SyncID
+ * when it was last synchronized.
+ * @param syncID The SyncID of the todo item.
+ * @return The logged fingerprint.
+ * @retval 0 No fingerprint was logged for the SyncID.
+ */
+uint64_t KOrgTodoPlugin::LoggedFingerprint(uint64_t syncID) {
+    const uint64_t *pSyncIDs;
+    const uint64_t *pFingerprints;
+    const uint64_t *pFound;
+    size_t numSyncIDs;
+
+    LoadSyncIDLog(pSyncIDs, pFingerprints, numSyncIDs);
+    if (!pFingerprints || (numSyncIDs == 0))
+	return 0;
+
+    pFound = std::lower_bound(pSyncIDs, pSyncIDs + numSyncIDs, syncID);
+    if ((pFound == (pSyncIDs + numSyncIDs)) || (*pFound != syncID))
+	return 0;
+    return pFingerprints[pFound - pSyncIDs];
+}
+
+/**
+ * Record the fingerprint of a todo item.
+ *
+ * Record the fingerprint of a todo item whose content the Zaurus has been
+ * brought up to date with, so that it is logged with its SyncID. Todo items
+ * without a SyncID are recorded once they are mapped to one. The todo item
+ * is fingerprinted through the todo store rather than converted.
+ * @param pKCalTodo Pointer to the todo item.
+ */
+void KOrgTodoPlugin::RecordFingerprint(KCal::Todo *pKCalTodo) {
+    size_t row;
+
+    if (pKCalTodo->pilotId() == 0)
+	return;
+
+    todoStore.Reset();
+    row = todoStore.Add(pKCalTodo, timeConv);
+    newFingerprints[(uint32_t)pKCalTodo->pilotId()] =
+	todoStore.Fingerprint(row, timeConv, categoryTable);
+}
+
+/**
+ * Save the SyncID Log.
+ *
+ * Save the SyncID log (a log file containing a record of all the items
+ * SyncIDs). This is used to save the current state of the SyncIDs of
+ * KOrganizer's Todo list for access at a later point. Specifically so that it
+ * can be used to check for removal of items for the purpose of generating the
+ * deltoodItemIdList.
+ *
+ * Normally only the SyncIDs added and removed since the last synchronization,
+ * and those whose fingerprint changed, are appended to the SyncID journal.
+ * The whole SyncID log is rewritten, and the journal emptied, when the
+ * journal would grow past journalMaxRecords entries or when the previous log
+ * or journal could not be used.
+ * @return An integer representing success (zero) or failure (non-zero).
+ * @retval 0 Success.
+ * @retval 1 Failed to open the file for output.
+ * @retval 2 Failed to write the file.
+ * @retval 3 Failed to replace the previous log with the new one.
+ */
+int KOrgTodoPlugin::SaveSyncIDLog(void) {
+    std::string tmpPath = homeDir;
+    std::string journalPath = homeDir;
+    std::vector<uint64_t> syncIDs;
+    std::vector<uint64_t> fingerprints;
+    std::vector<uint64_t> addedSyncIDs;
+    std::vector<uint64_t> addedFingerprints;
+    std::vector<uint64_t> removedSyncIDs;
+    const uint64_t *pLoggedSyncIDs;
+    const uint64_t *pLoggedFingerprints;
+    size_t numLoggedSyncIDs;
+    std::vector<KCal::Todo *>::const_iterator kcalIt;
+    std::map<uint64_t, uint64_t>::const_iterator fpIt;
+    size_t logPos;
+    size_t i;
+    int retval;
+    SyncStatsTimerType timer(syncStats, SYNCSTATS_PHASE_SYNCID_LOG_SAVE);
+
+    tmpPath.append("/.KOrgTodoPlugin.log");
+    journalPath.append("/.KOrgTodoPlugin.journal");
 
     // Obtain a list of all the Todo items within the KCal object.
     //kcalTodoList = calendar.rawTodos();
-    kcalTodoList = pCal->rawTodos();
+    const std::vector<KCal::Todo *> &kcalTodoList = GetTodoSnapshot();
 
+    // Collect the SyncIDs of all the items that have a pilotId() (rather
+    // SyncID) greater than zero. The log stores them sorted.
+    syncIDs.reserve(kcalTodoList.size());
+    for (kcalIt = kcalTodoList.begin(); kcalIt != kcalTodoList.end(); kcalIt++)
+    {
+	KCal::Todo *pKcalTodo = *kcalIt;
+	if (pKcalTodo->pilotId() != 0)
+	    syncIDs.push_back((uint32_t)pKcalTodo->pilotId());
+    }
+    SyncIDDiff::Sort(syncIDs);
+
+    // Pair each SyncID with the fingerprint recorded this session, or else
+    // the one logged before. Both the SyncIDs and the logged ones are sorted
+    // so this is a single pass over each.
+    retval = LoadSyncIDLog(pLoggedSyncIDs, pLoggedFingerprints,
+			   numLoggedSyncIDs);
+    fingerprints.resize(syncIDs.size(), 0);
+    logPos = 0;
+    for (i = 0; i < syncIDs.size(); i++) {
+	fpIt = newFingerprints.find(syncIDs[i]);
+	if (fpIt != newFingerprints.end()) {
+	    fingerprints[i] = fpIt->second;
+	    continue;
+	}
+	while ((logPos < numLoggedSyncIDs) &&
+	       (pLoggedSyncIDs[logPos] < syncIDs[i]))
+	    logPos++;
+	if (pLoggedFingerprints && (logPos < numLoggedSyncIDs) &&
+	    (pLoggedSyncIDs[logPos] == syncIDs[i]))
+	    fingerprints[i] = pLoggedFingerprints[logPos];
+    }
 
-    std::cout << "GetAllTodoSyncItems: Got Raw Todos.\n";
+    // Work out what changed relative to the logged SyncIDs. SyncIDs whose
+    // fingerprint changed are journaled the same way as added ones.
+    if ((retval == 0) && (syncIDLogRetval == 0)) {
+	SyncIDDiff::Difference(syncIDs.empty() ? NULL : &syncIDs[0],
+			       syncIDs.size(), pLoggedSyncIDs,
+			       numLoggedSyncIDs, addedSyncIDs);
+	SyncIDDiff::Difference(pLoggedSyncIDs, numLoggedSyncIDs,
+			       syncIDs.empty() ? NULL : &syncIDs[0],
+			       syncIDs.size(), removedSyncIDs);
+	for (fpIt = newFingerprints.begin(); fpIt != newFingerprints.end();
+	     fpIt++) {
+	    if (std::binary_search(pLoggedSyncIDs,
+				   pLoggedSyncIDs + numLoggedSyncIDs,
+				   fpIt->first) &&
+		std::binary_search(syncIDs.begin(), syncIDs.end(),
+				   fpIt->first) &&
+		(LoggedFingerprint(fpIt->first) != fpIt->second))
+		addedSyncIDs.push_back(fpIt->first);
+	}
+	addedFingerprints.reserve(addedSyncIDs.size());
+	for (i = 0; i < addedSyncIDs.size(); i++) {
+	    addedFingerprints.push_back(
+		fingerprints[std::lower_bound(syncIDs.begin(), syncIDs.end(),
+					      addedSyncIDs[i]) -
+			     syncIDs.begin()]);
+	}
 
-    // Here I handle the creation of the modified and new item lists. I do so
-    // by iterating through the todo items in the calendar and comparing their
-    // time of creation and time of last modification to the last time of
-    // synchronization to see if they are newer, or newly modified. Then given
-    // the case I add the items to the proper list so that it may be returned
-    // later.
-    if (!kcalTodoList.empty()) {
-	std::cout << "The kcalTodoList is not empty.\n";
-	for (kcalIt = kcalTodoList.begin(); kcalIt != kcalTodoList.end();
-	     ++kcalIt)
-	{
-	    std::cout << "Setting pKcalTodo to the item pointer.\n";
-	    KCal::Todo *pKcalTodo = *kcalIt;
-	    std::cout << "Set the pKcalTodo item.\n";
-
-	    time_t tempTime;
-
-	    std::cout << "Created Str: " << pKcalTodo->created().toString();
-	    std::cout << std::endl;
-	    tempTime = ConvQDateTime(pKcalTodo->created());
-	    std::cout << "Created: " << ctime((const time_t *)&tempTime);
-	    std::cout << " Last Synced: " << ctime((const time_t *)&lastTimeSynced) << std::endl;
-	    if ((ConvQDateTime(pKcalTodo->created()) > lastTimeSynced) && (pKcalTodo->pilotId() == 0)) {
-		std::cout << "Created after lastSynced.\n";
-		newItem = ConvKCalTodo(pKcalTodo);
-		std::cout << "Converted KCal Todo.\n";
-		newItemList.push_front(newItem);
-		std::cout << "Added new item to list.\n";
-	    } else if ((ConvQDateTime(pKcalTodo->lastModified()) > lastTimeSynced) && (pKcalTodo->pilotId() != 0)) {
-		std::cout << "Modified after lastSynced.\n";
-		newItem = ConvKCalTodo(pKcalTodo);
-		std::cout << "Converted KCal Todo.\n";
-		modItemList.push_front(newItem);
-		std::cout << "Added modified item to list.\n";
+	if ((numJournalRecords + addedSyncIDs.size() + removedSyncIDs.size())
+	    <= journalMaxRecords) {
+	    retval = SyncIDJournalType::Append(journalPath,
+					       syncIDLog.GetChecksum(),
+					       addedSyncIDs, addedFingerprints,
+					       removedSyncIDs);
+	    if (retval == 0) {
+		syncStats.AddCount(SYNCSTATS_BYTES_WRITTEN,
+				   (addedSyncIDs.size() +
+				    removedSyncIDs.size()) *
+				   sizeof(SyncIDJournalRecord));
+		ReleaseSyncIDLog();
+		newFingerprints.clear();
+		return 0;
 	    }
-	    std::cout << "GetAllTodoSyncItems: Ended one iteration.\n";
+	    KOTP_LOG_WARNING("KOrgTodoPlugin: Append to sync ID journal " \
+			     "returned (" << retval << ").");
 	}
-	std::cout << "Exited for loop.\n";
     }
 
-    std::cout << "GetAllTodoSyncItems: Created New and Mod lists.\n";
+    // Fold everything back into the log. The journal is only reset once the
+    // new log is in place, a journal that doesn't match the log is ignored.
+    ReleaseSyncIDLog();
+    newFingerprints.clear();
+    retval = SyncIDLogType::Save(tmpPath, syncIDs, fingerprints);
+    if (retval != 0)
+	return retval;
+    syncStats.AddCount(SYNCSTATS_BYTES_WRITTEN, sizeof(SyncIDLogHeader) +
+		       (syncIDs.size() * 2 * sizeof(uint64_t)));
+
+    SyncIDJournalType::Reset(journalPath,
+			     SyncIDLogType::Checksum(syncIDs.empty() ?
+						     NULL : &syncIDs[0],
+						     fingerprints.empty() ?
+						     NULL : &fingerprints[0],
+						     syncIDs.size()));
 
-    // Here I handle the creation of the deletion list. The idea behind the
-    // deletion list is that a list exist containing all the SyncIDs (UIDs) of
-    // the items that have been removed from the calendar since the last time
-    // of synchronization.
-    // 
-    // I do this by storeing a list of the SyncIDs contained within the
-    // current list of Todo items to a hidden file in the executing users home
-    // directory. The purpose for this is so that the next time they sync the
-    // file can be loaded and if I fail to find any of those SyncIDs in the
-    // current calendar Todo list then I know that, that I item has since been
-    // removed.
+    return 0;
+}
 
-    std::cout << "Attempting to open log.\n";
-    std::cout << "tmpPath = " << tmpPath << std::endl;
-    fin.open(tmpPath.c_str(), std::fstream::in);
-    std::cout << "Finished open log call.\n";
-    if (fin.is_open()) {
-
-	std::cout << "Opened the log file.\n";
-
-	// Obtain the number of sync ids contained within the log file so I
-	// know how much memory to allocate and I know how many bytes to read
-	// in.
-	fin.read((char *)&numSyncIDs, 4);
-
-	// Here, I check to see if the .KOrgTodoPlugin.log has hit the end of
-	// file at this point. If it has hit the end of file then we know that
-	// the log file does not contain valid data and possibly no data. In
-	// either case I want the numSyncIDs to represent 0 because I want it
-	// to act as if there were no items in the file.
-	if (!fin.good()) {
-	    numSyncIDs = 0;
-	}
+/**
+ * Release the SyncID Log.
+ *
+ * Release the SyncID log and the replayed SyncIDs loaded by LoadSyncIDLog().
+ */
+void KOrgTodoPlugin::ReleaseSyncIDLog(void) {
+    syncIDLog.Close();
+    journaledSyncIDs.clear();
+    journaledFingerprints.clear();
+    numJournalRecords = 0;
+    loadedSyncIDLog = false;
+}
+
+/**
+ * Load the time zone transition table.
+ *
+ * Load the transition table of the local time zone the times of the todo
+ * items are converted with. Without it they are converted by Qt, which
+ * gives the same results one libc call at a time.
+ */
+void KOrgTodoPlugin::LoadTimeConv(void) {
+    int retval;
 
-	std::cout << "Read the num of sync ids in log (" << numSyncIDs;
-	std::cout << ").\n";
+    retval = timeConv.Load();
+    if (retval != 0) {
+	KOTP_LOG_INFO("KOrgTodoPlugin: Converting times through libc, " \
+		      "failed to load the time zone (" <<
+		      timeConv.GetZonePath() << ") (" << retval << ").");
+	return;
+    }
 
-	// Dynamically allocate an array large enough to hold all the sync ids
-	// stored in the log file.
-	if (numSyncIDs) {
-	    pSyncIDs = new unsigned long int[numSyncIDs];
-	    if (pSyncIDs == NULL)
-		return 2;
-	}
+    KOTP_LOG_DEBUG("KOrgTodoPlugin::LoadTimeConv - Loaded " <<
+		   timeConv.GetNumTransitions() << " transitions from " <<
+		   timeConv.GetZonePath() << ".");
+}
 
-	// Load all the sync ids into the dynamically allocated array.
-	for (syncCount = 0; (syncCount < numSyncIDs); syncCount++) {
-	    fin.read((char *)&pSyncIDs[syncCount], 4);
-	    // Now, while reading in the content of the file, if for some
-	    // reason I hit eof before I should I want to set the numSyncIDs
-	    // to the number of sync IDs successufully read in.
-	    /*
-	    if (fin.good()) {
-		numSyncIDsRead = syncCount;
-	    }
-	    */
-	}
+/**
+ * Load the conversion cache.
+ *
+ * Load the todo items converted by earlier sessions from the conversion
+ * cache in the users home directory. A missing or unusable cache only means
+ * that every todo item is converted again.
+ */
+void KOrgTodoPlugin::LoadConvCache(void) {
+    std::string cachePath = homeDir;
+    int retval;
+    SyncStatsTimerType timer(syncStats, SYNCSTATS_PHASE_CONV_CACHE_LOAD);
+
+    cachePath.append("/.KOrgTodoPlugin.convcache");
+    retval = convCache.Load(cachePath, ConvCacheType::TimeKey(
+				calendars[0]->pCal->timeZoneId()));
+    if ((retval != 0) && (retval != 1)) {
+	KOTP_LOG_INFO("KOrgTodoPlugin: Discarded the conversion cache (" <<
+		      retval << ").");
+    }
 
-	numSyncIDsRead = syncCount;
-
-	std::cout << "Read in " << numSyncIDsRead << " sync ids.\n";
-
-	// At this point the array should be filled with all of the sync
-	// ids. Hence, I should be able to continue with the process.
-	for (syncCount = 0; syncCount < numSyncIDsRead; syncCount++) {
-	    foundSyncID = false;
-
-	    if (!kcalTodoList.empty()) {
-		std::cout << "KCal Todo list is not empty.\n";
-		for (kcalIt = kcalTodoList.begin();
-		     kcalIt != kcalTodoList.end();
-		     kcalIt++)
-		{
-		    KCal::Todo *pKcalTodo = *kcalIt;
-		    
-		    if ((unsigned long int)pKcalTodo->pilotId() ==
-			pSyncIDs[syncCount]) {
-			foundSyncID = true;
-		    }
-		}
-	    }
+    KOTP_LOG_DEBUG("KOrgTodoPlugin::LoadConvCache - Loaded " <<
+		   convCache.GetNumEntries() << " converted todo items.");
+}
 
-	    if (!foundSyncID) {
-		std::cout << "sync id not found.\n";
-		delItemIdList.push_front(pSyncIDs[syncCount]);
-		std::cout << "Added to del item list.\n";
-	    }
-	    std::cout << "Finished an iteration (" << syncCount << ").\n";
-	}
+/**
+ * Save the conversion cache.
+ *
+ * Save the conversion cache to the users home directory, dropping the todo
+ * items no longer in the calendar.
+ */
+void KOrgTodoPlugin::SaveConvCache(void) {
+    std::string cachePath = homeDir;
+    int retval;
+    SyncStatsTimerType timer(syncStats, SYNCSTATS_PHASE_CONV_CACHE_SAVE);
 
-	std::cout << "Finished sync id loop.\n";
+    cachePath.append("/.KOrgTodoPlugin.convcache");
+    retval = convCache.Save(cachePath, uidIndex);
+    if (retval != 0) {
+	KOTP_LOG_WARNING("KOrgTodoPlugin: Warning: Failed to save the " \
+			 "conversion cache (" << retval << ").");
+    }
+}
 
-	if (numSyncIDs) {
-	    delete [] pSyncIDs;
-	    std::cout << "Freed sync id list memory.\n";
+/**
+ * Load the parsed calendar cache.
+ *
+ * Load the todo items of the calendar file from the parsed calendar cache in
+ * the users home directory, provided it was saved for the calendar file as
+ * it is now, as ScanCalendar() found it. The components of the todo items
+ * are still recorded, as they are needed to write them back.
+ * @param cal The calendar to load.
+ * @return A boolean representing whether the todo items were taken from the
+ * cache (true) or the calendar file has to be parsed (false).
+ */
+bool KOrgTodoPlugin::LoadCalCache(CalendarType &cal) {
+    std::vector<KCal::Todo *> todos;
+    size_t numAdded;
+    size_t i;
+    int retval;
+    SyncStatsTimerType timer(cal.loadStats, SYNCSTATS_PHASE_CAL_CACHE_LOAD);
+
+    if (!cal.keyedFlag)
+	return false;
+
+    retval = cal.calCache.Load(cal.cachePath, cal.fileKey, todos,
+			       cal.cachedUnwritten);
+    if (retval == 5) {
+	KOTP_LOG_DEBUG("KOrgTodoPlugin::LoadCalCache - The calendar file " \
+		       "changed since the parsed calendar cache was saved.");
+	return false;
+    } else if (retval != 0) {
+	if (retval != 1) {
+	    KOTP_LOG_INFO("KOrgTodoPlugin: Discarded the parsed calendar " \
+			  "cache (" << retval << ").");
 	}
+	return false;
+    }
+
+    cal.pCal->setObserversEnabled(false);
+    for (numAdded = 0; numAdded < todos.size(); numAdded++) {
+	if (!cal.pCal->addTodo(todos[numAdded]))
+	    break;
+    }
+    cal.pCal->setObserversEnabled(true);
+
+    if (numAdded < todos.size()) {
+	KOTP_LOG_WARNING("KOrgTodoPlugin: Warning: Failed to add the todo " \
+			 "items of the parsed calendar cache to the " \
+			 "calendar, parsing the calendar file instead.");
+	for (i = 0; i < numAdded; i++)
+	    cal.pCal->deleteTodo(todos[i]);
+	for (i = numAdded; i < todos.size(); i++)
+	    delete todos[i];
+	cal.cachedUnwritten.clear();
+	return false;
     }
 
-    std::cout << "Attempting to close log file.\n";
+    cal.cachedTodos.insert(todos.begin(), todos.end());
+    cal.loadStats.AddCount(SYNCSTATS_BYTES_READ, cal.calFile.GetSize());
+    IndexCalFileTodos(cal);
 
-    fin.close();
+    KOTP_LOG_DEBUG("KOrgTodoPlugin::LoadCalCache - Loaded " << todos.size() <<
+		   " todo items from the parsed calendar cache.");
 
-    std::cout << "Closed log file.\n";
+    return true;
+}
 
-    obtainedSyncLists = true;
+/**
+ * Save the parsed calendar cache.
+ *
+ * Save the todo items of the calendar to the parsed calendar cache in the
+ * users home directory, keyed to the calendar file as it is on disk now.
+ * This is only done once the calendar was saved.
+ * @param cal The calendar that was saved.
+ */
+void KOrgTodoPlugin::SaveCalCache(CalendarType &cal) {
+    std::vector<KCal::Todo *> todos;
+    std::vector<KCal::Todo *>::const_iterator snapIt;
+    IcsFileType keyFile;
+    CalCacheKeyType fileKey;
+    const char *pData;
+    size_t dataSize;
+    int retval;
+    SyncStatsTimerType timer(syncStats, SYNCSTATS_PHASE_CAL_CACHE_SAVE);
+
+    // Writing the calendar file closes it, the key is then taken from the
+    // file as written.
+    pData = cal.calFile.GetData();
+    dataSize = cal.calFile.GetSize();
+    if (!pData) {
+	if (keyFile.Open(cal.filePath) != 0)
+	    return;
+	pData = keyFile.GetData();
+	dataSize = keyFile.GetSize();
+    }
 
-    if (numSyncIDsRead != numSyncIDs) {
-	return 3;
+    if (CalCacheType::FileKey(cal.filePath, pData, dataSize,
+			      ConvCacheType::TimeKey(cal.pCal->timeZoneId()),
+			      fileKey) != 0)
+	return;
+
+    if (cal.wroteCalFlag &&
+	((fileKey.inode != (uint64_t)cal.writtenCalStat.st_ino) ||
+	 (fileKey.size != (uint64_t)cal.writtenCalStat.st_size) ||
+	 (fileKey.mtime != (int64_t)cal.writtenCalStat.st_mtime))) {
+	KOTP_LOG_INFO("KOrgTodoPlugin: The calendar file changed after it " \
+		      "was saved, not saving the parsed calendar cache.");
+	return;
     }
 
-    std::cout << "GetAllTodoSyncITems: Exiting function.\n";
+    const std::vector<KCal::Todo *> &kcalTodoList = GetTodoSnapshot();
+    todos.reserve(kcalTodoList.size());
+    for (snapIt = kcalTodoList.begin(); snapIt != kcalTodoList.end();
+	 snapIt++) {
+	if (FindTodoCalendar(*snapIt) == &cal)
+	    todos.push_back(*snapIt);
+    }
 
-    // Return in succes.
-    return 0;
+    retval = cal.calCache.Save(cal.cachePath, fileKey, todos,
+			       unwrittenSyncIDs);
+    if (retval != 0) {
+	KOTP_LOG_WARNING("KOrgTodoPlugin: Warning: Failed to save the " \
+			 "parsed calendar cache (" << retval << ").");
+    }
 }
 
 /**
- * Save the SyncID Log.
+ * Load the ID map.
  *
- * Save the SyncID log (a log file containing a record of all the items
- * SyncIDs). This is used to save the current state of the SyncIDs of
- * KOrganizer's Todo list for access at a later point. Specifically so that it
- * can be used to check for removal of items for the purpose of generating the
- * deltoodItemIdList.
- * @return An integer representing success (zero) or failure (non-zero).
- * @retval 0 Success.
- * @retval 1 Failed to open the file for output.
+ * Load the ID map from the users home directory and bring the SyncIDs of the
+ * todo items of the calendar up to date with it. The ID map holds mappings
+ * made since the calendar file was last written, so it takes precedence over
+ * the SyncIDs in the calendar file. Todo items the ID map doesn't know, as
+ * when it is missing, are taken into it with the SyncID they have. This is
+ * done before the todo items are indexed.
  */
-int KOrgTodoPlugin::SaveSyncIDLog(void) {
-    std::string tmpPath = homeDir;
-    std::fstream fout;
-    unsigned long int numSyncIDs;
-    unsigned long int tmpSyncID;
+void KOrgTodoPlugin::LoadIDMap(void) {
+    std::string mapPath = homeDir;
     KCal::Todo::List kcalTodoList;
     KCal::Todo::List::iterator kcalIt;
+    KCal::Todo *pKCalTodo;
+    std::string uid;
+    uint64_t syncID;
+    size_t i;
+    int retval;
+    SyncStatsTimerType timer(syncStats, SYNCSTATS_PHASE_IDMAP_LOAD);
 
-    tmpPath.append("/.KOrgTodoPlugin.log");
-
-    // Obtain a list of all the Todo items within the KCal object.
-    //kcalTodoList = calendar.rawTodos();
-    kcalTodoList = pCal->rawTodos();
+    mapPath.append("/.KOrgTodoPlugin.idmap");
+    retval = idMap.Load(mapPath);
+    if ((retval != 0) && (retval != 1)) {
+	KOTP_LOG_INFO("KOrgTodoPlugin: Discarded the ID map (" << retval <<
+		      ").");
+    }
 
+    for (i = 0; i < calendars.size(); i++) {
+	kcalTodoList = calendars[i]->pCal->rawTodos();
+	for (kcalIt = kcalTodoList.begin(); kcalIt != kcalTodoList.end();
+	     kcalIt++) {
+	    pKCalTodo = *kcalIt;
+	    uid = (const char *)pKCalTodo->uid().utf8();
+	    if (idMap.FindSyncID(uid, syncID)) {
+		if ((uint32_t)pKCalTodo->pilotId() != syncID) {
+		    pKCalTodo->setPilotId((int)syncID);
+		    unwrittenSyncIDs.insert(pKCalTodo->uid());
+		}
+	    } else if (pKCalTodo->pilotId() != 0) {
+		idMap.Set(uid, (uint32_t)pKCalTodo->pilotId());
+	    }
+	}
+    }
 
-    fout.open(tmpPath.c_str(), std::fstream::out);
-    if (!fout.is_open())
-	return 1;
+    KOTP_LOG_DEBUG("KOrgTodoPlugin::LoadIDMap - Loaded " <<
+		   idMap.GetNumEntries() << " mapped todo items, " <<
+		   unwrittenSyncIDs.size() << " not yet in the calendar " \
+		   "file.");
+}
 
-    // Count the number of items that have a pilotId() (rather SyncID) greater
-    // than zero. Write this value of the number SyncIDs.
-    numSyncIDs = 0;
-    for (kcalIt = kcalTodoList.begin(); kcalIt != kcalTodoList.end(); kcalIt++)
-    {
-	KCal::Todo *pKcalTodo = *kcalIt;
-	if (pKcalTodo->pilotId() != 0)
-	    numSyncIDs++;
-    }
-    fout.write((const char *)&numSyncIDs, 4);
+/**
+ * Save the ID map.
+ *
+ * Save the ID map to the users home directory, leaving out the todo items
+ * no longer in the calendar.
+ * @return A boolean representing success (true) or failure (false).
+ */
+bool KOrgTodoPlugin::SaveIDMap(void) {
+    std::string mapPath = homeDir;
+    int retval;
+    SyncStatsTimerType timer(syncStats, SYNCSTATS_PHASE_IDMAP_SAVE);
 
-    // Loop through the list of todo Items and write their values in series if
-    // the value is larger than zero.
-    for (kcalIt = kcalTodoList.begin(); kcalIt != kcalTodoList.end(); kcalIt++)
-    {
-	KCal::Todo *pKcalTodo = *kcalIt;
-	tmpSyncID = pKcalTodo->pilotId();
-	if (tmpSyncID != 0)
-	    fout.write((const char *)&tmpSyncID, 4);
+    mapPath.append("/.KOrgTodoPlugin.idmap");
+    retval = idMap.Save(mapPath, uidIndex);
+    if (retval != 0) {
+	KOTP_LOG_WARNING("KOrgTodoPlugin: Warning: Failed to save the ID " \
+			 "map (" << retval << "), writing the mapped SyncIDs " \
+			 "to the calendar file instead.");
+	return false;
     }
 
-    fout.close();
-
-    return 0;
+    return true;
 }
 
 /**
  * Convert a KCal::Todo object into a common TodoItemType object.
  *
  * Convert a KCal::Todo object into a common TodoItemType object so that the
- * plugin interface can use the common format to synchronize the data.
+ * plugin interface can use the common format to synchronize the data. Todo
+ * items that weren't modified since they were last converted are taken from
+ * the conversion cache.
  * @param pKcalTodo Pointer to the KCal::Todo object to convert.
  * @return A TodoItemType object containing the converted data.
  */
 TodoItemType KOrgTodoPlugin::ConvKCalTodo(KCal::Todo *pKcalTodo) {
     TodoItemType todoItem;
-    QCString appId;
+    QString uid;
+    time_t lastModified;
+    SyncStatsTimerType timer(syncStats, SYNCSTATS_PHASE_CONV_KCAL_TODO);
+
+    // The SyncID isn't cached, the todo item may have been mapped to another
+    // one since without it counting as a modification.
+    uid = pKcalTodo->uid();
+    lastModified = ConvQDateTime(pKcalTodo->lastModified());
+    if (convCache.Find(uid, lastModified, todoItem)) {
+	syncStats.AddCount(SYNCSTATS_CONV_CACHE_HITS, 1);
+	todoItem.SetSyncID((unsigned long int)pKcalTodo->pilotId());
+	return todoItem;
+    }
+
+    syncStats.AddCount(SYNCSTATS_ITEMS_CONVERTED, 1);
 
     // Here I convert all the common data.
 
@@ -905,29 +2632,28 @@ TodoItemType KOrgTodoPlugin::ConvKCalTodo(KCal::Todo *pKcalTodo) {
     todoItem.SetCreatedTime(ConvQDateTime(pKcalTodo->created()));
 
     // Set the modified time to zero signifying that it has not been set.
-    todoItem.SetModifiedTime(ConvQDateTime(pKcalTodo->lastModified()));
+    todoItem.SetModifiedTime(lastModified);
 
     // Set the sync id.
     todoItem.SetSyncID((unsigned long int)pKcalTodo->pilotId());
 
     // Set the application id.
-    appId = pKcalTodo->uid().utf8();
-    todoItem.SetAppID((std::string)appId);
+    todoItem.SetAppID(ArenaUtf8(uid));
 
     // Below I convert all the Todo specific data.
 
     // Set the item category. Now in this case the Zaurus Todo item only has
     // one category and in the KOrganizer Todo items they can have multiple
     // categories. In this case I have decided to only use the first category
-    // of the KOrganizers categories list.
+    // of the KOrganizers categories list. Todo items without a category get
+    // the empty one. The category is converted once, by the category table.
     QStringList kOrgCatList;
-    QStringList::Iterator catIt;
-    QCString category;
+    uint32_t categoryID = CATEGORYTABLE_NO_CATEGORY;
 
     kOrgCatList = pKcalTodo->categories();
-    catIt = kOrgCatList.begin();
-    category = (*catIt).utf8();
-    todoItem.SetCategory((std::string)category);
+    if (!kOrgCatList.isEmpty())
+	categoryID = categoryTable.Intern(*kOrgCatList.begin());
+    todoItem.SetCategory(categoryTable.GetUtf8(categoryID));
 
     // Set Start Date
     if (pKcalTodo->hasStartDate()) {
@@ -963,20 +2689,114 @@ TodoItemType KOrgTodoPlugin::ConvKCalTodo(KCal::Todo *pKcalTodo) {
     todoItem.SetPriority((unsigned char)pKcalTodo->priority());
 
     // Set Description.
-    QCString descStr;
-
-    descStr = (pKcalTodo->summary()).utf8();
-    todoItem.SetDescription((std::string)descStr);
+    todoItem.SetDescription(ArenaUtf8(pKcalTodo->summary()));
 
     // Set Notes.
-    QCString notesStr;
+    todoItem.SetNotes(ArenaUtf8(pKcalTodo->description()));
 
-    notesStr = (pKcalTodo->description()).utf8();
-    todoItem.SetNotes((std::string)notesStr);
+    convCache.Insert(uid, lastModified, todoItem);
 
     return todoItem;
 }
 
+/**
+ * Encode a string as UTF-8.
+ *
+ * Encode a string as UTF-8 the same way as QString::utf8() followed by the
+ * conversion to std::string, in one pass straight from the UTF-16 of the
+ * string into a buffer taken from the session arena, rather than through
+ * the intermediate buffers Qt allocates for each string.
+ * @param str The string to encode.
+ * @return The UTF-8 encoding of the string.
+ */
+std::string KOrgTodoPlugin::ArenaUtf8(const QString &str) {
+    ArenaMarkType mark = convArena.Mark();
+    size_t numUnits = str.length();
+    char *pUtf8 = NULL;
+    std::string utf8;
+
+    if (numUnits != 0)
+	pUtf8 = (char *)convArena.Alloc(numUnits * 3);
+    // QChar holds nothing but its UTF-16 code unit.
+    if (pUtf8)
+	utf8.assign(pUtf8, TodoConvUtf8((const unsigned short *)str.unicode(),
+					numUnits, pUtf8));
+    else if (!str.isEmpty())
+	utf8 = (const char *)str.utf8();
+    convArena.Rewind(mark);
+
+    return utf8;
+}
+
+/**
+ * Convert a batch of KCal::Todo objects into common TodoItemType objects.
+ *
+ * Convert each of the given KCal::Todo objects into the TodoItemType object
+ * pointed to at the same index. Large batches are spread over the conversion
+ * threads: the todo items the conversion cache can't supply are snapshotted
+ * here, converted on the threads and then added to the conversion cache
+ * here. The result is the same as converting them one at a time.
+ * @param kcalTodos The KCal::Todo objects to convert.
+ * @param todoItems Pointers to the TodoItemType objects to convert them
+ * into.
+ */
+void KOrgTodoPlugin::ConvKCalTodos(const std::vector<KCal::Todo *> &kcalTodos,
+				   const std::vector<TodoItemType *> &todoItems)
+{
+    std::vector<TodoFieldsType> fields;
+    std::vector<TodoItemType *> convItems;
+    std::vector<size_t> convIdxs;
+    KCal::Todo *pKcalTodo;
+    ArenaMarkType mark;
+    time_t lastModified;
+    size_t i;
+
+    if ((convPool.GetNumThreads() == 0) ||
+	(kcalTodos.size() < (2 * TODOCONV_CHUNK_SIZE))) {
+	for (i = 0; i < kcalTodos.size(); i++)
+	    *todoItems[i] = ConvKCalTodo(kcalTodos[i]);
+	return;
+    }
+
+    SyncStatsTimerType timer(syncStats, SYNCSTATS_PHASE_CONV_KCAL_TODO);
+
+    // The fields are reserved up front so that snapshotting into them never
+    // has to move the ones already taken. Their strings are placed in the
+    // session arena, which is rewound once they are converted. A todo item
+    // whose strings don't fit is converted here instead.
+    fields.reserve(kcalTodos.size());
+    mark = convArena.Mark();
+    for (i = 0; i < kcalTodos.size(); i++) {
+	pKcalTodo = kcalTodos[i];
+	lastModified = ConvQDateTime(pKcalTodo->lastModified());
+	if (convCache.Find(pKcalTodo->uid(), lastModified, *todoItems[i])) {
+	    syncStats.AddCount(SYNCSTATS_CONV_CACHE_HITS, 1);
+	    todoItems[i]->SetSyncID((unsigned long int)pKcalTodo->pilotId());
+	    continue;
+	}
+
+	fields.push_back(TodoFieldsType());
+	if (!TodoConvSnapshot(pKcalTodo, lastModified, categoryTable,
+			      convArena, fields.back())) {
+	    fields.pop_back();
+	    *todoItems[i] = ConvKCalTodo(pKcalTodo);
+	    continue;
+	}
+	convItems.push_back(todoItems[i]);
+	convIdxs.push_back(i);
+    }
+
+    TodoConvTaskType task(fields, convItems, timeConv);
+    convPool.Run(task, fields.size(), TODOCONV_CHUNK_SIZE);
+
+    for (i = 0; i < convIdxs.size(); i++) {
+	convCache.Insert(kcalTodos[convIdxs[i]]->uid(), fields[i].lastModified,
+			 *convItems[i]);
+    }
+    convArena.Rewind(mark);
+    syncStats.AddCount(SYNCSTATS_ITEMS_CONVERTED, convIdxs.size());
+}
+
 /**
  * Convert a TodoItemType object into a KOrganizers KCal::Todo object.
  *
@@ -985,15 +2805,18 @@ TodoItemType KOrgTodoPlugin::ConvKCalTodo(KCal::Todo *pKcalTodo) {
  * KOrganizer Todo list. Note: This dynamically allocates the memory for the
  * new KCal::Todo item. Hence, if it is not added to the calender it needs to
  * be deallocated at some point or there will be a memory leak.
- * @param pTodoItem Pointer to the TodoItemType object to convert.
+ * @param todoItem The TodoItemType object to convert.
  * @return A pointer to the new KCal::Todo object.
  * @retval NULL Failed to allocate memory for the new object.
  */
-KCal::Todo *KOrgTodoPlugin::ConvTodoItemType(TodoItemType *pTodoItem) {
+KCal::Todo *KOrgTodoPlugin::ConvTodoItemType(const TodoItemType &todoItem) {
     KCal::Todo *pKCalTodo;
     QDateTime tmpTime;
     QString tmpStr;
     QString uId;
+    SyncStatsTimerType timer(syncStats, SYNCSTATS_PHASE_CONV_TODO_ITEM);
+
+    syncStats.AddCount(SYNCSTATS_ITEMS_CONVERTED, 1);
 
     // Create the instance of the object for the list of todo items stored in
     // the calendar. If failed to allocate the memory for it then return NULL.
@@ -1001,7 +2824,7 @@ KCal::Todo *KOrgTodoPlugin::ConvTodoItemType(TodoItemType *pTodoItem) {
     if (!pKCalTodo)
 	return pKCalTodo;
 
-    UpdateKCalTodoItem(pKCalTodo, *(pTodoItem));
+    UpdateKCalTodoItem(pKCalTodo, todoItem);
 
     /*
     std::cout << "ConvTodoItemType\n";
@@ -1083,19 +2906,12 @@ KCal::Todo *KOrgTodoPlugin::ConvTodoItemType(TodoItemType *pTodoItem) {
  * @param todoItem The TodoItemType object to get data from for the update.
  */
 void KOrgTodoPlugin::UpdateKCalTodoItem(KCal::Todo *pKCalTodo,
-					TodoItemType todoItem) {
+					const TodoItemType &todoItem) {
     QDateTime tmpTime;
     QString tmpStr;
     QString uId;
-    TodoItemType *pTodoItem;
-
-    struct tm brTime;
-    char buff[256];
-    time_t zTime;
-
-    std::string funcName;
-
-    funcName.assign("KOrgTodoPlugin::UpdateKCalTodoItem - ");
+    const TodoItemType *pTodoItem;
+    ArenaMarkType mark = convArena.Mark();
 
     pTodoItem = &todoItem;
 
@@ -1103,34 +2919,29 @@ void KOrgTodoPlugin::UpdateKCalTodoItem(KCal::Todo *pKCalTodo,
     // data items. 
 
     // Set the created time.
-    tmpTime.setTime_t(pTodoItem->GetCreatedTime());
+    tmpTime = timeConv.FromTime_t(pTodoItem->GetCreatedTime());
     pKCalTodo->setCreated(tmpTime);
 
-    std::cout << funcName << "-=Created Time=-\n";
-    zTime = pTodoItem->GetCreatedTime();
-    localtime_r(&zTime, &brTime);
-    asctime_r(&brTime, buff);
-    std::cout << funcName << "pTodoItem: " << buff << std::endl;
-
-    tmpStr = tmpTime.toString("dd-MM-yyyy hh:mm:ss");
-    std::cout << funcName << "pKCalTodo: " << tmpStr << std::endl;
+    KOTP_LOG_TRACE("KOrgTodoPlugin::UpdateKCalTodoItem - Created time: " <<
+		   pTodoItem->GetCreatedTime() << " (" <<
+		   tmpTime.toString("dd-MM-yyyy hh:mm:ss") << ").");
 
     // Set the modified time.
-    tmpTime.setTime_t(pTodoItem->GetModifiedTime());
+    tmpTime = timeConv.FromTime_t(pTodoItem->GetModifiedTime());
     pKCalTodo->setLastModified(tmpTime);
 
     // Set the sync ID (pilot id).
-    pKCalTodo->setPilotId((int)pTodoItem->GetSyncID());
+    SetTodoSyncID(pKCalTodo, pTodoItem->GetSyncID());
 
     // Now I convert the Todo specific data items.
     
-    // Set the category.
-    tmpStr = pTodoItem->GetCategory();
-    pKCalTodo->setCategories(tmpStr);
+    // Set the category, as converted once by the category table.
+    pKCalTodo->setCategories(categoryTable.GetString(
+	categoryTable.InternUtf8(pTodoItem->GetCategory())));
 
     // Set the start date.
     if (pTodoItem->GetStartDate() != 0) {
-	tmpTime.setTime_t(pTodoItem->GetStartDate());
+	tmpTime = timeConv.FromTime_t(pTodoItem->GetStartDate());
 	pKCalTodo->setDtStart(tmpTime);
 	pKCalTodo->setHasStartDate(true);
     } else {
@@ -1139,7 +2950,7 @@ void KOrgTodoPlugin::UpdateKCalTodoItem(KCal::Todo *pKCalTodo,
 
     // Set the due date.
     if (pTodoItem->GetDueDate() != 0) {
-	tmpTime.setTime_t(pTodoItem->GetDueDate());
+	tmpTime = timeConv.FromTime_t(pTodoItem->GetDueDate());
 	pKCalTodo->setDtDue(tmpTime);
 	pKCalTodo->setHasDueDate(true);
     } else {
@@ -1148,7 +2959,7 @@ void KOrgTodoPlugin::UpdateKCalTodoItem(KCal::Todo *pKCalTodo,
 
     // Set the completed date.
     if (pTodoItem->GetCompletedDate() != 0) {
-	tmpTime.setTime_t(pTodoItem->GetCompletedDate());
+	tmpTime = timeConv.FromTime_t(pTodoItem->GetCompletedDate());
 	pKCalTodo->setCompleted(tmpTime);
     }
 
@@ -1163,14 +2974,18 @@ void KOrgTodoPlugin::UpdateKCalTodoItem(KCal::Todo *pKCalTodo,
     pKCalTodo->setPriority((int)pTodoItem->GetPriority());
 
     // Set the description (KOrg Summary).
-    tmpStr = pTodoItem->GetDescription();
-    std::cout << funcName << "tmpStr (desc) = " << tmpStr << ".\n";
+    TodoConvFromUtf8(pTodoItem->GetDescription(), convArena, tmpStr);
+    KOTP_LOG_TRACE("KOrgTodoPlugin::UpdateKCalTodoItem - Description: " <<
+		   pTodoItem->GetDescription() << ".");
     pKCalTodo->setSummary(tmpStr);
 
     // Set the notes (KOrg Description).
-    tmpStr = pTodoItem->GetNotes();
-    std::cout << funcName << "tmpStr (notes) = " << tmpStr << ".\n";
+    TodoConvFromUtf8(pTodoItem->GetNotes(), convArena, tmpStr);
+    KOTP_LOG_TRACE("KOrgTodoPlugin::UpdateKCalTodoItem - Notes: " <<
+		   pTodoItem->GetNotes() << ".");
     pKCalTodo->setDescription(tmpStr);
+
+    convArena.Rewind(mark);
 }
 
 /**
@@ -1203,5 +3018,319 @@ time_t KOrgTodoPlugin::ConvQDateTime(QDateTime dateTime) {
     return mktime(&tmpTime);
     */
 
-    return dateTime.toTime_t();
+    return timeConv.ToTime_t(dateTime);
+}
+
+/**
+ * Build the SyncID and UID indexes.
+ *
+ * Build the lookup tables that map SyncIDs (pilotIds) and KCal UIDs to the
+ * todo items within the loaded calendars. This is done once after the
+ * calendars have been loaded so that finding an item by either of its IDs
+ * doesn't require a walk over the entire todo list. With several calendars
+ * the calendar holding each todo item is recorded as well.
+ */
+void KOrgTodoPlugin::BuildTodoIndex(void) {
+    std::vector<KCal::Todo *>::const_iterator kcalIt;
+    KCal::Todo::List calTodoList;
+    KCal::Todo::List::iterator calIt;
+    size_t i;
+
+    syncIDIndex.clear();
+    uidIndex.clear();
+    todoCalendars.clear();
+
+    // The calendar was just loaded, so this is where the snapshot is taken.
+    todoSnapshotValid = false;
+    const std::vector<KCal::Todo *> &kcalTodoList = GetTodoSnapshot();
+
+    ReserveTodoIndex(kcalTodoList.size());
+
+    for (kcalIt = kcalTodoList.begin(); kcalIt != kcalTodoList.end(); kcalIt++)
+	IndexTodo(*kcalIt);
+
+    if (calendars.size() > 1) {
+	for (i = 0; i < calendars.size(); i++) {
+	    calTodoList = calendars[i]->pCal->rawTodos();
+	    for (calIt = calTodoList.begin(); calIt != calTodoList.end();
+		 calIt++)
+		todoCalendars.insert(*calIt, calendars[i]);
+	}
+    }
+}
+
+/**
+ * Make room in the SyncID and UID indexes.
+ *
+ * The Qt dictionaries do not grow on their own, so I size them to a prime
+ * comfortably larger than the number of items they will hold. They are only
+ * ever grown.
+ * @param numTodos The number of todo items the indexes will hold.
+ */
+void KOrgTodoPlugin::ReserveTodoIndex(size_t numTodos) {
+    unsigned int dictSize;
+
+    dictSize = (numTodos * 2) + 1;
+    if (dictSize <= uidIndex.size())
+	return;
+    while (!IsPrime(dictSize))
+	dictSize += 2;
+    syncIDIndex.resize(dictSize);
+    uidIndex.resize(dictSize);
+    if (calendars.size() > 1)
+	todoCalendars.resize(dictSize);
+}
+
+/**
+ * Get the snapshot of the todo items.
+ *
+ * Get the todo items of all the calendars, in the order of the calendars.
+ * The list is taken from the calendars once and then kept in step with the
+ * items the plugin adds and deletes, so that each operation walking the todo
+ * items doesn't have the calendars build a new list for it. Deleted items
+ * are removed from the snapshot in one go the next time it is asked for.
+ * @return The todo items of the calendar.
+ */
+const std::vector<KCal::Todo *> &KOrgTodoPlugin::GetTodoSnapshot(void) {
+    KCal::Todo::List kcalTodoList;
+    KCal::Todo::List::iterator kcalIt;
+    std::vector<KCal::Todo *>::iterator snapIt, keepIt;
+    size_t i;
+
+    if (!todoSnapshotValid) {
+	todoSnapshot.clear();
+	for (i = 0; i < calendars.size(); i++) {
+	    kcalTodoList = calendars[i]->pCal->rawTodos();
+	    todoSnapshot.reserve(todoSnapshot.size() + kcalTodoList.size());
+	    for (kcalIt = kcalTodoList.begin(); kcalIt != kcalTodoList.end();
+		 kcalIt++)
+		todoSnapshot.push_back(*kcalIt);
+	}
+	snapshotDeletes.clear();
+	todoSnapshotValid = true;
+    } else if (!snapshotDeletes.empty()) {
+	keepIt = todoSnapshot.begin();
+	for (snapIt = todoSnapshot.begin(); snapIt != todoSnapshot.end();
+	     snapIt++) {
+	    if (snapshotDeletes.find(*snapIt) == snapshotDeletes.end())
+		*(keepIt++) = *snapIt;
+	}
+	todoSnapshot.erase(keepIt, todoSnapshot.end());
+	snapshotDeletes.clear();
+    }
+
+    return todoSnapshot;
+}
+
+/**
+ * Add a todo item to the snapshot of the todo items.
+ *
+ * @param pKCalTodo Pointer to the KCal::Todo item just added to the
+ * calendar.
+ */
+void KOrgTodoPlugin::SnapshotAddTodo(KCal::Todo *pKCalTodo) {
+    if (!todoSnapshotValid)
+	return;
+
+    // A new item may reuse the address of a deleted one, so the deleted
+    // ones have to be removed first.
+    if (!snapshotDeletes.empty())
+	GetTodoSnapshot();
+    todoSnapshot.push_back(pKCalTodo);
+}
+
+/**
+ * Remove a todo item from the snapshot of the todo items.
+ *
+ * Remove the given todo item from the snapshot. This must be done before the
+ * item is deleted from the calendar, as the snapshot is only patched up the
+ * next time it is asked for.
+ * @param pKCalTodo Pointer to the KCal::Todo item about to be deleted.
+ */
+void KOrgTodoPlugin::SnapshotDelTodo(KCal::Todo *pKCalTodo) {
+    if (todoSnapshotValid)
+	snapshotDeletes.insert(pKCalTodo);
+}
+
+/**
+ * Add a todo item to the SyncID and UID indexes.
+ *
+ * Add the given todo item to the UID index, and if it has been assigned a
+ * SyncID also to the SyncID index. SyncIDs are handed out by the Zaurus and
+ * are unique, hence, an item with the same SyncID replaces any previous one.
+ * @param pKCalTodo Pointer to the KCal::Todo item to index.
+ */
+void KOrgTodoPlugin::IndexTodo(KCal::Todo *pKCalTodo) {
+    uidIndex.replace(pKCalTodo->uid(), pKCalTodo);
+    if (pKCalTodo->pilotId() != 0)
+	syncIDIndex.replace((long)pKCalTodo->pilotId(), pKCalTodo);
+}
+
+/**
+ * Remove a todo item from the SyncID and UID indexes.
+ *
+ * Remove the given todo item from both indexes. This must be done before the
+ * item is deleted from the calendar since the calendar frees it.
+ * @param pKCalTodo Pointer to the KCal::Todo item to remove.
+ */
+void KOrgTodoPlugin::UnindexTodo(KCal::Todo *pKCalTodo) {
+    if (uidIndex.find(pKCalTodo->uid()) == pKCalTodo)
+	uidIndex.remove(pKCalTodo->uid());
+    if ((pKCalTodo->pilotId() != 0) &&
+	(syncIDIndex.find((long)pKCalTodo->pilotId()) == pKCalTodo))
+	syncIDIndex.remove((long)pKCalTodo->pilotId());
+}
+
+/**
+ * Set the SyncID of a todo item.
+ *
+ * Set the SyncID (pilotId) of the given todo item, moving it within the
+ * SyncID index and recording it in the ID map if it is an item of the
+ * calendar. Items that have not been added to the calendar yet are left out
+ * of both.
+ * @param pKCalTodo Pointer to the KCal::Todo item to update.
+ * @param syncID The new SyncID of the todo item.
+ */
+void KOrgTodoPlugin::SetTodoSyncID(KCal::Todo *pKCalTodo,
+				   unsigned long int syncID) {
+    bool indexedFlag;
+
+    if ((unsigned long int)pKCalTodo->pilotId() == syncID)
+	return;
+
+    indexedFlag = (uidIndex.find(pKCalTodo->uid()) == pKCalTodo);
+    if (indexedFlag)
+	UnindexTodo(pKCalTodo);
+
+    pKCalTodo->setPilotId((int)syncID);
+
+    if (indexedFlag) {
+	IndexTodo(pKCalTodo);
+	RecordTodoMapping(pKCalTodo);
+    }
+}
+
+/**
+ * Record the mapping of a todo item.
+ *
+ * Record the SyncID the given todo item of the calendar is mapped to in the
+ * ID map, instead of marking the todo item changed.
+ * @param pKCalTodo Pointer to the KCal::Todo item that was mapped.
+ */
+void KOrgTodoPlugin::RecordTodoMapping(KCal::Todo *pKCalTodo) {
+    idMap.Set((const char *)pKCalTodo->uid().utf8(),
+	      (uint32_t)pKCalTodo->pilotId());
+    unwrittenSyncIDs.insert(pKCalTodo->uid());
+}
+
+/**
+ * Find the calendar holding a todo item.
+ *
+ * @param pKCalTodo Pointer to a KCal::Todo item of one of the calendars.
+ * @return Pointer to the calendar holding the todo item.
+ */
+KOrgTodoPlugin::CalendarType *KOrgTodoPlugin::FindTodoCalendar(
+    KCal::Todo *pKCalTodo) {
+    CalendarType *pCalendar;
+
+    if (calendars.size() == 1)
+	return calendars[0];
+
+    pCalendar = todoCalendars.find(pKCalTodo);
+    return pCalendar ? pCalendar : pDefaultCal;
+}
+
+/**
+ * Free the calendars.
+ *
+ * Free the calendar file state set up by Initialize(). The calendar objects
+ * themselves are closed by CleanUp().
+ */
+void KOrgTodoPlugin::ClearCalendars(void) {
+    size_t i;
+
+    for (i = 0; i < calendars.size(); i++)
+	delete calendars[i];
+    calendars.clear();
+    todoCalendars.clear();
+    pDefaultCal = NULL;
+}
+
+/**
+ * Split a comma separated list.
+ *
+ * Split the given comma separated list into its items, leaving out the
+ * spaces around each item and any empty items.
+ * @param pList The comma separated list.
+ * @param items The items are appended to this.
+ */
+void KOrgTodoPlugin::SplitList(const char *pList,
+			       std::vector<std::string> &items) {
+    const char *pStart;
+    const char *pEnd;
+
+    while (*pList != '\0') {
+	pStart = pList;
+	while ((*pList != '\0') && (*pList != ','))
+	    pList++;
+	pEnd = pList;
+	if (*pList == ',')
+	    pList++;
+
+	while ((pStart < pEnd) && isspace((unsigned char)*pStart))
+	    pStart++;
+	while ((pEnd > pStart) && isspace((unsigned char)*(pEnd - 1)))
+	    pEnd--;
+	if (pStart < pEnd)
+	    items.push_back(std::string(pStart, pEnd - pStart));
+    }
+}
+
+/**
+ * Parse a count.
+ *
+ * Parse the value of a config file item holding a count, which has to be
+ * a decimal number and nothing else. strtoul() alone takes anything it
+ * can't read as zero.
+ * @param pVal The value of the item.
+ * @param count Set to the count, only when the value is one.
+ * @return A boolean representing whether the value is a count (true) or
+ * not (false).
+ */
+bool KOrgTodoPlugin::ParseCount(const char *pVal, unsigned long int &count) {
+    unsigned long int val;
+    char *pEnd;
+
+    // strtoul() also skips spaces and takes a sign.
+    if ((*pVal < '0') || (*pVal > '9'))
+	return false;
+
+    errno = 0;
+    val = strtoul(pVal, &pEnd, 10);
+    if ((errno != 0) || (*pEnd != '\0'))
+	return false;
+
+    count = val;
+    return true;
+}
+
+/**
+ * Check if a number is prime.
+ *
+ * Check if the given number is prime. This is used to pick the sizes of the
+ * Qt dictionaries used as indexes, since they perform best with prime sizes.
+ * @param num The number to check.
+ * @return A boolean representing whether the number is prime (true) or not
+ * (false).
+ */
+bool KOrgTodoPlugin::IsPrime(unsigned int num) {
+    unsigned int div;
+
+    if (num < 2)
+	return false;
+    for (div = 3; (div * div) <= num; div += 2) {
+	if ((num % div) == 0)
+	    return false;
+    }
+    return ((num == 2) || ((num % 2) != 0));
 }
@@ -33,12 +33,34 @@
 
 #define TODO_PLUGIN_VERSION "1.0.2"
 
+// The default number of entries the SyncID journal may hold before it is
+// folded back into the SyncID log.
+#define DEFAULT_JOURNAL_MAX_RECORDS 4096
+
+// The default number of seconds the first call needing the calendar waits
+// for the prefetch thread to load it.
+#define DEFAULT_PREFETCH_TIMEOUT 60
+
+// The largest number of seconds the prefetch timeout may be set to, short of
+// waiting as long as it takes.
+#define MAX_PREFETCH_TIMEOUT 86400
+
+// The largest number of threads todo items are converted on.
+#define MAX_CONV_THREADS 64
+
+// The number of todo items VisitAllTodoItems() converts at a time.
+#define VISIT_CHUNK_SIZE 4096
+
 // Plugin Includes
 #include <zync/TodoPluginType.hh>
+#include "TodoPluginV2Type.hh"
 
 // KOrganizer Includes
 #include <qstring.h>
 #include <qdatetime.h>
+#include <qintdict.h>
+#include <qdict.h>
+#include <qptrdict.h>
 
 #include <kinstance.h>
 #include <kaboutdata.h>
@@ -48,14 +70,42 @@
 #include <libkcal/calendarresources.h>
 
 #include <libkcal/calendarlocal.h>
+#include <libkcal/icalformat.h>
 
 #include <iostream>
 #include <fstream>
+#include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
+
+#include "SyncIDDiff.hh"
+#include "SyncIDLog.hh"
+#include "SyncIDJournal.hh"
+#include "IcsFile.hh"
+#include "Log.hh"
+#include "SyncStats.hh"
+#include "ConvCache.hh"
+#include "WorkPool.hh"
+#include "TodoConv.hh"
+#include "IDMap.hh"
+#include "TimeConv.hh"
+#include "CalCache.hh"
+#include "TodoStore.hh"
+#include "CategoryTable.hh"
+#include "Arena.hh"
 
 // Config File Includes
 #include <confmgr/ConfigManagerType.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
 
 /**
  * @class KOrgTodoPlugin
@@ -65,9 +115,10 @@
  * the ZaurusSyncer application to synchronize its Todo list with the Todo
  * list stored in KOrganizer.
  */
-class KOrgTodoPlugin : public TodoPluginType {
+class KOrgTodoPlugin : public TodoPluginV2Type {
 public:
     KOrgTodoPlugin(void);
+    ~KOrgTodoPlugin(void);
 
     int Initialize(void);
     int CleanUp(void);
@@ -81,38 +132,250 @@ public:
     int DelTodoItems(SyncIDListType todoItemIDs);
     int MapItemIDs(TodoItemType::List todoItems);
 
+    int VisitAllTodoItems(TodoItemVisitorType &visitor);
+    int TakeNewTodoItems(time_t lastTimeSynced,
+			 TodoItemType::List &todoItems);
+    int TakeModTodoItems(time_t lastTimeSynced,
+			 TodoItemType::List &todoItems);
+    int TakeDelTodoItemIDs(time_t lastTimeSynced,
+			   SyncIDListType &todoItemIDs);
+    int AddTodoItemsRef(const TodoItemType::List &todoItems);
+    int ModTodoItemsRef(const TodoItemType::List &todoItems);
+    int DelTodoItemsRef(const SyncIDListType &todoItemIDs);
+    int MapItemIDsRef(const TodoItemType::List &todoItems);
+
     std::string GetPluginDescription(void) const;
     std::string GetPluginName(void) const;
     std::string GetPluginAuthor(void) const;
     std::string GetPluginVersion(void) const;
 private:
+    /**
+     * @struct CalendarType
+     * @brief A calendar file synchronized by the plugin.
+     *
+     * The calendar object holding the todo items of one calendar file,
+     * along with everything the plugin keeps to load and save that file.
+     */
+    struct CalendarType {
+	std::string filePath;
+	QString qFilePath;
+	std::string cachePath;
+	KCal::CalendarLocal *pCal;
+
+	// The mapped calendar file the components other than todo items are
+	// kept in when only the todo items are loaded.
+	IcsFileType calFile;
+
+	// The component of calFile holding each todo item, by UID, and the
+	// UIDs of the todo items added, modified or deleted since the calendar
+	// was loaded. Together these let SaveCalendar() rewrite only what
+	// changed.
+	std::map<QString, size_t> calFileTodos;
+	std::set<QString> changedUIDs;
+
+	// The todo items of the calendar file as parsed by the last session,
+	// those of pCal that were rebuilt from it, and the UIDs among them
+	// whose SyncID wasn't yet written to the calendar file. The rebuilt
+	// ones only hold the fields the plugin synchronizes, so they are
+	// completed from calFile by HydrateTodos() before they are written.
+	CalCacheType calCache;
+	std::set<KCal::Todo *> cachedTodos;
+	std::set<QString> cachedUnwritten;
+
+	// The time key of the time zone of pCal, and what ScanCalendar()
+	// found, so that the threads scanning the calendar files don't need
+	// pCal.
+	uint64_t timeKey;
+	int scanRetval;
+	CalCacheKeyType fileKey;
+	bool keyedFlag;
+
+	// The status of the calendar file as SaveCalendar() wrote it, so that
+	// the parsed calendar cache isn't keyed to a file written by someone
+	// else since.
+	struct stat writtenCalStat;
+	bool wroteCalFlag;
+
+	// The timers of loading the calendar, kept apart from those of the
+	// session while the calendars are scanned in parallel.
+	SyncStatsType loadStats;
+	bool loadedFlag;
+	KOrgTodoPlugin *pPlugin;
+	pthread_t loadThread;
+    };
+
     int GetAllTodoSyncItems(time_t lastTimeSynced,
 			    TodoItemType::List &newItemList,
 			    TodoItemType::List &modItemList,
 			    SyncIDListType &delItemIdList);
+    int EnsureCalendarLoaded(void);
+    int OpenCalendar(void);
+    int CreateCalendars(void);
+    void StartPrefetch(void);
+    bool JoinPrefetch(unsigned long int timeout);
+    static void *PrefetchMain(void *pArg);
+    bool LoadCalendars(void);
+    void ScanCalendars(void);
+    static void *ScanCalendarMain(void *pArg);
+    void ScanCalendar(CalendarType &cal);
+    bool LoadCalendar(CalendarType &cal);
+    bool SaveCalendar(CalendarType &cal);
+    bool LoadCalCache(CalendarType &cal);
+    void SaveCalCache(CalendarType &cal);
+    bool HydrateTodos(CalendarType &cal,
+		      const std::vector<std::pair<size_t, QString> > &replaced,
+		      std::map<QString, KCal::Todo *> &fullTodos);
+    static bool WriteRange(FILE *pFile, const char *pData, size_t dataSize);
+    static bool WriteTodo(FILE *pFile, KCal::ICalFormat &format,
+			  KCal::Todo *pKCalTodo);
+    static uint64_t FileSize(const std::string &filePath);
+    void IndexCalFileTodos(CalendarType &cal);
+    CalendarType *FindTodoCalendar(KCal::Todo *pKCalTodo);
+    void ClearCalendars(void);
+    static void SplitList(const char *pList, std::vector<std::string> &items);
+    static bool ParseCount(const char *pVal, unsigned long int &count);
+    void MarkTodoChanged(KCal::Todo *pKCalTodo);
+    int LoadSyncIDLog(const uint64_t *&pSyncIDs,
+		      const uint64_t *&pFingerprints, size_t &numSyncIDs);
+    void ReadSyncIDLog(SyncStatsType &stats);
+    uint64_t LoggedFingerprint(uint64_t syncID);
+    void RecordFingerprint(KCal::Todo *pKCalTodo);
     int SaveSyncIDLog(void);
+    void ReleaseSyncIDLog(void);
+    void LoadTimeConv(void);
+    void LoadConvCache(void);
+    void SaveConvCache(void);
+    void LoadIDMap(void);
+    bool SaveIDMap(void);
+    void RecordTodoMapping(KCal::Todo *pKCalTodo);
     TodoItemType ConvKCalTodo(KCal::Todo *pKcalTodo);
-    KCal::Todo *ConvTodoItemType(TodoItemType *pTodoItem);
-    void UpdateKCalTodoItem(KCal::Todo *pKCalTodo, TodoItemType todoItem);
+    std::string ArenaUtf8(const QString &str);
+    void ConvKCalTodos(const std::vector<KCal::Todo *> &kcalTodos,
+		       const std::vector<TodoItemType *> &todoItems);
+    KCal::Todo *ConvTodoItemType(const TodoItemType &todoItem);
+    void UpdateKCalTodoItem(KCal::Todo *pKCalTodo,
+			    const TodoItemType &todoItem);
     time_t ConvQDateTime(QDateTime dateTime);
 
+    void BuildTodoIndex(void);
+    void ReserveTodoIndex(size_t numTodos);
+    const std::vector<KCal::Todo *> &GetTodoSnapshot(void);
+    void SnapshotAddTodo(KCal::Todo *pKCalTodo);
+    void SnapshotDelTodo(KCal::Todo *pKCalTodo);
+    void IndexTodo(KCal::Todo *pKCalTodo);
+    void UnindexTodo(KCal::Todo *pKCalTodo);
+    void SetTodoSyncID(KCal::Todo *pKCalTodo, unsigned long int syncID);
+    static bool IsPrime(unsigned int num);
+
     KAboutData *pKAboutData;
     KInstance *pKInstance;
 //    KCal::CalendarResources *pCalRes;
-    KCal::CalendarLocal *pCal;
 
     
     /*
     KCal::CalendarLocal calendar;
     */
-    QString qCalPath;
+    std::string korgConfFilePath;
     bool openedCalFlag;
+
+    // What EnsureCalendarLoaded() returned the first time it was called, or
+    // -1 before that.
+    int calLoadRetval;
+
+    // Whether Initialize() starts reading the calendar files on a thread of
+    // its own, and the number of seconds the first call needing them waits
+    // for that, zero meaning as long as it takes. While prefetchRunningFlag
+    // is set the thread owns the mapped calendar files, the SyncID log and
+    // prefetchStats, which keeps its timers apart from those of the
+    // session; prefetchDoneFlag is guarded by prefetchMutex.
+    bool prefetchFlag;
+    unsigned long int prefetchTimeout;
+    pthread_t prefetchThread;
+    pthread_mutex_t prefetchMutex;
+    pthread_cond_t prefetchCond;
+    bool prefetchRunningFlag;
+    bool prefetchDoneFlag;
+    SyncStatsType prefetchStats;
     bool openedConfFlag;
 
     std::string homeDir;
 
+    // Whether only the todo items of the calendar files are loaded, and
+    // whether the calendar files were already scanned.
+    bool todoOnlyFlag;
+    bool scannedCalsFlag;
+
+    // The calendars synchronized, the one new todo items are added to, and
+    // the calendar holding each todo item when there is more than one.
+    std::vector<CalendarType *> calendars;
+    CalendarType *pDefaultCal;
+    QPtrDict<CalendarType> todoCalendars;
+
+    // The timers and counters of the current synchronization session.
+    SyncStatsType syncStats;
+
+    // The transition table of the local time zone, converting the times of
+    // the todo items without going through libc for each one.
+    TimeConvType timeConv;
+
+    // The todo items converted by this and earlier sessions, by UID.
+    ConvCacheType convCache;
+
+    // The SyncID each UID is mapped to, and the UIDs of the todo items whose
+    // SyncID in the calendar file is out of date with it.
+    IDMapType idMap;
+    std::set<QString> unwrittenSyncIDs;
+
+    // The number of threads converting todo items (zero for one per
+    // processor), and the pool of them besides the calling thread.
+    unsigned long int convThreads;
+    WorkPoolType convPool;
+
+    // Lookup tables from SyncID (pilotId) and from KCal UID to the todo item
+    // within the calendars. These are built once the calendars are loaded and
+    // kept up to date by every operation that adds, deletes or re-maps a todo
+    // item.
+    QIntDict<KCal::Todo> syncIDIndex;
+    QDict<KCal::Todo> uidIndex;
+
+    // The todo items of the calendars, taken once and patched as the plugin
+    // adds and deletes items, along with the deleted items not yet removed
+    // from it.
+    std::vector<KCal::Todo *> todoSnapshot;
+    std::set<KCal::Todo *> snapshotDeletes;
+    bool todoSnapshotValid;
+
+    // The synchronized fields of the todo items, in columns, while they are
+    // classified and fingerprinted.
+    TodoStoreType todoStore;
+
+    // The categories seen in either direction, converted once each.
+    CategoryTableType categoryTable;
+
+    // The temporary buffers of converting todo items during the session,
+    // reset by CleanUp().
+    ArenaType convArena;
+
+    // The SyncID log and journal, as loaded by LoadSyncIDLog().
+    SyncIDLogType syncIDLog;
+    std::vector<uint64_t> journaledSyncIDs;
+    std::vector<uint64_t> journaledFingerprints;
+    bool loadedSyncIDLog;
+    int syncIDLogRetval;
+    int syncIDJournalRetval;
+    size_t numJournalRecords;
+    unsigned long int journalMaxRecords;
+
+    // The fingerprints of the todo items, by SyncID, as the Zaurus will hold
+    // them at the end of this synchronization, for those that changed.
+    std::map<uint64_t, uint64_t> newFingerprints;
 
     bool obtainedSyncLists;
+    // Whether each of the sync lists was handed over by one of the Take*()
+    // calls, which leaves the plugin without it.
+    bool takenNewItems;
+    bool takenModItems;
+    bool takenDelItemIDs;
     TodoItemType::List newTodoItemList;
     TodoItemType::List modTodoItemList;
     SyncIDListType delTodoItemIdList;
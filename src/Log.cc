@@ -0,0 +1,331 @@
+/*
+ * Copyright 2004, 2005 Andrew De Ponte
+ *
+ * This file is part of zsrep.
+ *
+ * zsrep is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * zsrep is distributed in the hopes that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with zsrep; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @file Log.cc
+ * @brief An implementation file for the plugin log.
+ * @author Andrew De Ponte
+ *
+ * An implementation file for the leveled log of the plugin and the writer
+ * thread that drains it.
+ */
+
+#include "Log.hh"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * @struct LogSlot
+ * @brief A single message within the ring buffer of the log.
+ *
+ * The seq field tells whose turn it is to use the slot. A writer may fill
+ * the slot when seq equals the position it claimed, and the writer thread
+ * may empty it once seq is one past that position.
+ */
+struct LogSlot {
+    volatile unsigned int seq;
+    unsigned int msgLen;
+    char msg[LOG_MSG_SIZE];
+};
+
+static LogSlot *pSlots = NULL;
+static volatile unsigned int enqueuePos = 0;
+static unsigned int dequeuePos = 0;
+static volatile unsigned int numDropped = 0;
+static volatile int stopFlag = 0;
+static bool startedFlag = false;
+static pthread_t writerThread;
+
+volatile int LogType::curLevel = LOG_DEFAULT_LEVEL;
+
+/**
+ * Start the log.
+ *
+ * Start the writer thread of the log and set the level of the messages
+ * written. If the writer thread can't be started messages are still written,
+ * directly.
+ * @param level The most verbose level of the messages to write.
+ * @return An integer representing success (zero) or failure (non-zero).
+ * @retval 0 Success.
+ * @retval 1 Failed to allocate the ring buffer.
+ * @retval 2 Failed to create the writer thread.
+ */
+int LogType::Start(int level) {
+    unsigned int i;
+
+    SetLevel(level);
+
+    if (startedFlag)
+	return 0;
+
+    pSlots = new LogSlot[LOG_RING_SIZE];
+    if (!pSlots)
+	return 1;
+    for (i = 0; i < LOG_RING_SIZE; i++)
+	pSlots[i].seq = i;
+    enqueuePos = 0;
+    dequeuePos = 0;
+    numDropped = 0;
+    stopFlag = 0;
+
+    if (pthread_create(&writerThread, NULL, WriterMain, NULL) != 0) {
+	delete [] pSlots;
+	pSlots = NULL;
+	return 2;
+    }
+
+    // The ring buffer must be fully set up before any message can go into
+    // it.
+    __sync_synchronize();
+    startedFlag = true;
+
+    return 0;
+}
+
+/**
+ * Stop the log.
+ *
+ * Stop the writer thread of the log once it has written all the messages
+ * in the ring buffer. Messages written afterwards are written directly. No
+ * other thread may be writing to the log while it is stopped.
+ */
+void LogType::Stop(void) {
+    char buff[64];
+    int len;
+
+    if (!startedFlag)
+	return;
+
+    startedFlag = false;
+    __sync_synchronize();
+    stopFlag = 1;
+    pthread_join(writerThread, NULL);
+
+    // Anything that raced with the stop is still in the ring buffer.
+    Drain();
+
+    if (numDropped > 0) {
+	len = snprintf(buff, sizeof(buff),
+		       "KOrgTodoPlugin: Dropped %u log messages.\n",
+		       numDropped);
+	Output(buff, (size_t)len);
+    }
+
+    delete [] pSlots;
+    pSlots = NULL;
+}
+
+/**
+ * Set the log level.
+ *
+ * @param level The most verbose level of the messages to write.
+ */
+void LogType::SetLevel(int level) {
+    if (level < LOG_LEVEL_NONE)
+	level = LOG_LEVEL_NONE;
+    if (level > LOG_LEVEL_TRACE)
+	level = LOG_LEVEL_TRACE;
+    curLevel = level;
+}
+
+/**
+ * Get the log level.
+ *
+ * @return The most verbose level of the messages written.
+ */
+int LogType::GetLevel(void) {
+    return curLevel;
+}
+
+/**
+ * Parse the name of a log level.
+ *
+ * Parse a log level as given in the config file, either by name (none,
+ * error, warning, info, debug or trace) or by number.
+ * @param pName The name of the log level.
+ * @param level The integer the parsed level is stored in.
+ * @return A boolean representing whether the name was recognized (true) or
+ * not (false).
+ */
+bool LogType::ParseLevel(const char *pName, int &level) {
+    static const char *levelNames[] = {
+	"none", "error", "warning", "info", "debug", "trace"
+    };
+    int i;
+
+    for (i = LOG_LEVEL_NONE; i <= LOG_LEVEL_TRACE; i++) {
+	if (strcmp(pName, levelNames[i]) == 0) {
+	    level = i;
+	    return true;
+	}
+    }
+
+    if ((pName[0] >= '0') && (pName[0] <= '5') && (pName[1] == '\0')) {
+	level = pName[0] - '0';
+	return true;
+    }
+
+    return false;
+}
+
+/**
+ * Write a message to the log.
+ *
+ * Write the given message to the log. The KOTP_LOG macros should be used
+ * instead of calling this directly, since they skip formatting the message
+ * when its level is disabled.
+ * @param level The level of the message.
+ * @param msg The message, without a trailing line break.
+ */
+void LogType::Write(int level, const std::string &msg) {
+    std::string line;
+
+    if (!Enabled(level))
+	return;
+
+    if (startedFlag) {
+	Enqueue(msg);
+	return;
+    }
+
+    line = msg;
+    line.append("\n");
+    Output(line.data(), line.size());
+}
+
+/**
+ * Put a message into the ring buffer.
+ *
+ * Put the given message into the ring buffer of the log without taking any
+ * lock. Any number of threads may do so at the same time. Messages too long
+ * for a slot are cut short, and when the ring buffer is full the message is
+ * dropped.
+ * @param msg The message, without a trailing line break.
+ */
+void LogType::Enqueue(const std::string &msg) {
+    LogSlot *pSlot;
+    unsigned int pos, seq;
+    size_t msgLen;
+    int diff;
+
+    pos = enqueuePos;
+    for (;;) {
+	pSlot = &pSlots[pos & (LOG_RING_SIZE - 1)];
+	seq = pSlot->seq;
+	diff = (int)(seq - pos);
+	if (diff == 0) {
+	    if (__sync_bool_compare_and_swap(&enqueuePos, pos, pos + 1))
+		break;
+	    pos = enqueuePos;
+	} else if (diff < 0) {
+	    // The writer thread hasn't emptied this slot since the ring
+	    // buffer last wrapped around, hence, it is full.
+	    __sync_fetch_and_add(&numDropped, 1);
+	    return;
+	} else {
+	    pos = enqueuePos;
+	}
+    }
+
+    msgLen = msg.size();
+    if (msgLen > (LOG_MSG_SIZE - 1))
+	msgLen = LOG_MSG_SIZE - 1;
+    memcpy(pSlot->msg, msg.data(), msgLen);
+    pSlot->msg[msgLen] = '\n';
+    pSlot->msgLen = (unsigned int)(msgLen + 1);
+
+    // Publish the message to the writer thread.
+    __sync_synchronize();
+    pSlot->seq = pos + 1;
+}
+
+/**
+ * Drain the ring buffer.
+ *
+ * Write out all the messages in the ring buffer. Only the writer thread, or
+ * Stop() once the writer thread is gone, may do this.
+ * @return A boolean representing whether any messages were written (true)
+ * or not (false).
+ */
+bool LogType::Drain(void) {
+    LogSlot *pSlot;
+    bool drainedFlag = false;
+
+    for (;;) {
+	pSlot = &pSlots[dequeuePos & (LOG_RING_SIZE - 1)];
+	if ((int)(pSlot->seq - (dequeuePos + 1)) < 0)
+	    break;
+	__sync_synchronize();
+
+	fwrite(pSlot->msg, 1, pSlot->msgLen, stdout);
+
+	// Hand the slot back to the writers for the next time around.
+	__sync_synchronize();
+	pSlot->seq = dequeuePos + LOG_RING_SIZE;
+	dequeuePos++;
+	drainedFlag = true;
+    }
+
+    if (drainedFlag)
+	fflush(stdout);
+
+    return drainedFlag;
+}
+
+/**
+ * Write a message out directly.
+ *
+ * @param pMsg Pointer to the message, including its line break.
+ * @param msgLen The length of the message.
+ */
+void LogType::Output(const char *pMsg, size_t msgLen) {
+    fwrite(pMsg, 1, msgLen, stdout);
+    fflush(stdout);
+}
+
+/**
+ * Run the writer thread.
+ *
+ * Drain the ring buffer until the log is stopped, sleeping for a moment
+ * whenever it is empty.
+ * @param pArg Unused.
+ * @return Always NULL.
+ */
+void *LogType::WriterMain(void *pArg) {
+    struct timespec pause;
+
+    (void)pArg;
+
+    pause.tv_sec = 0;
+    pause.tv_nsec = 200000;
+
+    for (;;) {
+	if (Drain())
+	    continue;
+	if (stopFlag)
+	    break;
+	nanosleep(&pause, NULL);
+    }
+
+    return NULL;
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright 2004, 2005 Andrew De Ponte
+ *
+ * This file is part of zsrep.
+ *
+ * zsrep is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * zsrep is distributed in the hopes that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with zsrep; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @file Log.hh
+ * @brief A specifications file for the plugin log.
+ * @author Andrew De Ponte
+ *
+ * A specifications file for the leveled log of the plugin, along with the
+ * macros used to write to it.
+ */
+
+#ifndef LOG_H
+#define LOG_H
+
+#include <string>
+#include <sstream>
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARNING 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+#define LOG_LEVEL_TRACE 5
+
+// The most verbose level compiled into the plugin. Messages of the levels
+// above it compile to nothing, arguments included.
+#ifndef KOTP_LOG_LEVEL
+#define KOTP_LOG_LEVEL LOG_LEVEL_TRACE
+#endif
+
+// The level used when the config file does not give one.
+#define LOG_DEFAULT_LEVEL LOG_LEVEL_INFO
+
+// The number of messages the ring buffer holds, which must be a power of
+// two, and the longest message a slot of it holds.
+#define LOG_RING_SIZE 4096
+#define LOG_MSG_SIZE 256
+
+/**
+ * Write a message to the log.
+ *
+ * Write the message formed by streaming msg into a std::ostringstream to the
+ * log, if the given level is enabled. The message is only formatted when it
+ * is written.
+ */
+#define KOTP_LOG(level, msg) \
+    do { \
+	if (LogType::Enabled(level)) { \
+	    std::ostringstream logStream; \
+	    logStream << msg; \
+	    LogType::Write(level, logStream.str()); \
+	} \
+    } while (0)
+
+#define KOTP_LOG_NOTHING() do { } while (0)
+
+#if KOTP_LOG_LEVEL >= LOG_LEVEL_ERROR
+#define KOTP_LOG_ERROR(msg) KOTP_LOG(LOG_LEVEL_ERROR, msg)
+#else
+#define KOTP_LOG_ERROR(msg) KOTP_LOG_NOTHING()
+#endif
+
+#if KOTP_LOG_LEVEL >= LOG_LEVEL_WARNING
+#define KOTP_LOG_WARNING(msg) KOTP_LOG(LOG_LEVEL_WARNING, msg)
+#else
+#define KOTP_LOG_WARNING(msg) KOTP_LOG_NOTHING()
+#endif
+
+#if KOTP_LOG_LEVEL >= LOG_LEVEL_INFO
+#define KOTP_LOG_INFO(msg) KOTP_LOG(LOG_LEVEL_INFO, msg)
+#else
+#define KOTP_LOG_INFO(msg) KOTP_LOG_NOTHING()
+#endif
+
+#if KOTP_LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define KOTP_LOG_DEBUG(msg) KOTP_LOG(LOG_LEVEL_DEBUG, msg)
+#else
+#define KOTP_LOG_DEBUG(msg) KOTP_LOG_NOTHING()
+#endif
+
+#if KOTP_LOG_LEVEL >= LOG_LEVEL_TRACE
+#define KOTP_LOG_TRACE(msg) KOTP_LOG(LOG_LEVEL_TRACE, msg)
+#else
+#define KOTP_LOG_TRACE(msg) KOTP_LOG_NOTHING()
+#endif
+
+/**
+ * @class LogType
+ * @brief A type providing the log of the plugin.
+ *
+ * The LogType class holds the log of the plugin. While the log is started,
+ * messages are copied into a lock-free ring buffer and a writer thread
+ * drains it to standard output, so writing a message never waits on the
+ * console. When the ring buffer is full the message is dropped and counted
+ * rather than making the caller wait. Before the log is started, or once it
+ * is stopped, messages are written out directly.
+ */
+class LogType {
+public:
+    static int Start(int level);
+    static void Stop(void);
+
+    static void SetLevel(int level);
+    static int GetLevel(void);
+    static bool ParseLevel(const char *pName, int &level);
+
+    /**
+     * Check if a level is enabled.
+     *
+     * @param level The level to check.
+     * @return A boolean representing whether messages of the level are
+     * written (true) or not (false).
+     */
+    static inline bool Enabled(int level) {
+	return (level <= curLevel);
+    }
+
+    static void Write(int level, const std::string &msg);
+private:
+    static void Enqueue(const std::string &msg);
+    static bool Drain(void);
+    static void Output(const char *pMsg, size_t msgLen);
+    static void *WriterMain(void *pArg);
+
+    static volatile int curLevel;
+};
+
+#endif
@@ -0,0 +1,175 @@
+/*
+ * Copyright 2004, 2005 Andrew De Ponte
+ *
+ * This file is part of zsrep.
+ *
+ * zsrep is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * zsrep is distributed in the hopes that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with zsrep; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @file SyncIDDiff.cc
+ * @brief An implementation file for the SyncID set difference engine.
+ * @author Andrew De Ponte
+ *
+ * An implementation file for the engine used to work out which SyncIDs
+ * recorded at the last synchronization no longer exist in the calendar.
+ */
+
+#include "SyncIDDiff.hh"
+
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * Sort a set of SyncIDs.
+ *
+ * Sort the given SyncIDs in ascending order and drop any duplicates so that
+ * the result can be handed to Difference().
+ * @param syncIDs The SyncIDs to sort, sorted in place.
+ */
+void SyncIDDiff::Sort(std::vector<uint64_t> &syncIDs) {
+    std::sort(syncIDs.begin(), syncIDs.end());
+    syncIDs.erase(std::unique(syncIDs.begin(), syncIDs.end()), syncIDs.end());
+}
+
+/**
+ * Obtain the SyncIDs that are no longer present.
+ *
+ * Obtain the SyncIDs contained in the old set that are not contained in the
+ * current set. Both sets must be sorted in ascending order without
+ * duplicates, as Sort() leaves them. The two arrays are walked once, so the
+ * cost is linear in the size of the sets. Between two synchronizations only
+ * a few items come and go, so most of the walk is spent over runs where the
+ * two sets are identical, and those runs are compared a block at a time.
+ * @param pOldIDs Pointer to the sorted SyncIDs from the last synchronization.
+ * @param numOldIDs The number of SyncIDs pointed to by pOldIDs.
+ * @param pCurIDs Pointer to the sorted SyncIDs currently in the calendar.
+ * @param numCurIDs The number of SyncIDs pointed to by pCurIDs.
+ * @param removedIDs The list the SyncIDs that are no longer present are
+ * appended to, in ascending order.
+ */
+void SyncIDDiff::Difference(const uint64_t *pOldIDs, size_t numOldIDs,
+			    const uint64_t *pCurIDs, size_t numCurIDs,
+			    std::vector<uint64_t> &removedIDs) {
+    size_t oldPos = 0;
+    size_t curPos = 0;
+
+    while (oldPos < numOldIDs) {
+	// Step over the blocks where both sets hold the same SyncIDs.
+#if defined(__AVX2__)
+	while (((oldPos + 4) <= numOldIDs) && ((curPos + 4) <= numCurIDs) &&
+	       (_mm256_movemask_epi8(_mm256_cmpeq_epi64(
+		   _mm256_loadu_si256((const __m256i *)(pOldIDs + oldPos)),
+		   _mm256_loadu_si256((const __m256i *)(pCurIDs + curPos))))
+		== -1)) {
+	    oldPos += 4;
+	    curPos += 4;
+	}
+#elif defined(__SSE2__)
+	while (((oldPos + 2) <= numOldIDs) && ((curPos + 2) <= numCurIDs) &&
+	       (_mm_movemask_epi8(_mm_cmpeq_epi32(
+		   _mm_loadu_si128((const __m128i *)(pOldIDs + oldPos)),
+		   _mm_loadu_si128((const __m128i *)(pCurIDs + curPos))))
+		== 0xffff)) {
+	    oldPos += 2;
+	    curPos += 2;
+	}
+#endif
+	if (oldPos == numOldIDs)
+	    break;
+
+	// The sets differ here, so work out whether the old SyncID is still
+	// present one item at a time.
+	if ((curPos < numCurIDs) && (pCurIDs[curPos] < pOldIDs[oldPos]))
+	    curPos = SkipLess(pCurIDs, numCurIDs, curPos, pOldIDs[oldPos]);
+	if ((curPos == numCurIDs) || (pCurIDs[curPos] != pOldIDs[oldPos]))
+	    removedIDs.push_back(pOldIDs[oldPos]);
+	else
+	    curPos++;
+	oldPos++;
+    }
+}
+
+/**
+ * Skip the SyncIDs less than a given SyncID.
+ *
+ * Obtain the position of the first SyncID at or after pos that is not less
+ * than the given SyncID. Since the array is sorted, the SyncIDs less than
+ * the given one always form a prefix of each block that is compared, so the
+ * vector compares only have to count the lanes that matched.
+ * @param pIDs Pointer to the sorted SyncIDs to search.
+ * @param numIDs The number of SyncIDs pointed to by pIDs.
+ * @param pos The position to start searching from.
+ * @param syncID The SyncID to search for.
+ * @return The position of the first SyncID not less than syncID, or numIDs
+ * if there is no such SyncID.
+ */
+size_t SyncIDDiff::SkipLess(const uint64_t *pIDs, size_t numIDs, size_t pos,
+			    uint64_t syncID) {
+#if defined(__AVX2__)
+    // AVX2 only has a signed 64 bit compare, so flip the sign bits of both
+    // sides to get an unsigned compare out of it.
+    const __m256i signBits =
+	_mm256_set1_epi64x((long long)0x8000000000000000ULL);
+    const __m256i key = _mm256_xor_si256(_mm256_set1_epi64x((long long)syncID),
+					 signBits);
+    __m256i block;
+    int lessMask;
+
+    while ((pos + 4) <= numIDs) {
+	block = _mm256_loadu_si256((const __m256i *)(pIDs + pos));
+	block = _mm256_xor_si256(block, signBits);
+	lessMask = _mm256_movemask_pd(
+	    _mm256_castsi256_pd(_mm256_cmpgt_epi64(key, block)));
+	if (lessMask != 0xf)
+	    return pos + __builtin_ctz(~lessMask);
+	pos += 4;
+    }
+#elif defined(__SSE2__)
+    // SSE2 has no 64 bit compare at all, so the unsigned 64 bit less than is
+    // built from 32 bit compares of the high and low halves of each lane.
+    const __m128i signBits = _mm_set1_epi32((int)0x80000000);
+    const __m128i key = _mm_xor_si128(
+	_mm_set_epi32((int)(syncID >> 32), (int)syncID,
+		      (int)(syncID >> 32), (int)syncID), signBits);
+    __m128i block, greater, equal, lessLanes;
+    int lessMask;
+
+    while ((pos + 2) <= numIDs) {
+	block = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(pIDs + pos)),
+			      signBits);
+	greater = _mm_cmpgt_epi32(key, block);
+	equal = _mm_cmpeq_epi32(key, block);
+	lessLanes = _mm_or_si128(
+	    _mm_shuffle_epi32(greater, _MM_SHUFFLE(3, 3, 1, 1)),
+	    _mm_and_si128(_mm_shuffle_epi32(equal, _MM_SHUFFLE(3, 3, 1, 1)),
+			  _mm_shuffle_epi32(greater, _MM_SHUFFLE(2, 2, 0, 0))));
+	lessMask = _mm_movemask_pd(_mm_castsi128_pd(lessLanes));
+	if (lessMask != 0x3)
+	    return pos + (lessMask & 0x1);
+	pos += 2;
+    }
+#endif
+
+    while ((pos < numIDs) && (pIDs[pos] < syncID))
+	pos++;
+
+    return pos;
+}
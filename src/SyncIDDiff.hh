@@ -0,0 +1,59 @@
+/*
+ * Copyright 2004, 2005 Andrew De Ponte
+ *
+ * This file is part of zsrep.
+ *
+ * zsrep is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * zsrep is distributed in the hopes that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with zsrep; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @file SyncIDDiff.hh
+ * @brief A specifications file for the SyncID set difference engine.
+ * @author Andrew De Ponte
+ *
+ * A specifications file for the engine used to work out which SyncIDs
+ * recorded at the last synchronization no longer exist in the calendar.
+ */
+
+#ifndef SYNCIDDIFF_H
+#define SYNCIDDIFF_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+/**
+ * @class SyncIDDiff
+ * @brief A set difference engine for sorted arrays of SyncIDs.
+ *
+ * The SyncIDDiff class provides the sorting and set difference operations
+ * used to detect deleted Todo items. Both sets are sorted first, after which
+ * the difference is produced by a single merge pass over the two arrays. The
+ * merge pass steps over runs the two sets have in common using SSE2 or AVX2
+ * compares when the compiler targets them and plain compares otherwise.
+ */
+class SyncIDDiff {
+public:
+    static void Sort(std::vector<uint64_t> &syncIDs);
+    static void Difference(const uint64_t *pOldIDs, size_t numOldIDs,
+			   const uint64_t *pCurIDs, size_t numCurIDs,
+			   std::vector<uint64_t> &removedIDs);
+private:
+    static size_t SkipLess(const uint64_t *pIDs, size_t numIDs, size_t pos,
+			   uint64_t syncID);
+};
+
+#endif
@@ -0,0 +1,368 @@
+/*
+ * Copyright 2004, 2005 Andrew De Ponte
+ *
+ * This file is part of zsrep.
+ *
+ * zsrep is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * zsrep is distributed in the hopes that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with zsrep; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @file SyncIDJournal.cc
+ * @brief An implementation file for the SyncID journal.
+ * @author Andrew De Ponte
+ *
+ * An implementation file for the SyncID journal, the append only record of
+ * the SyncIDs added and removed since the SyncID log was last written.
+ */
+
+#include "SyncIDJournal.hh"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include <map>
+
+static uint32_t SwapBytes32(uint32_t val) {
+    return ((val >> 24) | ((val >> 8) & 0xff00) | ((val << 8) & 0xff0000) |
+	    (val << 24));
+}
+
+static uint64_t SwapBytes64(uint64_t val) {
+    return (((uint64_t)SwapBytes32((uint32_t)val) << 32) |
+	    SwapBytes32((uint32_t)(val >> 32)));
+}
+
+static int WriteAll(int fd, const char *pData, size_t dataSize) {
+    ssize_t retval;
+
+    while (dataSize > 0) {
+	retval = write(fd, pData, dataSize);
+	if (retval < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return -1;
+	}
+	pData += retval;
+	dataSize -= (size_t)retval;
+    }
+
+    return 0;
+}
+
+/**
+ * Replay the SyncID journal.
+ *
+ * Replay the SyncID journal on top of the SyncIDs and fingerprints of the
+ * SyncID log, producing the set of SyncIDs and their fingerprints as of the
+ * end of the last synchronization. When the journal holds no entries that
+ * apply to the log, syncIDs and fingerprints are left untouched and those
+ * of the log can be used as they are.
+ * @param journalPath The path of the SyncID journal file.
+ * @param logChecksum The checksum of the SyncID log the journal applies to.
+ * @param pLogIDs Pointer to the sorted SyncIDs of the SyncID log.
+ * @param pLogFingerprints Pointer to the fingerprints of the SyncID log, or
+ * NULL if it has none.
+ * @param numLogIDs The number of SyncIDs pointed to by pLogIDs.
+ * @param syncIDs The vector the resulting SyncIDs are stored in, sorted,
+ * when numRecords is non-zero.
+ * @param fingerprints The vector the resulting fingerprints are stored in,
+ * in the order of syncIDs, when numRecords is non-zero.
+ * @param numRecords The number of journal entries that were replayed.
+ * @return An integer representing success (zero) or failure (non-zero).
+ * @retval 0 Success.
+ * @retval 1 Failed to open the journal file, as happens when there is none.
+ * @retval 2 The journal belongs to a different SyncID log or is damaged,
+ * and none of it was replayed.
+ * @retval 3 The journal ends in a damaged entry. The entries before it were
+ * still replayed.
+ */
+int SyncIDJournalType::Replay(const std::string &journalPath,
+			      uint32_t logChecksum,
+			      const uint64_t *pLogIDs,
+			      const uint64_t *pLogFingerprints,
+			      size_t numLogIDs,
+			      std::vector<uint64_t> &syncIDs,
+			      std::vector<uint64_t> &fingerprints,
+			      size_t &numRecords) {
+    std::vector<char> content;
+    struct stat journalStat;
+    SyncIDJournalHeader header;
+    SyncIDJournalRecord record;
+    SyncIDJournalRecordV1 recordV1;
+    std::map<uint64_t, SyncIDJournalRecord> lastOps;
+    std::map<uint64_t, SyncIDJournalRecord>::iterator opIt;
+    size_t offset, logPos, recordSize;
+    ssize_t numRead;
+    bool swapFlag;
+    int fd;
+    int retval = 0;
+
+    numRecords = 0;
+
+    fd = open(journalPath.c_str(), O_RDONLY);
+    if (fd == -1)
+	return 1;
+
+    if (fstat(fd, &journalStat) != 0) {
+	close(fd);
+	return 1;
+    }
+
+    // The journal only ever holds the changes of recent synchronizations,
+    // so it is small enough to just be read in whole.
+    content.resize((size_t)journalStat.st_size);
+    offset = 0;
+    while (offset < content.size()) {
+	numRead = read(fd, &content[offset], content.size() - offset);
+	if (numRead < 0) {
+	    if (errno == EINTR)
+		continue;
+	    close(fd);
+	    return 2;
+	}
+	if (numRead == 0)
+	    break;
+	offset += (size_t)numRead;
+    }
+    close(fd);
+    content.resize(offset);
+
+    if (content.size() < sizeof(header))
+	return 2;
+    memcpy(&header, &content[0], sizeof(header));
+
+    swapFlag = (header.byteOrder != SYNCIDJOURNAL_BYTE_ORDER);
+    if (swapFlag) {
+	header.magic = SwapBytes32(header.magic);
+	header.version = SwapBytes32(header.version);
+	header.logChecksum = SwapBytes32(header.logChecksum);
+    }
+    if ((header.magic != SYNCIDJOURNAL_MAGIC) ||
+	(header.version > SYNCIDJOURNAL_VERSION) ||
+	(header.logChecksum != logChecksum))
+	return 2;
+
+    // Only the last entry of each SyncID matters, since each one replaces
+    // the effect of the ones before it. Journals from before fingerprints
+    // were kept have shorter entries, their fingerprints are unknown.
+    recordSize = (header.version >= 2) ? sizeof(record) : sizeof(recordV1);
+    for (offset = sizeof(header);
+	 (offset + recordSize) <= content.size();
+	 offset += recordSize) {
+	if (header.version >= 2) {
+	    memcpy(&record, &content[offset], sizeof(record));
+	} else {
+	    memcpy(&recordV1, &content[offset], sizeof(recordV1));
+	    record.syncID = recordV1.syncID;
+	    record.fingerprint = 0;
+	    record.op = recordV1.op;
+	    record.check = recordV1.check;
+	}
+	if (swapFlag) {
+	    record.syncID = SwapBytes64(record.syncID);
+	    record.fingerprint = SwapBytes64(record.fingerprint);
+	    record.op = SwapBytes32(record.op);
+	    record.check = SwapBytes32(record.check);
+	}
+	if ((record.check != RecordCheck(record.syncID, record.op,
+					 record.fingerprint)) ||
+	    ((record.op != SYNCIDJOURNAL_OP_ADD) &&
+	     (record.op != SYNCIDJOURNAL_OP_REMOVE))) {
+	    retval = 3;
+	    break;
+	}
+	lastOps[record.syncID] = record;
+	numRecords++;
+    }
+    if ((retval == 0) && (offset != content.size()))
+	retval = 3;
+
+    if (numRecords == 0)
+	return retval;
+
+    // Merge the SyncIDs of the log with the journaled changes. Both are in
+    // ascending order so this is a single pass over each. An add of a
+    // SyncID already in the log replaces its fingerprint.
+    syncIDs.clear();
+    syncIDs.reserve(numLogIDs + lastOps.size());
+    fingerprints.clear();
+    fingerprints.reserve(numLogIDs + lastOps.size());
+    logPos = 0;
+    opIt = lastOps.begin();
+    while ((logPos < numLogIDs) || (opIt != lastOps.end())) {
+	if ((opIt == lastOps.end()) ||
+	    ((logPos < numLogIDs) && (pLogIDs[logPos] < opIt->first))) {
+	    syncIDs.push_back(pLogIDs[logPos]);
+	    fingerprints.push_back(pLogFingerprints ?
+				   pLogFingerprints[logPos] : 0);
+	    logPos++;
+	} else {
+	    if ((logPos < numLogIDs) && (pLogIDs[logPos] == opIt->first))
+		logPos++;
+	    if (opIt->second.op == SYNCIDJOURNAL_OP_ADD) {
+		syncIDs.push_back(opIt->first);
+		fingerprints.push_back(opIt->second.fingerprint);
+	    }
+	    opIt++;
+	}
+    }
+
+    return retval;
+}
+
+/**
+ * Append to the SyncID journal.
+ *
+ * Append entries for the given added and removed SyncIDs to the SyncID
+ * journal. A journal is started if there isn't one yet. The added SyncIDs
+ * include those whose fingerprint changed.
+ * @param journalPath The path of the SyncID journal file.
+ * @param logChecksum The checksum of the SyncID log the journal applies to.
+ * @param addedIDs The SyncIDs added, or whose fingerprint changed, since the
+ * last synchronization.
+ * @param addedFingerprints The fingerprint of each of the added SyncIDs.
+ * @param removedIDs The SyncIDs removed since the last synchronization.
+ * @return An integer representing success (zero) or failure (non-zero).
+ * @retval 0 Success.
+ * @retval 1 Failed to open the journal file for output.
+ * @retval 2 Failed to write the journal file.
+ * @retval 3 The journal is in an older format, or doesn't belong to the
+ * SyncID log, so it can't be appended to.
+ */
+int SyncIDJournalType::Append(const std::string &journalPath,
+			      uint32_t logChecksum,
+			      const std::vector<uint64_t> &addedIDs,
+			      const std::vector<uint64_t> &addedFingerprints,
+			      const std::vector<uint64_t> &removedIDs) {
+    std::vector<SyncIDJournalRecord> records;
+    SyncIDJournalRecord record;
+    SyncIDJournalHeader header;
+    size_t i;
+    int fd;
+
+    if (addedIDs.empty() && removedIDs.empty())
+	return 0;
+
+    fd = open(journalPath.c_str(), O_RDWR | O_APPEND);
+    if ((fd == -1) && (errno == ENOENT)) {
+	if (Reset(journalPath, logChecksum) != 0)
+	    return 1;
+	fd = open(journalPath.c_str(), O_RDWR | O_APPEND);
+    }
+    if (fd == -1)
+	return 1;
+
+    // Entries may only be added to a journal written in the current format
+    // on this host, for this log.
+    if ((pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) ||
+	(header.magic != SYNCIDJOURNAL_MAGIC) ||
+	(header.version != SYNCIDJOURNAL_VERSION) ||
+	(header.byteOrder != SYNCIDJOURNAL_BYTE_ORDER) ||
+	(header.logChecksum != logChecksum)) {
+	close(fd);
+	return 3;
+    }
+
+    records.reserve(addedIDs.size() + removedIDs.size());
+    for (i = 0; i < removedIDs.size(); i++) {
+	record.syncID = removedIDs[i];
+	record.fingerprint = 0;
+	record.op = SYNCIDJOURNAL_OP_REMOVE;
+	record.check = RecordCheck(record.syncID, record.op,
+				   record.fingerprint);
+	records.push_back(record);
+    }
+    for (i = 0; i < addedIDs.size(); i++) {
+	record.syncID = addedIDs[i];
+	record.fingerprint = addedFingerprints[i];
+	record.op = SYNCIDJOURNAL_OP_ADD;
+	record.check = RecordCheck(record.syncID, record.op,
+				   record.fingerprint);
+	records.push_back(record);
+    }
+
+    if (WriteAll(fd, (const char *)&records[0],
+		 records.size() * sizeof(SyncIDJournalRecord)) != 0) {
+	close(fd);
+	return 2;
+    }
+
+    if (close(fd) != 0)
+	return 2;
+
+    return 0;
+}
+
+/**
+ * Reset the SyncID journal.
+ *
+ * Reset the SyncID journal to hold no entries, tying it to the SyncID log
+ * with the given checksum. This is done right after the SyncID log has been
+ * rewritten with all the SyncIDs.
+ * @param journalPath The path of the SyncID journal file.
+ * @param logChecksum The checksum of the SyncID log the journal applies to.
+ * @return An integer representing success (zero) or failure (non-zero).
+ * @retval 0 Success.
+ * @retval 1 Failed to open the journal file for output.
+ * @retval 2 Failed to write the journal file.
+ */
+int SyncIDJournalType::Reset(const std::string &journalPath,
+			     uint32_t logChecksum) {
+    SyncIDJournalHeader header;
+    int fd;
+
+    header.magic = SYNCIDJOURNAL_MAGIC;
+    header.version = SYNCIDJOURNAL_VERSION;
+    header.byteOrder = SYNCIDJOURNAL_BYTE_ORDER;
+    header.logChecksum = logChecksum;
+
+    fd = open(journalPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd == -1)
+	return 1;
+
+    if (WriteAll(fd, (const char *)&header, sizeof(header)) != 0) {
+	close(fd);
+	return 2;
+    }
+
+    if (close(fd) != 0)
+	return 2;
+
+    return 0;
+}
+
+/**
+ * Calculate the check value of a journal entry.
+ *
+ * Calculate the check value stored with each journal entry. Entries without
+ * a fingerprint, as in version 1 journals, have a fingerprint of zero, for
+ * which the check value is the same as it was in version 1.
+ * @param syncID The SyncID of the entry.
+ * @param op The operation of the entry.
+ * @param fingerprint The fingerprint of the entry.
+ * @return The check value of the entry.
+ */
+uint32_t SyncIDJournalType::RecordCheck(uint64_t syncID, uint32_t op,
+					uint64_t fingerprint) {
+    uint64_t hash;
+
+    hash = (syncID ^ ((uint64_t)op << 56) ^
+	    (fingerprint * 0xff51afd7ed558ccdULL)) * 0x9e3779b97f4a7c15ULL;
+    return (uint32_t)(hash >> 32) ^ 0x4b4f5450;
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright 2004, 2005 Andrew De Ponte
+ *
+ * This file is part of zsrep.
+ *
+ * zsrep is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * zsrep is distributed in the hopes that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with zsrep; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @file SyncIDJournal.hh
+ * @brief A specifications file for the SyncID journal.
+ * @author Andrew De Ponte
+ *
+ * A specifications file for the SyncID journal, the append only record of
+ * the SyncIDs added and removed since the SyncID log was last written.
+ */
+
+#ifndef SYNCIDJOURNAL_H
+#define SYNCIDJOURNAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#define SYNCIDJOURNAL_MAGIC 0x4a544f4b
+#define SYNCIDJOURNAL_VERSION 2
+#define SYNCIDJOURNAL_BYTE_ORDER 0x01020304
+
+#define SYNCIDJOURNAL_OP_ADD 1
+#define SYNCIDJOURNAL_OP_REMOVE 2
+
+/**
+ * @struct SyncIDJournalHeader
+ * @brief The header at the start of a SyncID journal file.
+ *
+ * The header at the start of a SyncID journal file. The logChecksum is the
+ * checksum of the SyncID log the journal applies to, so a journal left over
+ * from before the log was last rewritten is recognized and ignored.
+ */
+struct SyncIDJournalHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t logChecksum;
+};
+
+/**
+ * @struct SyncIDJournalRecord
+ * @brief A single entry of the SyncID journal.
+ *
+ * A single entry of the SyncID journal, recording that a SyncID was added,
+ * or had the fingerprint of its item change, or was removed. The check
+ * field lets a partially written entry at the end of the journal be told
+ * apart from a real one.
+ */
+struct SyncIDJournalRecord {
+    uint64_t syncID;
+    uint64_t fingerprint;
+    uint32_t op;
+    uint32_t check;
+};
+
+/**
+ * @struct SyncIDJournalRecordV1
+ * @brief A single entry of a version 1 SyncID journal.
+ *
+ * A single entry of a SyncID journal written before fingerprints were kept.
+ */
+struct SyncIDJournalRecordV1 {
+    uint64_t syncID;
+    uint32_t op;
+    uint32_t check;
+};
+
+/**
+ * @class SyncIDJournalType
+ * @brief A type providing access to the SyncID journal.
+ *
+ * The SyncIDJournalType class replays the SyncID journal on top of the
+ * SyncIDs and fingerprints of the SyncID log, and appends the changes of a
+ * synchronization to it. Only the changes are ever written, until the
+ * journal grows large enough that the plugin folds it back into the SyncID
+ * log.
+ */
+class SyncIDJournalType {
+public:
+    static int Replay(const std::string &journalPath, uint32_t logChecksum,
+		      const uint64_t *pLogIDs,
+		      const uint64_t *pLogFingerprints, size_t numLogIDs,
+		      std::vector<uint64_t> &syncIDs,
+		      std::vector<uint64_t> &fingerprints,
+		      size_t &numRecords);
+    static int Append(const std::string &journalPath, uint32_t logChecksum,
+		      const std::vector<uint64_t> &addedIDs,
+		      const std::vector<uint64_t> &addedFingerprints,
+		      const std::vector<uint64_t> &removedIDs);
+    static int Reset(const std::string &journalPath, uint32_t logChecksum);
+private:
+    static uint32_t RecordCheck(uint64_t syncID, uint32_t op,
+				uint64_t fingerprint);
+};
+
+#endif
@@ -0,0 +1,435 @@
+/*
+ * Copyright 2004, 2005 Andrew De Ponte
+ *
+ * This file is part of zsrep.
+ *
+ * zsrep is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * zsrep is distributed in the hopes that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with zsrep; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @file SyncIDLog.cc
+ * @brief An implementation file for the SyncID log.
+ * @author Andrew De Ponte
+ *
+ * An implementation file for the SyncID log, the file recording the SyncIDs
+ * present in the calendar at the end of the last synchronization.
+ */
+
+#include "SyncIDLog.hh"
+#include "SyncIDDiff.hh"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+
+static uint32_t SwapBytes32(uint32_t val) {
+    return ((val >> 24) | ((val >> 8) & 0xff00) | ((val << 8) & 0xff0000) |
+	    (val << 24));
+}
+
+static uint64_t SwapBytes64(uint64_t val) {
+    return (((uint64_t)SwapBytes32((uint32_t)val) << 32) |
+	    SwapBytes32((uint32_t)(val >> 32)));
+}
+
+/**
+ * Construct a default SyncIDLogType object.
+ *
+ * Construct a default SyncIDLogType object holding no SyncIDs.
+ */
+SyncIDLogType::SyncIDLogType(void) {
+    pMap = NULL;
+    mapSize = 0;
+    pSyncIDs = NULL;
+    pFingerprints = NULL;
+    numSyncIDs = 0;
+    checksum = Checksum(NULL, NULL, 0);
+}
+
+/**
+ * Destruct the SyncIDLogType object.
+ *
+ * Destruct the SyncIDLogType object, unmapping the log if it is mapped.
+ */
+SyncIDLogType::~SyncIDLogType(void) {
+    Close();
+}
+
+/**
+ * Load the SyncID log.
+ *
+ * Load the SyncID log at the given path by memory mapping it. The SyncIDs
+ * and fingerprints stay in the mapping and are handed out in place by
+ * GetSyncIDs() and GetFingerprints() until Close() is called. Logs in the
+ * original format are converted and the log file is rewritten in the
+ * current format.
+ * @param logPath The path of the SyncID log file.
+ * @return An integer representing success (zero) or failure (non-zero).
+ * @retval 0 Success.
+ * @retval 1 Failed to open the log file, as happens before the first sync.
+ * @retval 2 Failed to memory map the log file.
+ * @retval 3 The log file is truncated or its checksum doesn't match. Any
+ * SyncIDs that could be read from an original format log are still loaded.
+ * @retval 4 The log file was written by a newer version of the plugin.
+ */
+int SyncIDLogType::Load(const std::string &logPath) {
+    int fd;
+    struct stat logStat;
+    const SyncIDLogHeader *pHeader;
+    uint32_t version;
+    uint64_t count;
+    size_t numArrays;
+    size_t i;
+
+    Close();
+
+    fd = open(logPath.c_str(), O_RDONLY);
+    if (fd == -1)
+	return 1;
+
+    if (fstat(fd, &logStat) != 0) {
+	close(fd);
+	return 1;
+    }
+
+    // An empty log holds no SyncIDs, and mmap() refuses zero length maps.
+    if (logStat.st_size == 0) {
+	close(fd);
+	return 0;
+    }
+
+    mapSize = (size_t)logStat.st_size;
+    pMap = mmap(NULL, mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (pMap == MAP_FAILED) {
+	pMap = NULL;
+	mapSize = 0;
+	return 2;
+    }
+
+    // Logs without the magic number at the start were written in the
+    // original format, and are converted.
+    pHeader = (const SyncIDLogHeader *)pMap;
+    if ((mapSize < sizeof(SyncIDLogHeader)) ||
+	((pHeader->magic != SYNCIDLOG_MAGIC) &&
+	 (pHeader->magic != SwapBytes32(SYNCIDLOG_MAGIC))))
+	return LoadLegacy(logPath, (const char *)pMap, mapSize);
+
+    if (pHeader->byteOrder == SYNCIDLOG_BYTE_ORDER) {
+	version = pHeader->version;
+	count = pHeader->numSyncIDs;
+    } else {
+	version = SwapBytes32(pHeader->version);
+	count = SwapBytes64(pHeader->numSyncIDs);
+    }
+    if (version > SYNCIDLOG_VERSION) {
+	Close();
+	return 4;
+    }
+
+    // Logs from before version 3 hold no fingerprints.
+    numArrays = (version >= 3) ? 2 : 1;
+    if (count > ((mapSize - sizeof(SyncIDLogHeader)) /
+		 (numArrays * sizeof(uint64_t)))) {
+	Close();
+	return 3;
+    }
+
+    if (pHeader->byteOrder == SYNCIDLOG_BYTE_ORDER) {
+	pSyncIDs = (const uint64_t *)(pHeader + 1);
+	if (numArrays == 2)
+	    pFingerprints = pSyncIDs + count;
+	numSyncIDs = (size_t)count;
+	checksum = pHeader->checksum;
+    } else {
+	// The log was written on a host of the opposite byte order, so the
+	// SyncIDs can't be used in place and are swapped into a copy.
+	ownedSyncIDs.resize((size_t)count);
+	for (i = 0; i < (size_t)count; i++) {
+	    ownedSyncIDs[i] =
+		SwapBytes64(((const uint64_t *)(pHeader + 1))[i]);
+	}
+	if (numArrays == 2) {
+	    ownedFingerprints.resize((size_t)count);
+	    for (i = 0; i < (size_t)count; i++) {
+		ownedFingerprints[i] =
+		    SwapBytes64(((const uint64_t *)(pHeader + 1))[count + i]);
+	    }
+	}
+	checksum = SwapBytes32(pHeader->checksum);
+	munmap(pMap, mapSize);
+	pMap = NULL;
+	mapSize = 0;
+	pSyncIDs = ownedSyncIDs.empty() ? NULL : &ownedSyncIDs[0];
+	pFingerprints = ownedFingerprints.empty() ? NULL :
+	    &ownedFingerprints[0];
+	numSyncIDs = ownedSyncIDs.size();
+    }
+
+    if (Checksum(pSyncIDs, pFingerprints, numSyncIDs) != checksum) {
+	Close();
+	return 3;
+    }
+
+    return 0;
+}
+
+/**
+ * Close the SyncID log.
+ *
+ * Close the SyncID log, unmapping it. The pointer obtained from GetSyncIDs()
+ * is no longer valid afterwards.
+ */
+void SyncIDLogType::Close(void) {
+    if (pMap)
+	munmap(pMap, mapSize);
+    pMap = NULL;
+    mapSize = 0;
+    pSyncIDs = NULL;
+    pFingerprints = NULL;
+    numSyncIDs = 0;
+    checksum = Checksum(NULL, NULL, 0);
+    ownedSyncIDs.clear();
+    ownedFingerprints.clear();
+}
+
+/**
+ * Get the SyncIDs.
+ *
+ * Obtain the SyncIDs loaded from the log, in ascending order.
+ * @return A pointer to the SyncIDs, or NULL if there are none.
+ */
+const uint64_t *SyncIDLogType::GetSyncIDs(void) const {
+    return pSyncIDs;
+}
+
+/**
+ * Get the fingerprints.
+ *
+ * Obtain the fingerprints loaded from the log, in the order of the SyncIDs
+ * they belong to.
+ * @return A pointer to the fingerprints, or NULL if there are none, as with
+ * logs written before fingerprints were kept.
+ */
+const uint64_t *SyncIDLogType::GetFingerprints(void) const {
+    return pFingerprints;
+}
+
+/**
+ * Get the number of SyncIDs.
+ *
+ * Obtain the number of SyncIDs loaded from the log.
+ * @return The number of SyncIDs.
+ */
+size_t SyncIDLogType::GetNumSyncIDs(void) const {
+    return numSyncIDs;
+}
+
+/**
+ * Get the checksum of the SyncIDs.
+ *
+ * Obtain the checksum of the SyncIDs loaded from the log, as recorded in the
+ * log header. This identifies the log the SyncID journal applies to.
+ * @return The checksum of the SyncIDs.
+ */
+uint32_t SyncIDLogType::GetChecksum(void) const {
+    return checksum;
+}
+
+/**
+ * Save the SyncID log.
+ *
+ * Save the given SyncIDs and fingerprints as the SyncID log at the given
+ * path. The log is written to a temporary file which then replaces the log,
+ * so an interrupted save leaves the previous log intact.
+ * @param logPath The path of the SyncID log file.
+ * @param syncIDs The SyncIDs to save, sorted in ascending order without
+ * duplicates.
+ * @param fingerprints The fingerprint of the item of each SyncID, in the
+ * same order. It must be the same size as syncIDs.
+ * @return An integer representing success (zero) or failure (non-zero).
+ * @retval 0 Success.
+ * @retval 1 Failed to open the temporary file for output.
+ * @retval 2 Failed to write the temporary file.
+ * @retval 3 Failed to replace the log with the temporary file.
+ */
+int SyncIDLogType::Save(const std::string &logPath,
+			const std::vector<uint64_t> &syncIDs,
+			const std::vector<uint64_t> &fingerprints) {
+    std::string tmpPath;
+    SyncIDLogHeader header;
+    struct iovec iov[3];
+    size_t totalSize;
+    size_t written = 0;
+    ssize_t retval;
+    int fd;
+    int i;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = SYNCIDLOG_MAGIC;
+    header.version = SYNCIDLOG_VERSION;
+    header.byteOrder = SYNCIDLOG_BYTE_ORDER;
+    header.numSyncIDs = syncIDs.size();
+    header.checksum = Checksum(syncIDs.empty() ? NULL : &syncIDs[0],
+			       fingerprints.empty() ? NULL : &fingerprints[0],
+			       syncIDs.size());
+
+    tmpPath = logPath;
+    tmpPath.append(".tmp");
+
+    fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd == -1)
+	return 1;
+
+    // Write the header, the SyncIDs and the fingerprints straight out of the
+    // vectors, picking up where a short write left off.
+    iov[0].iov_base = (void *)&header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = syncIDs.empty() ? NULL : (void *)&syncIDs[0];
+    iov[1].iov_len = syncIDs.size() * sizeof(uint64_t);
+    iov[2].iov_base = fingerprints.empty() ? NULL : (void *)&fingerprints[0];
+    iov[2].iov_len = fingerprints.size() * sizeof(uint64_t);
+    totalSize = iov[0].iov_len + iov[1].iov_len + iov[2].iov_len;
+
+    while (written < totalSize) {
+	retval = writev(fd, iov, 3);
+	if (retval < 0) {
+	    if (errno == EINTR)
+		continue;
+	    close(fd);
+	    unlink(tmpPath.c_str());
+	    return 2;
+	}
+	written += (size_t)retval;
+	for (i = 0; i < 3; i++) {
+	    if ((size_t)retval >= iov[i].iov_len) {
+		retval -= iov[i].iov_len;
+		iov[i].iov_len = 0;
+	    } else {
+		iov[i].iov_base = (char *)iov[i].iov_base + retval;
+		iov[i].iov_len -= retval;
+		retval = 0;
+	    }
+	}
+    }
+
+    if (close(fd) != 0) {
+	unlink(tmpPath.c_str());
+	return 2;
+    }
+
+    if (rename(tmpPath.c_str(), logPath.c_str()) != 0) {
+	unlink(tmpPath.c_str());
+	return 3;
+    }
+
+    return 0;
+}
+
+/**
+ * Load a SyncID log in the original format.
+ *
+ * Load a SyncID log written in the original format, a 4 byte count followed
+ * by that many 4 byte SyncIDs. The SyncIDs are sorted into a copy and the
+ * log is rewritten in the current format so this only happens once.
+ * @param logPath The path of the SyncID log file.
+ * @param pData Pointer to the content of the log file.
+ * @param dataSize The size of the content of the log file.
+ * @return An integer representing success (zero) or failure (non-zero).
+ * @retval 0 Success.
+ * @retval 3 The log file is truncated. The SyncIDs that could be read are
+ * still loaded, but the log is not rewritten.
+ */
+int SyncIDLogType::LoadLegacy(const std::string &logPath, const char *pData,
+			      size_t dataSize) {
+    uint32_t count = 0;
+    uint32_t tmpSyncID;
+    size_t numAvail;
+    size_t i;
+    int retval = 0;
+
+    // A log too short to hold the count is treated as holding no SyncIDs.
+    if (dataSize >= sizeof(count))
+	memcpy(&count, pData, sizeof(count));
+
+    numAvail = (dataSize - sizeof(count)) / sizeof(tmpSyncID);
+    if (dataSize < sizeof(count))
+	numAvail = 0;
+    if (numAvail > count)
+	numAvail = count;
+    if (numAvail < count)
+	retval = 3;
+
+    ownedSyncIDs.reserve(numAvail);
+    for (i = 0; i < numAvail; i++) {
+	memcpy(&tmpSyncID, pData + sizeof(count) + (i * sizeof(tmpSyncID)),
+	       sizeof(tmpSyncID));
+	ownedSyncIDs.push_back(tmpSyncID);
+    }
+
+    munmap(pMap, mapSize);
+    pMap = NULL;
+    mapSize = 0;
+
+    // The original format kept no fingerprints, so they are all unknown.
+    SyncIDDiff::Sort(ownedSyncIDs);
+    ownedFingerprints.assign(ownedSyncIDs.size(), 0);
+    pSyncIDs = ownedSyncIDs.empty() ? NULL : &ownedSyncIDs[0];
+    pFingerprints = ownedFingerprints.empty() ? NULL : &ownedFingerprints[0];
+    numSyncIDs = ownedSyncIDs.size();
+    checksum = Checksum(pSyncIDs, pFingerprints, numSyncIDs);
+
+    if (retval == 0)
+	Save(logPath, ownedSyncIDs, ownedFingerprints);
+
+    return retval;
+}
+
+/**
+ * Calculate the checksum of a set of SyncIDs.
+ *
+ * Calculate the checksum stored in the log header. It is FNV-1a applied to
+ * whole 64 bit SyncIDs and then fingerprints rather than bytes, folded down
+ * to 32 bits, so that it keeps up with reading the log out of the page
+ * cache.
+ * @param pIDs Pointer to the SyncIDs.
+ * @param pFingerprints Pointer to the fingerprints of the SyncIDs, or NULL
+ * for a log without fingerprints.
+ * @param numIDs The number of SyncIDs pointed to by pIDs.
+ * @return The checksum of the SyncIDs.
+ */
+uint32_t SyncIDLogType::Checksum(const uint64_t *pIDs,
+				 const uint64_t *pFingerprints,
+				 size_t numIDs) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t i;
+
+    for (i = 0; i < numIDs; i++) {
+	hash ^= pIDs[i];
+	hash *= 0x100000001b3ULL;
+    }
+    for (i = 0; pFingerprints && (i < numIDs); i++) {
+	hash ^= pFingerprints[i];
+	hash *= 0x100000001b3ULL;
+    }
+
+    return (uint32_t)(hash ^ (hash >> 32));
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright 2004, 2005 Andrew De Ponte
+ *
+ * This file is part of zsrep.
+ *
+ * zsrep is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * zsrep is distributed in the hopes that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with zsrep; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @file SyncIDLog.hh
+ * @brief A specifications file for the SyncID log.
+ * @author Andrew De Ponte
+ *
+ * A specifications file for the SyncID log, the file recording the SyncIDs
+ * present in the calendar at the end of the last synchronization.
+ */
+
+#ifndef SYNCIDLOG_H
+#define SYNCIDLOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#define SYNCIDLOG_MAGIC 0x4c544f4b
+#define SYNCIDLOG_VERSION 3
+#define SYNCIDLOG_BYTE_ORDER 0x01020304
+
+/**
+ * @struct SyncIDLogHeader
+ * @brief The header at the start of a SyncID log file.
+ *
+ * The header at the start of a SyncID log file. It is followed directly by
+ * numSyncIDs 64 bit SyncIDs in ascending order, and from version 3 on by the
+ * 64 bit fingerprint of the synchronized content of each of those items, in
+ * the same order. All values are stored in the byte order of the host that
+ * wrote the file, which byteOrder records.
+ */
+struct SyncIDLogHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t checksum;
+    uint64_t numSyncIDs;
+};
+
+/**
+ * @class SyncIDLogType
+ * @brief A type providing access to the SyncID log.
+ *
+ * The SyncIDLogType class loads and saves the SyncID log. Loading memory maps
+ * the log and exposes the SyncIDs and fingerprints in place. Logs written in
+ * the original format (a 4 byte count followed by 4 byte SyncIDs) are
+ * converted and rewritten in the current format the first time they are
+ * loaded. Logs written before fingerprints were kept have none; a
+ * fingerprint of zero means it isn't known.
+ */
+class SyncIDLogType {
+public:
+    SyncIDLogType(void);
+    ~SyncIDLogType(void);
+
+    int Load(const std::string &logPath);
+    void Close(void);
+
+    const uint64_t *GetSyncIDs(void) const;
+    const uint64_t *GetFingerprints(void) const;
+    size_t GetNumSyncIDs(void) const;
+    uint32_t GetChecksum(void) const;
+
+    static int Save(const std::string &logPath,
+		    const std::vector<uint64_t> &syncIDs,
+		    const std::vector<uint64_t> &fingerprints);
+    static uint32_t Checksum(const uint64_t *pIDs,
+			     const uint64_t *pFingerprints, size_t numIDs);
+private:
+    int LoadLegacy(const std::string &logPath, const char *pData,
+		   size_t dataSize);
+
+    void *pMap;
+    size_t mapSize;
+    const uint64_t *pSyncIDs;
+    const uint64_t *pFingerprints;
+    size_t numSyncIDs;
+    uint32_t checksum;
+    std::vector<uint64_t> ownedSyncIDs;
+    std::vector<uint64_t> ownedFingerprints;
+};
+
+#endif
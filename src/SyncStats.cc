@@ -0,0 +1,251 @@
+/*
+ * Copyright 2004, 2005 Andrew De Ponte
+ *
+ * This file is part of zsrep.
+ *
+ * zsrep is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * zsrep is distributed in the hopes that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with zsrep; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @file SyncStats.cc
+ * @brief An implementation file for the synchronization statistics.
+ * @author Andrew De Ponte
+ *
+ * An implementation file for the timers and counters kept over a
+ * synchronization session, and the report written from them.
+ */
+
+#include "SyncStats.hh"
+
+#include <stdio.h>
+#include <unistd.h>
+
+// The names used for the phases and counters in the report, in the order
+// of the SYNCSTATS_ defines.
+static const char *phaseNames[SYNCSTATS_NUM_PHASES] = {
+    "initialize", "clean_up", "get_all_todo_items", "get_new_todo_items",
+    "get_mod_todo_items", "get_del_todo_item_ids", "add_todo_items",
+    "mod_todo_items", "del_todo_items", "map_item_ids", "calendar_load",
+    "calendar_save", "classify", "conv_kcal_todo", "conv_todo_item",
+    "syncid_log_load", "syncid_log_save", "conv_cache_load",
+    "conv_cache_save", "idmap_load", "idmap_save", "calendar_open",
+    "prefetch_wait", "cal_cache_load", "cal_cache_save"
+};
+
+static const char *counterNames[SYNCSTATS_NUM_COUNTERS] = {
+    "items_scanned", "items_converted", "items_added", "items_modified",
+    "items_deleted", "items_mapped", "bytes_read", "bytes_written",
+    "conv_cache_hits", "items_unchanged", "arena_allocs", "arena_chunks"
+};
+
+/**
+ * Construct a default SyncStatsType object.
+ *
+ * Construct a default SyncStatsType object with all timers and counters at
+ * zero.
+ */
+SyncStatsType::SyncStatsType(void) {
+    Reset();
+}
+
+/**
+ * Reset the statistics.
+ *
+ * Reset all timers and counters to zero and mark the current time as the
+ * start of the session.
+ */
+void SyncStatsType::Reset(void) {
+    int i;
+
+    sessionStart = time(NULL);
+    for (i = 0; i < SYNCSTATS_NUM_PHASES; i++) {
+	phaseNanos[i] = 0;
+	phaseCalls[i] = 0;
+    }
+    for (i = 0; i < SYNCSTATS_NUM_COUNTERS; i++)
+	counters[i] = 0;
+}
+
+/**
+ * Merge in the statistics of another session.
+ *
+ * Add the times, calls and counts of the given statistics to these, as for
+ * work that was timed apart from them on another thread.
+ * @param stats The statistics to add.
+ */
+void SyncStatsType::Merge(const SyncStatsType &stats) {
+    int i;
+
+    for (i = 0; i < SYNCSTATS_NUM_PHASES; i++) {
+	phaseNanos[i] += stats.phaseNanos[i];
+	phaseCalls[i] += stats.phaseCalls[i];
+    }
+    for (i = 0; i < SYNCSTATS_NUM_COUNTERS; i++)
+	counters[i] += stats.counters[i];
+}
+
+/**
+ * Obtain the current time of the monotonic clock.
+ *
+ * @return The current time of the monotonic clock, in nanoseconds.
+ */
+uint64_t SyncStatsType::Now(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000000000ULL) + (uint64_t)now.tv_nsec;
+}
+
+/**
+ * Add the time spent in a phase.
+ *
+ * Add the time elapsed since the given start time to the given phase and
+ * count one more call of it.
+ * @param phase The phase, one of the SYNCSTATS_PHASE_ defines.
+ * @param startTime The time the phase was entered, as returned by Now().
+ */
+void SyncStatsType::AddTime(int phase, uint64_t startTime) {
+    phaseNanos[phase] += Now() - startTime;
+    phaseCalls[phase]++;
+}
+
+/**
+ * Add to a counter.
+ *
+ * @param counter The counter, one of the SYNCSTATS_ counter defines.
+ * @param amount The amount to add to the counter.
+ */
+void SyncStatsType::AddCount(int counter, uint64_t amount) {
+    counters[counter] += amount;
+}
+
+/**
+ * Get the time spent in a phase.
+ *
+ * @param phase The phase, one of the SYNCSTATS_PHASE_ defines.
+ * @return The time spent in the phase, in nanoseconds.
+ */
+uint64_t SyncStatsType::GetPhaseNanos(int phase) const {
+    return phaseNanos[phase];
+}
+
+/**
+ * Get the number of calls of a phase.
+ *
+ * @param phase The phase, one of the SYNCSTATS_PHASE_ defines.
+ * @return The number of times the phase was entered.
+ */
+uint64_t SyncStatsType::GetPhaseCalls(int phase) const {
+    return phaseCalls[phase];
+}
+
+/**
+ * Get the value of a counter.
+ *
+ * @param counter The counter, one of the SYNCSTATS_ counter defines.
+ * @return The value of the counter.
+ */
+uint64_t SyncStatsType::GetCount(int counter) const {
+    return counters[counter];
+}
+
+/**
+ * Save the statistics report.
+ *
+ * Save the statistics of the session as a single JSON object, replacing
+ * the report of the previous session. The report is written next to the
+ * report path first and then renamed over it, so a reader never sees a
+ * partial report.
+ * @param statsPath The path of the report file.
+ * @return An integer representing success (zero) or failure (non-zero).
+ * @retval 0 Success.
+ * @retval 1 Failed to open the report file for output.
+ * @retval 2 Failed to write the report file.
+ */
+int SyncStatsType::Save(const std::string &statsPath) const {
+    std::string tmpPath;
+    FILE *pFile;
+    int i;
+
+    tmpPath = statsPath;
+    tmpPath.append(".tmp");
+
+    pFile = fopen(tmpPath.c_str(), "w");
+    if (!pFile)
+	return 1;
+
+    fprintf(pFile, "{\n  \"version\": 1,\n  \"session_start\": %ld,\n",
+	    (long)sessionStart);
+
+    fprintf(pFile, "  \"phases\": {\n");
+    for (i = 0; i < SYNCSTATS_NUM_PHASES; i++) {
+	fprintf(pFile,
+		"    \"%s\": { \"calls\": %llu, \"nanoseconds\": %llu }%s\n",
+		phaseNames[i], (unsigned long long)phaseCalls[i],
+		(unsigned long long)phaseNanos[i],
+		(i < (SYNCSTATS_NUM_PHASES - 1)) ? "," : "");
+    }
+    fprintf(pFile, "  },\n");
+
+    fprintf(pFile, "  \"counters\": {\n");
+    for (i = 0; i < SYNCSTATS_NUM_COUNTERS; i++) {
+	fprintf(pFile, "    \"%s\": %llu%s\n", counterNames[i],
+		(unsigned long long)counters[i],
+		(i < (SYNCSTATS_NUM_COUNTERS - 1)) ? "," : "");
+    }
+    fprintf(pFile, "  }\n}\n");
+
+    if (ferror(pFile)) {
+	fclose(pFile);
+	unlink(tmpPath.c_str());
+	return 2;
+    }
+
+    if (fclose(pFile) != 0) {
+	unlink(tmpPath.c_str());
+	return 2;
+    }
+
+    if (rename(tmpPath.c_str(), statsPath.c_str()) != 0) {
+	unlink(tmpPath.c_str());
+	return 2;
+    }
+
+    return 0;
+}
+
+/**
+ * Construct a SyncStatsTimerType object.
+ *
+ * Construct a SyncStatsTimerType object, which starts timing the given
+ * phase.
+ * @param stats The statistics the time is added to.
+ * @param phase The phase, one of the SYNCSTATS_PHASE_ defines.
+ */
+SyncStatsTimerType::SyncStatsTimerType(SyncStatsType &stats, int phase)
+    : timerStats(stats) {
+    timerPhase = phase;
+    startTime = SyncStatsType::Now();
+}
+
+/**
+ * Destruct the SyncStatsTimerType object.
+ *
+ * Destruct the SyncStatsTimerType object, adding the time elapsed since it
+ * was constructed to its phase.
+ */
+SyncStatsTimerType::~SyncStatsTimerType(void) {
+    timerStats.AddTime(timerPhase, startTime);
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright 2004, 2005 Andrew De Ponte
+ *
+ * This file is part of zsrep.
+ *
+ * zsrep is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * zsrep is distributed in the hopes that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with zsrep; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @file SyncStats.hh
+ * @brief A specifications file for the synchronization statistics.
+ * @author Andrew De Ponte
+ *
+ * A specifications file for the timers and counters kept over a
+ * synchronization session, and the report written from them.
+ */
+
+#ifndef SYNCSTATS_H
+#define SYNCSTATS_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include <string>
+
+// The public entry points of the plugin.
+#define SYNCSTATS_PHASE_INITIALIZE 0
+#define SYNCSTATS_PHASE_CLEAN_UP 1
+#define SYNCSTATS_PHASE_GET_ALL_ITEMS 2
+#define SYNCSTATS_PHASE_GET_NEW_ITEMS 3
+#define SYNCSTATS_PHASE_GET_MOD_ITEMS 4
+#define SYNCSTATS_PHASE_GET_DEL_ITEM_IDS 5
+#define SYNCSTATS_PHASE_ADD_ITEMS 6
+#define SYNCSTATS_PHASE_MOD_ITEMS 7
+#define SYNCSTATS_PHASE_DEL_ITEMS 8
+#define SYNCSTATS_PHASE_MAP_ITEM_IDS 9
+// The internal phases, which are timed within the entry points above.
+#define SYNCSTATS_PHASE_CALENDAR_LOAD 10
+#define SYNCSTATS_PHASE_CALENDAR_SAVE 11
+#define SYNCSTATS_PHASE_CLASSIFY 12
+#define SYNCSTATS_PHASE_CONV_KCAL_TODO 13
+#define SYNCSTATS_PHASE_CONV_TODO_ITEM 14
+#define SYNCSTATS_PHASE_SYNCID_LOG_LOAD 15
+#define SYNCSTATS_PHASE_SYNCID_LOG_SAVE 16
+#define SYNCSTATS_PHASE_CONV_CACHE_LOAD 17
+#define SYNCSTATS_PHASE_CONV_CACHE_SAVE 18
+#define SYNCSTATS_PHASE_IDMAP_LOAD 19
+#define SYNCSTATS_PHASE_IDMAP_SAVE 20
+#define SYNCSTATS_PHASE_CALENDAR_OPEN 21
+#define SYNCSTATS_PHASE_PREFETCH_WAIT 22
+#define SYNCSTATS_PHASE_CAL_CACHE_LOAD 23
+#define SYNCSTATS_PHASE_CAL_CACHE_SAVE 24
+#define SYNCSTATS_NUM_PHASES 25
+
+#define SYNCSTATS_ITEMS_SCANNED 0
+#define SYNCSTATS_ITEMS_CONVERTED 1
+#define SYNCSTATS_ITEMS_ADDED 2
+#define SYNCSTATS_ITEMS_MODIFIED 3
+#define SYNCSTATS_ITEMS_DELETED 4
+#define SYNCSTATS_ITEMS_MAPPED 5
+#define SYNCSTATS_BYTES_READ 6
+#define SYNCSTATS_BYTES_WRITTEN 7
+#define SYNCSTATS_CONV_CACHE_HITS 8
+#define SYNCSTATS_ITEMS_UNCHANGED 9
+#define SYNCSTATS_ARENA_ALLOCS 10
+#define SYNCSTATS_ARENA_CHUNKS 11
+#define SYNCSTATS_NUM_COUNTERS 12
+
+/**
+ * @class SyncStatsType
+ * @brief A type holding the statistics of a synchronization session.
+ *
+ * The SyncStatsType class accumulates the time spent in each phase of a
+ * synchronization session, measured with the monotonic clock, along with
+ * counts of the items and bytes handled. At the end of the session it is
+ * saved as a report that other tools can read.
+ */
+class SyncStatsType {
+public:
+    SyncStatsType(void);
+
+    void Reset(void);
+    void Merge(const SyncStatsType &stats);
+
+    static uint64_t Now(void);
+    void AddTime(int phase, uint64_t startTime);
+    void AddCount(int counter, uint64_t amount);
+
+    uint64_t GetPhaseNanos(int phase) const;
+    uint64_t GetPhaseCalls(int phase) const;
+    uint64_t GetCount(int counter) const;
+
+    int Save(const std::string &statsPath) const;
+private:
+    time_t sessionStart;
+    uint64_t phaseNanos[SYNCSTATS_NUM_PHASES];
+    uint64_t phaseCalls[SYNCSTATS_NUM_PHASES];
+    uint64_t counters[SYNCSTATS_NUM_COUNTERS];
+};
+
+/**
+ * @class SyncStatsTimerType
+ * @brief A type timing a phase for as long as it is in scope.
+ *
+ * The SyncStatsTimerType class starts timing the given phase when it is
+ * constructed and adds the elapsed time to the statistics when it is
+ * destructed, so every return path of a function is covered.
+ */
+class SyncStatsTimerType {
+public:
+    SyncStatsTimerType(SyncStatsType &stats, int phase);
+    ~SyncStatsTimerType(void);
+private:
+    SyncStatsType &timerStats;
+    int timerPhase;
+    uint64_t startTime;
+};
+
+#endif
@@ -0,0 +1,992 @@
+/*
+ * Copyright 2004, 2005 Andrew De Ponte
+ *
+ * This file is part of zsrep.
+ *
+ * zsrep is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * zsrep is distributed in the hopes that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with zsrep; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @file TimeConv.cc
+ * @brief An implementation file for the time conversion engine.
+ * @author Andrew De Ponte
+ *
+ * An implementation file for converting between local date times and
+ * seconds since the epoch with a transition table of the local time zone,
+ * instead of going through libc for each conversion.
+ */
+
+#include "TimeConv.hh"
+
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SECS_PER_DAY 86400
+#define TIMECONV_MIN_SECS (-0x7fffffffffffffffLL - 1)
+#define TIMECONV_MAX_SECS 0x7fffffffffffffffLL
+
+// The rule at the end of a zone file is expanded into transitions up to the
+// start of this year, past the last time a QDateTime converts to.
+#define TIMECONV_END_YEAR 2107
+
+// The number of instants, spread evenly over the times a QDateTime converts
+// to, that are checked against libc once the zone file is loaded.
+#define TIMECONV_NUM_CHECKS 1024
+
+// The largest zone file read.
+#define TIMECONV_MAX_FILE_SIZE (1024 * 1024)
+
+static int64_t FloorDiv(int64_t num, int64_t den) {
+    int64_t quot = num / den;
+
+    if (((num % den) != 0) && ((num < 0) != (den < 0)))
+	quot--;
+    return quot;
+}
+
+static bool IsLeapYear(int year) {
+    return (((year % 4) == 0) && ((year % 100) != 0)) || ((year % 400) == 0);
+}
+
+// The number of days from 1970-01-01 to the given date of the proleptic
+// Gregorian calendar, as mktime() counts them.
+static int64_t DaysFromCivil(int year, int month, int day) {
+    int64_t y = (int64_t)year - ((month <= 2) ? 1 : 0);
+    int64_t era = FloorDiv(y, 400);
+    int64_t yoe = y - (era * 400);
+    int64_t doy = (((153 * (month + ((month > 2) ? -3 : 9))) + 2) / 5) +
+	day - 1;
+    int64_t doe = (yoe * 365) + (yoe / 4) - (yoe / 100) + doy;
+
+    return (era * 146097) + doe - 719468;
+}
+
+static void CivilFromDays(int64_t days, int &year, int &month, int &day) {
+    int64_t z = days + 719468;
+    int64_t era = FloorDiv(z, 146097);
+    int64_t doe = z - (era * 146097);
+    int64_t yoe = (doe - (doe / 1460) + (doe / 36524) - (doe / 146096)) / 365;
+    int64_t doy = doe - ((365 * yoe) + (yoe / 4) - (yoe / 100));
+    int64_t mp = ((5 * doy) + 2) / 153;
+
+    day = (int)(doy - (((153 * mp) + 2) / 5) + 1);
+    month = (int)((mp < 10) ? (mp + 3) : (mp - 9));
+    year = (int)(yoe + (era * 400) + ((month <= 2) ? 1 : 0));
+}
+
+static uint32_t GetBE32(const unsigned char *pData) {
+    return ((uint32_t)pData[0] << 24) | ((uint32_t)pData[1] << 16) |
+	((uint32_t)pData[2] << 8) | (uint32_t)pData[3];
+}
+
+static int64_t GetBE64(const unsigned char *pData) {
+    return (int64_t)(((uint64_t)GetBE32(pData) << 32) | GetBE32(pData + 4));
+}
+
+// Whether the given number of seconds since the epoch fits in a time_t.
+static bool FitsTime_t(int64_t secs) {
+    return ((int64_t)(time_t)secs == secs);
+}
+
+// Turn seconds since the epoch into what QDateTime::toTime_t() returns for
+// them, which passes them through an int and clamps negative times to -1.
+static uint QtTime_t(int64_t secs) {
+    int qtSecs = (int)secs;
+
+    if (qtSecs < -1)
+	qtSecs = -1;
+    return (uint)qtSecs;
+}
+
+// Count the sorted values that are less than or equal to the given one. The
+// search halves the range without branching on the comparisons, so it runs
+// the same steps whatever the value.
+static size_t CountNotAfter(const int64_t *pValues, size_t numValues,
+			    int64_t value) {
+    const int64_t *pBase = pValues;
+    size_t num = numValues;
+    size_t half;
+
+    if (num == 0)
+	return 0;
+
+    while (num > 1) {
+	half = num / 2;
+	pBase = (pBase[half] <= value) ? (pBase + half) : pBase;
+	num -= half;
+    }
+
+    return (size_t)(pBase - pValues) + ((*pBase <= value) ? 1 : 0);
+}
+
+/**
+ * Construct a default TimeConvType object.
+ *
+ * Construct a TimeConvType object without a transition table. Until Load()
+ * succeeds every conversion is handed to Qt.
+ */
+TimeConvType::TimeConvType(void) {
+    loadedFlag = false;
+    ruleEnd = TIMECONV_MAX_SECS;
+}
+
+/**
+ * Load the transition table.
+ *
+ * Load the transition table of the local time zone from the zone file libc
+ * uses for it: the one named by the TZ environment variable, or else
+ * /etc/localtime. The table is then checked against libc over the range of
+ * times a QDateTime converts to, so it is only used when it gives the same
+ * results.
+ * @return An integer representing success (zero) or failure (non-zero).
+ * @retval 0 Success.
+ * @retval 1 Failed to open the zone file, as when TZ holds a rule rather
+ * than naming a zone.
+ * @retval 2 The zone file is malformed or uses leap seconds.
+ * @retval 3 The transition table doesn't give the same results as libc.
+ */
+int TimeConvType::Load(void) {
+    const char *pTZ;
+    const char *pTZDir;
+    int retval;
+
+    loadedFlag = false;
+    transTimes.clear();
+    transOffsets.clear();
+    segStarts.clear();
+    segEnds.clear();
+    segOffsets.clear();
+    ruleEnd = TIMECONV_MAX_SECS;
+
+    // Find the zone file the same way libc does.
+    pTZ = getenv("TZ");
+    if (!pTZ) {
+	zonePath = "/etc/localtime";
+    } else {
+	if (*pTZ == ':')
+	    pTZ++;
+	if (*pTZ == '\0')
+	    return 1;
+	if (*pTZ == '/') {
+	    zonePath = pTZ;
+	} else {
+	    pTZDir = getenv("TZDIR");
+	    zonePath = (pTZDir && (*pTZDir != '\0')) ?
+		pTZDir : "/usr/share/zoneinfo";
+	    zonePath.append("/");
+	    zonePath.append(pTZ);
+	}
+    }
+    tzset();
+
+    retval = ReadZoneFile(zonePath);
+    if (retval != 0) {
+	transTimes.clear();
+	transOffsets.clear();
+	return retval;
+    }
+
+    BuildSegments();
+
+    if (!SelfCheck()) {
+	transTimes.clear();
+	transOffsets.clear();
+	segStarts.clear();
+	segEnds.clear();
+	segOffsets.clear();
+	return 3;
+    }
+
+    loadedFlag = true;
+    return 0;
+}
+
+/**
+ * Check whether the transition table is loaded.
+ *
+ * @return A boolean representing whether conversions use the transition
+ * table (true) or are handed to Qt (false).
+ */
+bool TimeConvType::IsLoaded(void) const {
+    return loadedFlag;
+}
+
+/**
+ * Get the zone file path.
+ *
+ * @return The path of the zone file the transition table was loaded from,
+ * or was last attempted to be.
+ */
+const std::string &TimeConvType::GetZonePath(void) const {
+    return zonePath;
+}
+
+/**
+ * Get the number of transitions.
+ *
+ * @return The number of transitions in the table, including those expanded
+ * from the rule at the end of the zone file.
+ */
+size_t TimeConvType::GetNumTransitions(void) const {
+    return transTimes.size();
+}
+
+/**
+ * Convert a local date time to seconds since the epoch.
+ *
+ * @param dateTime The local date time to convert.
+ * @return The same value as dateTime.toTime_t().
+ */
+uint TimeConvType::ToTime_t(const QDateTime &dateTime) const {
+    int64_t localSecs;
+    int64_t utcSecs;
+    bool foundFlag;
+
+    if (!loadedFlag || !dateTime.isValid())
+	return dateTime.toTime_t();
+
+    localSecs = LocalSecs(dateTime);
+    utcSecs = LocalToUTC(localSecs, foundFlag);
+    if (!foundFlag)
+	return LibcToTime_t(localSecs);
+    return QtTime_t(utcSecs);
+}
+
+/**
+ * Convert local date times to seconds since the epoch.
+ *
+ * Convert an array of local date times, as ToTime_t() converts one. The
+ * broken down times are all turned into local seconds first, and then all
+ * looked up in the transition table.
+ * @param pDateTimes Pointer to the local date times to convert.
+ * @param pTimes Pointer to where the converted times are stored.
+ * @param numTimes The number of date times to convert.
+ */
+void TimeConvType::ToTime_t(const QDateTime *pDateTimes, uint *pTimes,
+			    size_t numTimes) const {
+    std::vector<int64_t> localSecs;
+    int64_t utcSecs;
+    bool foundFlag;
+    size_t i;
+
+    if (!loadedFlag) {
+	for (i = 0; i < numTimes; i++)
+	    pTimes[i] = pDateTimes[i].toTime_t();
+	return;
+    }
+
+    localSecs.resize(numTimes);
+    for (i = 0; i < numTimes; i++)
+	localSecs[i] = LocalSecs(pDateTimes[i]);
+
+    for (i = 0; i < numTimes; i++) {
+	utcSecs = LocalToUTC(localSecs[i], foundFlag);
+	if (foundFlag && pDateTimes[i].isValid())
+	    pTimes[i] = QtTime_t(utcSecs);
+	else if (pDateTimes[i].isValid())
+	    pTimes[i] = LibcToTime_t(localSecs[i]);
+	else
+	    pTimes[i] = pDateTimes[i].toTime_t();
+    }
+}
+
+/**
+ * Convert seconds since the epoch to a local date time.
+ *
+ * @param secs The seconds since the epoch to convert.
+ * @return The same date time as QDateTime::setTime_t() sets for secs.
+ */
+QDateTime TimeConvType::FromTime_t(uint secs) const {
+    QDateTime dateTime;
+
+    if (!loadedFlag) {
+	dateTime.setTime_t(secs);
+	return dateTime;
+    }
+
+    return LocalDateTime(UTCToLocal((int64_t)(time_t)secs));
+}
+
+/**
+ * Convert local seconds to seconds since the epoch.
+ *
+ * Look up the UTC offset of the given local time in the transition table.
+ * @param localSecs The local time, as seconds since the epoch of the local
+ * wall clock.
+ * @param foundFlag Set to whether the local time maps to a single offset
+ * (true), or is around a transition or out of the range of time_t (false).
+ * @return The seconds since the epoch, when foundFlag is set.
+ */
+int64_t TimeConvType::LocalToUTC(int64_t localSecs, bool &foundFlag) const {
+    size_t seg;
+    int64_t utcSecs;
+
+    foundFlag = false;
+    seg = CountNotAfter(segStarts.empty() ? NULL : &segStarts[0],
+			segStarts.size(), localSecs);
+    if ((seg == 0) || (localSecs >= segEnds[seg - 1]))
+	return 0;
+
+    utcSecs = localSecs - segOffsets[seg - 1];
+    foundFlag = FitsTime_t(utcSecs);
+    return utcSecs;
+}
+
+/**
+ * Convert seconds since the epoch to local seconds.
+ *
+ * @param utcSecs The seconds since the epoch.
+ * @return The local time, as seconds since the epoch of the local wall
+ * clock.
+ */
+int64_t TimeConvType::UTCToLocal(int64_t utcSecs) const {
+    size_t idx;
+
+    if (!loadedFlag || (utcSecs >= ruleEnd))
+	return LibcToLocal(utcSecs);
+
+    idx = CountNotAfter(transTimes.empty() ? NULL : &transTimes[0],
+			transTimes.size(), utcSecs);
+    return utcSecs + transOffsets[idx];
+}
+
+/**
+ * Get the local seconds of a date time.
+ *
+ * @param dateTime The local date time.
+ * @return The local time, as seconds since the epoch of the local wall
+ * clock.
+ */
+int64_t TimeConvType::LocalSecs(const QDateTime &dateTime) {
+    QDate date = dateTime.date();
+    QTime time = dateTime.time();
+
+    return LocalSecs(date.year(), date.month(), date.day(), time.hour(),
+		     time.minute(), time.second());
+}
+
+/**
+ * Get the date time of local seconds.
+ *
+ * @param localSecs The local time, as seconds since the epoch of the local
+ * wall clock.
+ * @return The local date time.
+ */
+QDateTime TimeConvType::LocalDateTime(int64_t localSecs) {
+    int64_t days = FloorDiv(localSecs, SECS_PER_DAY);
+    int secs = (int)(localSecs - (days * SECS_PER_DAY));
+    int year, month, day;
+
+    CivilFromDays(days, year, month, day);
+    return QDateTime(QDate(year, month, day),
+		     QTime(secs / 3600, (secs / 60) % 60, secs % 60));
+}
+
+/**
+ * Get the local seconds of a broken down time.
+ *
+ * @return The local time, as seconds since the epoch of the local wall
+ * clock.
+ */
+int64_t TimeConvType::LocalSecs(int year, int month, int day, int hour,
+				int minute, int second) {
+    return (DaysFromCivil(year, month, day) * SECS_PER_DAY) +
+	(hour * 3600) + (minute * 60) + second;
+}
+
+/**
+ * Convert local seconds to seconds since the epoch through libc.
+ *
+ * Convert the given local time with mktime(), exactly as
+ * QDateTime::toTime_t() does.
+ * @param localSecs The local time, as seconds since the epoch of the local
+ * wall clock.
+ * @return The same value as QDateTime::toTime_t() for the local time.
+ */
+uint TimeConvType::LibcToTime_t(int64_t localSecs) {
+    int64_t days = FloorDiv(localSecs, SECS_PER_DAY);
+    int secs = (int)(localSecs - (days * SECS_PER_DAY));
+    struct tm brokenDown;
+    int year, month, day;
+
+    CivilFromDays(days, year, month, day);
+
+    memset(&brokenDown, 0, sizeof(brokenDown));
+    brokenDown.tm_sec = secs % 60;
+    brokenDown.tm_min = (secs / 60) % 60;
+    brokenDown.tm_hour = secs / 3600;
+    brokenDown.tm_mday = day;
+    brokenDown.tm_mon = month - 1;
+    brokenDown.tm_year = year - 1900;
+    brokenDown.tm_isdst = -1;
+
+    return QtTime_t((int64_t)mktime(&brokenDown));
+}
+
+/**
+ * Convert seconds since the epoch to local seconds through libc.
+ *
+ * Convert the given time with localtime_r(), falling back to UTC as
+ * QDateTime::setTime_t() does.
+ * @param utcSecs The seconds since the epoch.
+ * @return The local time, as seconds since the epoch of the local wall
+ * clock.
+ */
+int64_t TimeConvType::LibcToLocal(int64_t utcSecs) {
+    time_t secs = (time_t)utcSecs;
+    struct tm brokenDown;
+
+    if (!localtime_r(&secs, &brokenDown) && !gmtime_r(&secs, &brokenDown))
+	return 0;
+
+    return LocalSecs(brokenDown.tm_year + 1900, brokenDown.tm_mon + 1,
+		     brokenDown.tm_mday, brokenDown.tm_hour, brokenDown.tm_min,
+		     brokenDown.tm_sec);
+}
+
+/**
+ * Read a zone file.
+ *
+ * Read the transitions of a TZif zone file into the transition table. The
+ * 64 bit data of version 2 and later files is used, along with the rule at
+ * their end for the times after the last transition.
+ * @param zonePath The path of the zone file.
+ * @return An integer representing success (zero) or failure (non-zero).
+ * @retval 0 Success.
+ * @retval 1 Failed to open the zone file.
+ * @retval 2 The zone file is malformed or uses leap seconds.
+ */
+int TimeConvType::ReadZoneFile(const std::string &zonePath) {
+    std::vector<unsigned char> content;
+    std::vector<int32_t> typeOffsets;
+    std::vector<bool> typeDST;
+    const unsigned char *pData;
+    const unsigned char *pEnd;
+    const unsigned char *pFooter;
+    std::string tzString;
+    uint32_t isUTCCnt, isStdCnt, leapCnt, timeCnt, typeCnt, charCnt;
+    size_t timeSize, leapSize, dataSize;
+    size_t readSize;
+    size_t initType;
+    size_t i;
+    FILE *pFile;
+
+    pFile = fopen(zonePath.c_str(), "rb");
+    if (!pFile)
+	return 1;
+    content.resize(TIMECONV_MAX_FILE_SIZE);
+    readSize = fread(&content[0], 1, content.size(), pFile);
+    fclose(pFile);
+    content.resize(readSize);
+
+    pData = content.empty() ? NULL : &content[0];
+    pEnd = pData + content.size();
+    timeSize = 4;
+    leapSize = 8;
+
+    for (;;) {
+	if (((size_t)(pEnd - pData) < 44) || (memcmp(pData, "TZif", 4) != 0))
+	    return 2;
+
+	isUTCCnt = GetBE32(pData + 20);
+	isStdCnt = GetBE32(pData + 24);
+	leapCnt = GetBE32(pData + 28);
+	timeCnt = GetBE32(pData + 32);
+	typeCnt = GetBE32(pData + 36);
+	charCnt = GetBE32(pData + 40);
+	if ((timeCnt > TIMECONV_MAX_FILE_SIZE) ||
+	    (typeCnt > TIMECONV_MAX_FILE_SIZE) ||
+	    (charCnt > TIMECONV_MAX_FILE_SIZE) ||
+	    (leapCnt > TIMECONV_MAX_FILE_SIZE) ||
+	    (isStdCnt > TIMECONV_MAX_FILE_SIZE) ||
+	    (isUTCCnt > TIMECONV_MAX_FILE_SIZE))
+	    return 2;
+
+	dataSize = (timeCnt * timeSize) + timeCnt + (typeCnt * 6) + charCnt +
+	    (leapCnt * leapSize) + isStdCnt + isUTCCnt;
+	if ((size_t)(pEnd - pData - 44) < dataSize)
+	    return 2;
+
+	// Version 2 and later files repeat the data with 64 bit times after
+	// the 32 bit data, and that is what is used.
+	if ((timeSize == 4) && (pData[4] >= '2')) {
+	    pData += 44 + dataSize;
+	    timeSize = 8;
+	    leapSize = 12;
+	    continue;
+	}
+	break;
+    }
+
+    // Leap seconds change what the seconds since the epoch mean, libc has to
+    // handle those zones.
+    if ((leapCnt != 0) || (typeCnt == 0))
+	return 2;
+
+    pFooter = pData + 44 + dataSize;
+    pData += 44;
+
+    typeOffsets.resize(typeCnt);
+    typeDST.resize(typeCnt);
+    for (i = 0; i < typeCnt; i++) {
+	const unsigned char *pType = pData + (timeCnt * timeSize) + timeCnt +
+	    (i * 6);
+
+	typeOffsets[i] = (int32_t)GetBE32(pType);
+	typeDST[i] = (pType[4] != 0);
+    }
+
+    // Like libc, times before the first transition take the first type
+    // that isn't daylight saving time.
+    initType = 0;
+    while ((initType < typeCnt) && typeDST[initType])
+	initType++;
+    if (initType == typeCnt)
+	initType = 0;
+
+    transTimes.resize(timeCnt);
+    transOffsets.resize(timeCnt + 1);
+    transOffsets[0] = typeOffsets[initType];
+    for (i = 0; i < timeCnt; i++) {
+	if (timeSize == 8)
+	    transTimes[i] = GetBE64(pData + (i * 8));
+	else
+	    transTimes[i] = (int32_t)GetBE32(pData + (i * 4));
+	if ((i > 0) && (transTimes[i] <= transTimes[i - 1]))
+	    return 2;
+	if (pData[(timeCnt * timeSize) + i] >= typeCnt)
+	    return 2;
+	transOffsets[i + 1] = typeOffsets[pData[(timeCnt * timeSize) + i]];
+    }
+
+    // The rule at the end of the file applies after the last transition.
+    // Without transitions libc doesn't use it, and neither is it here.
+    if ((timeSize == 8) && (timeCnt > 0) && (pFooter < pEnd) &&
+	(*pFooter == '\n')) {
+	for (pData = pFooter + 1; (pData < pEnd) && (*pData != '\n'); pData++)
+	    ;
+	if (pData == pEnd)
+	    return 2;
+	tzString.assign((const char *)(pFooter + 1),
+			(size_t)(pData - pFooter - 1));
+	if (!tzString.empty() && !ExpandRule(tzString))
+	    return 2;
+    }
+
+    return 0;
+}
+
+/**
+ * Expand the rule of a zone file.
+ *
+ * Expand the POSIX TZ rule at the end of a zone file into transitions
+ * following the last one of the file, up to TIMECONV_END_YEAR.
+ * @param tzString The rule, such as "CET-1CEST,M3.5.0,M10.5.0/3".
+ * @return A boolean representing success (true) or failure (false) to
+ * parse the rule.
+ */
+bool TimeConvType::ExpandRule(const std::string &tzString) {
+    const char *pStr = tzString.c_str();
+    int32_t stdOffset;
+    int32_t dstOffset;
+    RuleType startRule;
+    RuleType endRule;
+    int64_t lastTime;
+    int64_t changeTimes[2];
+    int32_t changeOffsets[2];
+    int64_t tmpTime;
+    int32_t tmpOffset;
+    bool firstFlag;
+    int year, month, day;
+    int i;
+
+    // POSIX offsets count hours west of Greenwich, the table counts seconds
+    // east of it.
+    if (!ParseName(pStr) || !ParseOffset(pStr, stdOffset))
+	return false;
+    stdOffset = -stdOffset;
+
+    if (*pStr == '\0') {
+	transOffsets.back() = stdOffset;
+	return true;
+    }
+
+    if (!ParseName(pStr))
+	return false;
+    dstOffset = stdOffset + 3600;
+    if ((*pStr != ',') && (*pStr != '\0')) {
+	if (!ParseOffset(pStr, dstOffset))
+	    return false;
+	dstOffset = -dstOffset;
+    }
+
+    if (*pStr == '\0') {
+	// The rule libc uses when none is given.
+	startRule.kind = 'M';
+	startRule.month = 3;
+	startRule.week = 2;
+	startRule.day = 0;
+	startRule.time = 7200;
+	endRule.kind = 'M';
+	endRule.month = 11;
+	endRule.week = 1;
+	endRule.day = 0;
+	endRule.time = 7200;
+    } else {
+	if (*(pStr++) != ',')
+	    return false;
+	if (!ParseRule(pStr, startRule) || (*(pStr++) != ','))
+	    return false;
+	if (!ParseRule(pStr, endRule) || (*pStr != '\0'))
+	    return false;
+    }
+
+    lastTime = transTimes.back();
+    CivilFromDays(FloorDiv(lastTime, SECS_PER_DAY), year, month, day);
+    firstFlag = true;
+    for (; year < TIMECONV_END_YEAR; year++) {
+	changeTimes[0] = RuleTime(startRule, year) - stdOffset;
+	changeOffsets[0] = dstOffset;
+	changeTimes[1] = RuleTime(endRule, year) - dstOffset;
+	changeOffsets[1] = stdOffset;
+	if (changeTimes[1] < changeTimes[0]) {
+	    tmpTime = changeTimes[0];
+	    changeTimes[0] = changeTimes[1];
+	    changeTimes[1] = tmpTime;
+	    tmpOffset = changeOffsets[0];
+	    changeOffsets[0] = changeOffsets[1];
+	    changeOffsets[1] = tmpOffset;
+	}
+
+	for (i = 0; i < 2; i++) {
+	    if (changeTimes[i] <= transTimes.back())
+		continue;
+
+	    // The rule decides the offset from the last transition of the
+	    // file on, not the file.
+	    if (firstFlag) {
+		transOffsets.back() = (changeOffsets[i] == dstOffset) ?
+		    stdOffset : dstOffset;
+		firstFlag = false;
+	    }
+	    transTimes.push_back(changeTimes[i]);
+	    transOffsets.push_back(changeOffsets[i]);
+	}
+    }
+
+    // The rules of the following year can move a change up to a week into
+    // the year before, so the table is only trusted up to a week before it.
+    ruleEnd = (DaysFromCivil(TIMECONV_END_YEAR, 1, 1) - 8) * SECS_PER_DAY;
+
+    return true;
+}
+
+/**
+ * Build the local time segments.
+ *
+ * Build the ranges of local time that map to a single UTC offset from the
+ * transition table. A transition that moves the clock back repeats the
+ * local times in between, one that moves it forward skips them; either way
+ * those local times are left out of the segments.
+ */
+void TimeConvType::BuildSegments(void) {
+    int64_t curTime = TIMECONV_MIN_SECS;
+    int64_t winStart;
+    int64_t winEnd;
+    int32_t before;
+    int32_t after;
+    int64_t endTime;
+    size_t i;
+
+    segStarts.clear();
+    segEnds.clear();
+    segOffsets.clear();
+    segStarts.reserve(transTimes.size() + 1);
+    segEnds.reserve(transTimes.size() + 1);
+    segOffsets.reserve(transTimes.size() + 1);
+
+    for (i = 0; i < transTimes.size(); i++) {
+	before = transOffsets[i];
+	after = transOffsets[i + 1];
+	winStart = transTimes[i] + ((before < after) ? before : after);
+	winEnd = transTimes[i] + ((before < after) ? after : before);
+
+	if (winStart > curTime) {
+	    segStarts.push_back(curTime);
+	    segEnds.push_back(winStart);
+	    segOffsets.push_back(before);
+	}
+	if (winEnd > curTime)
+	    curTime = winEnd;
+    }
+
+    endTime = (ruleEnd == TIMECONV_MAX_SECS) ? ruleEnd :
+	(ruleEnd - SECS_PER_DAY);
+    if (endTime > curTime) {
+	segStarts.push_back(curTime);
+	segEnds.push_back(endTime);
+	segOffsets.push_back(transOffsets.back());
+    }
+}
+
+/**
+ * Check the transition table against libc.
+ *
+ * Check that the transition table converts instants spread evenly over the
+ * times a QDateTime converts to, along with those either side of each
+ * transition and segment boundary, the same as libc does.
+ * @return A boolean representing whether all the instants matched (true)
+ * or not (false).
+ */
+bool TimeConvType::SelfCheck(void) const {
+    const int64_t rangeEnd = (int64_t)1 << 32;
+    const int64_t step = rangeEnd / TIMECONV_NUM_CHECKS;
+    int64_t secs;
+    int64_t delta;
+    size_t i;
+
+    for (i = 0; i < TIMECONV_NUM_CHECKS; i++) {
+	if (!CheckInstant((int64_t)i * step))
+	    return false;
+    }
+
+    for (i = 0; i < transTimes.size(); i++) {
+	for (delta = -1; delta <= 1; delta++) {
+	    secs = transTimes[i] + delta;
+	    if ((secs >= 0) && (secs < rangeEnd) && !CheckInstant(secs))
+		return false;
+	}
+    }
+
+    for (i = 0; i < segStarts.size(); i++) {
+	secs = segStarts[i];
+	if ((secs >= 0) && (secs < rangeEnd) &&
+	    (!CheckLocal(secs) || !CheckLocal(secs + 1)))
+	    return false;
+	secs = segEnds[i] - 1;
+	if ((secs >= 0) && (secs < rangeEnd) && !CheckLocal(secs))
+	    return false;
+    }
+
+    return true;
+}
+
+/**
+ * Check an instant against libc.
+ *
+ * @param utcSecs The seconds since the epoch to check.
+ * @return A boolean representing whether the transition table converts
+ * the instant to the same local time as libc, and back (true), or not
+ * (false).
+ */
+bool TimeConvType::CheckInstant(int64_t utcSecs) const {
+    int64_t localSecs;
+
+    if (!FitsTime_t(utcSecs))
+	return true;
+
+    localSecs = LibcToLocal(utcSecs);
+    if ((utcSecs < ruleEnd) &&
+	(localSecs != (utcSecs + transOffsets[CountNotAfter(&transTimes[0],
+	    transTimes.size(), utcSecs)])))
+	return false;
+
+    return CheckLocal(localSecs);
+}
+
+/**
+ * Check a local time against libc.
+ *
+ * @param localSecs The local time to check, as seconds since the epoch of
+ * the local wall clock.
+ * @return A boolean representing whether the transition table converts the
+ * local time the same as libc (true) or not (false).
+ */
+bool TimeConvType::CheckLocal(int64_t localSecs) const {
+    int64_t utcSecs;
+    bool foundFlag;
+
+    utcSecs = LocalToUTC(localSecs, foundFlag);
+    if (!foundFlag)
+	return true;
+    return (QtTime_t(utcSecs) == LibcToTime_t(localSecs));
+}
+
+/**
+ * Parse the name of a POSIX TZ rule.
+ *
+ * @param pStr Pointer to the name, advanced past it.
+ * @return A boolean representing success (true) or failure (false).
+ */
+bool TimeConvType::ParseName(const char *&pStr) {
+    const char *pStart;
+
+    if (*pStr == '<') {
+	pStart = ++pStr;
+	while ((*pStr != '\0') && (*pStr != '>'))
+	    pStr++;
+	if ((*pStr != '>') || (pStr == pStart))
+	    return false;
+	pStr++;
+	return true;
+    }
+
+    pStart = pStr;
+    while (((*pStr >= 'a') && (*pStr <= 'z')) ||
+	   ((*pStr >= 'A') && (*pStr <= 'Z')))
+	pStr++;
+    return ((pStr - pStart) >= 3);
+}
+
+/**
+ * Parse an offset or time of a POSIX TZ rule.
+ *
+ * Parse a value of the form [+-]hh[:mm[:ss]].
+ * @param pStr Pointer to the value, advanced past it.
+ * @param secs Set to the value in seconds.
+ * @return A boolean representing success (true) or failure (false).
+ */
+bool TimeConvType::ParseOffset(const char *&pStr, int32_t &secs) {
+    int32_t sign = 1;
+    int32_t parts[3] = { 0, 0, 0 };
+    int numDigits;
+    int part;
+
+    if ((*pStr == '+') || (*pStr == '-')) {
+	if (*pStr == '-')
+	    sign = -1;
+	pStr++;
+    }
+
+    for (part = 0; part < 3; part++) {
+	if (part > 0) {
+	    if (*pStr != ':')
+		break;
+	    pStr++;
+	}
+	for (numDigits = 0; (*pStr >= '0') && (*pStr <= '9'); numDigits++) {
+	    if (numDigits == 3)
+		return false;
+	    parts[part] = (parts[part] * 10) + (*(pStr++) - '0');
+	}
+	if (numDigits == 0)
+	    return false;
+    }
+
+    secs = sign * ((parts[0] * 3600) + (parts[1] * 60) + parts[2]);
+    return true;
+}
+
+/**
+ * Parse a date and time of a POSIX TZ rule.
+ *
+ * Parse a value of the form Jn, n or Mm.w.d, optionally followed by /time.
+ * @param pStr Pointer to the value, advanced past it.
+ * @param rule Set to the parsed date and time.
+ * @return A boolean representing success (true) or failure (false).
+ */
+bool TimeConvType::ParseRule(const char *&pStr, RuleType &rule) {
+    int *pFields[3];
+    int numFields;
+    int field;
+
+    rule.month = 0;
+    rule.week = 0;
+    rule.day = 0;
+    rule.time = 7200;
+
+    if (*pStr == 'J') {
+	rule.kind = 'J';
+	pStr++;
+    } else if (*pStr == 'M') {
+	rule.kind = 'M';
+	pStr++;
+    } else {
+	rule.kind = 'N';
+    }
+
+    pFields[0] = (rule.kind == 'M') ? &rule.month : &rule.day;
+    pFields[1] = &rule.week;
+    pFields[2] = &rule.day;
+    numFields = (rule.kind == 'M') ? 3 : 1;
+    for (field = 0; field < numFields; field++) {
+	if ((field > 0) && (*(pStr++) != '.'))
+	    return false;
+	if ((*pStr < '0') || (*pStr > '9'))
+	    return false;
+	while ((*pStr >= '0') && (*pStr <= '9')) {
+	    *pFields[field] = (*pFields[field] * 10) + (*(pStr++) - '0');
+	    if (*pFields[field] > 366)
+		return false;
+	}
+    }
+
+    if ((rule.kind == 'M') &&
+	((rule.month < 1) || (rule.month > 12) || (rule.week < 1) ||
+	 (rule.week > 5) || (rule.day > 6)))
+	return false;
+    if ((rule.kind == 'J') && ((rule.day < 1) || (rule.day > 365)))
+	return false;
+    if ((rule.kind == 'N') && (rule.day > 365))
+	return false;
+
+    if (*pStr == '/') {
+	pStr++;
+	if (!ParseOffset(pStr, rule.time))
+	    return false;
+    }
+
+    return true;
+}
+
+/**
+ * Get the local time a POSIX TZ rule date falls on.
+ *
+ * @param rule The date and time of the rule.
+ * @param year The year to apply the rule to.
+ * @return The local time, as seconds since the epoch of the local wall
+ * clock.
+ */
+int64_t TimeConvType::RuleTime(const RuleType &rule, int year) {
+    int64_t days;
+    int64_t firstDay;
+    int64_t monthLen;
+    int weekDay;
+
+    if (rule.kind == 'J') {
+	// Julian days never count February 29th.
+	days = DaysFromCivil(year, 1, 1) + rule.day - 1;
+	if (IsLeapYear(year) && (rule.day >= 60))
+	    days++;
+    } else if (rule.kind == 'N') {
+	days = DaysFromCivil(year, 1, 1) + rule.day;
+    } else {
+	// Day d of week w of month m, with week 5 being the last one.
+	firstDay = DaysFromCivil(year, rule.month, 1);
+	if (rule.month == 12)
+	    monthLen = DaysFromCivil(year + 1, 1, 1) - firstDay;
+	else
+	    monthLen = DaysFromCivil(year, rule.month + 1, 1) - firstDay;
+	weekDay = (int)(((firstDay % 7) + 11) % 7);
+	days = firstDay + ((rule.day - weekDay + 7) % 7) +
+	    (7 * (rule.week - 1));
+	while ((days - firstDay) >= monthLen)
+	    days -= 7;
+    }
+
+    return (days * SECS_PER_DAY) + rule.time;
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright 2004, 2005 Andrew De Ponte
+ *
+ * This file is part of zsrep.
+ *
+ * zsrep is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * zsrep is distributed in the hopes that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with zsrep; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @file TimeConv.hh
+ * @brief A specifications file for the time conversion engine.
+ * @author Andrew De Ponte
+ *
+ * A specifications file for converting between local date times and
+ * seconds since the epoch with a transition table of the local time zone,
+ * instead of going through libc for each conversion.
+ */
+
+#ifndef TIMECONV_H
+#define TIMECONV_H
+
+#include <qdatetime.h>
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+/**
+ * @class TimeConvType
+ * @brief A type converting times with a time zone transition table.
+ *
+ * The TimeConvType class converts between QDateTime objects holding a local
+ * time and seconds since the epoch, giving exactly the results of
+ * QDateTime::toTime_t() and QDateTime::setTime_t(). Those go through
+ * mktime() and localtime(), so the transition table is read from the zone
+ * file libc uses for the local time zone. Local times falling in the
+ * repeated or skipped hour around a transition, where mktime() has to
+ * choose, are still handed to libc. Until Load() succeeds every conversion
+ * is handed to Qt.
+ *
+ * Once loaded the object is only read from, so it may be used from several
+ * threads at once.
+ */
+class TimeConvType {
+public:
+    TimeConvType(void);
+
+    int Load(void);
+    bool IsLoaded(void) const;
+    const std::string &GetZonePath(void) const;
+    size_t GetNumTransitions(void) const;
+
+    uint ToTime_t(const QDateTime &dateTime) const;
+    void ToTime_t(const QDateTime *pDateTimes, uint *pTimes,
+		  size_t numTimes) const;
+    QDateTime FromTime_t(uint secs) const;
+
+    int64_t LocalToUTC(int64_t localSecs, bool &foundFlag) const;
+    int64_t UTCToLocal(int64_t utcSecs) const;
+
+    static int64_t LocalSecs(const QDateTime &dateTime);
+    static QDateTime LocalDateTime(int64_t localSecs);
+    static int64_t LocalSecs(int year, int month, int day, int hour,
+			     int minute, int second);
+    static uint LibcToTime_t(int64_t localSecs);
+    static int64_t LibcToLocal(int64_t utcSecs);
+private:
+    struct RuleType {
+	char kind;
+	int month;
+	int week;
+	int day;
+	int32_t time;
+    };
+
+    int ReadZoneFile(const std::string &zonePath);
+    bool ExpandRule(const std::string &tzString);
+    void BuildSegments(void);
+    bool SelfCheck(void) const;
+    bool CheckInstant(int64_t utcSecs) const;
+    bool CheckLocal(int64_t localSecs) const;
+    static bool ParseName(const char *&pStr);
+    static bool ParseOffset(const char *&pStr, int32_t &secs);
+    static bool ParseRule(const char *&pStr, RuleType &rule);
+    static int64_t RuleTime(const RuleType &rule, int year);
+
+    std::string zonePath;
+    bool loadedFlag;
+
+    // The instants at which the UTC offset changes, and the offset in effect
+    // before the first (at index 0) and after each of them.
+    std::vector<int64_t> transTimes;
+    std::vector<int32_t> transOffsets;
+
+    // The first instant not covered by the transitions expanded from the
+    // rule at the end of the zone file, if there is one.
+    int64_t ruleEnd;
+
+    // The ranges of local time that map to a single UTC offset. Local times
+    // outside all of them are around a transition and handed to libc.
+    std::vector<int64_t> segStarts;
+    std::vector<int64_t> segEnds;
+    std::vector<int32_t> segOffsets;
+};
+
+#endif
@@ -0,0 +1,457 @@
+/*
+ * Copyright 2004, 2005 Andrew De Ponte
+ *
+ * This file is part of zsrep.
+ *
+ * zsrep is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * zsrep is distributed in the hopes that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with zsrep; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @file TodoConv.cc
+ * @brief An implementation file for the parallel todo item conversion.
+ * @author Andrew De Ponte
+ *
+ * An implementation file for converting KOrganizer todo items into
+ * TodoItemType objects on the threads of a WorkPoolType.
+ */
+
+#include "TodoConv.hh"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// The offset basis and prime of the 64 bit FNV-1a hash.
+#define FINGERPRINT_BASIS 0xcbf29ce484222325ULL
+#define FINGERPRINT_PRIME 0x100000001b3ULL
+
+/**
+ * Copy out the UTF-16 code units of a string.
+ *
+ * @param str The string to copy.
+ * @param arena The arena to place the copy in.
+ * @param pUnits Set to point at the copied code units.
+ * @param numUnits Set to the number of code units.
+ * @return A boolean representing success (true) or failure to allocate the
+ * copy from the arena (false).
+ */
+bool TodoConvUnits(const QString &str, ArenaType &arena,
+		   const unsigned short *&pUnits, size_t &numUnits) {
+    const QChar *pChars = str.unicode();
+    unsigned short *pCopy;
+    uint len = str.length();
+    uint i;
+
+    pCopy = (unsigned short *)arena.Alloc(len * sizeof(unsigned short));
+    if (!pCopy)
+	return false;
+    for (i = 0; i < len; i++)
+	pCopy[i] = pChars[i].unicode();
+
+    pUnits = pCopy;
+    numUnits = len;
+    return true;
+}
+
+/**
+ * Snapshot the fields of a todo item.
+ *
+ * Copy the fields of a KCal::Todo needed to convert it. This has to be done
+ * on the thread that owns the calendar.
+ * @param pKcalTodo Pointer to the KCal::Todo object to snapshot.
+ * @param lastModified The last modified time of the todo item, as already
+ * converted for the conversion cache lookup.
+ * @param categories The table the category of the todo item is interned in.
+ * @param arena The arena to place the strings in.
+ * @param fields The fields to fill in.
+ * @return A boolean representing success (true) or failure to allocate the
+ * strings from the arena (false).
+ */
+bool TodoConvSnapshot(KCal::Todo *pKcalTodo, time_t lastModified,
+		      CategoryTableType &categories, ArenaType &arena,
+		      TodoFieldsType &fields) {
+    QStringList kOrgCatList;
+
+    if (!TodoConvUnits(pKcalTodo->uid(), arena, fields.pUid,
+		       fields.uidSize) ||
+	!TodoConvUnits(pKcalTodo->summary(), arena, fields.pSummary,
+		       fields.summarySize) ||
+	!TodoConvUnits(pKcalTodo->description(), arena, fields.pDescription,
+		       fields.descriptionSize))
+	return false;
+
+    // Only the first of the KOrganizer categories is synchronized. It is
+    // taken from the category table already converted.
+    kOrgCatList = pKcalTodo->categories();
+    if (kOrgCatList.isEmpty())
+	fields.category = categories.GetUtf8(CATEGORYTABLE_NO_CATEGORY);
+    else
+	fields.category = categories.GetUtf8(
+	    categories.Intern(*kOrgCatList.begin()));
+
+    fields.created = pKcalTodo->created();
+    fields.lastModified = lastModified;
+    fields.hasStartDate = pKcalTodo->hasStartDate();
+    if (fields.hasStartDate)
+	fields.dtStart = pKcalTodo->dtStart();
+    fields.hasDueDate = pKcalTodo->hasDueDate();
+    if (fields.hasDueDate)
+	fields.dtDue = pKcalTodo->dtDue();
+    fields.hasCompletedDate = pKcalTodo->hasCompletedDate();
+    if (fields.hasCompletedDate)
+	fields.completed = pKcalTodo->completed();
+    fields.isCompleted = pKcalTodo->isCompleted();
+    fields.priority = pKcalTodo->priority();
+    fields.pilotId = pKcalTodo->pilotId();
+    return true;
+}
+
+/**
+ * Convert the fields of a todo item.
+ *
+ * Convert the snapshotted fields of a todo item into a TodoItemType, exactly
+ * as KOrgTodoPlugin::ConvKCalTodo() converts the KCal::Todo itself. This may
+ * be called from any thread.
+ * @param fields The fields of the todo item.
+ * @param todoItem The TodoItemType to fill in.
+ * @param timeConv The time zone transition table to convert the times with.
+ */
+void TodoConvFields(const TodoFieldsType &fields, TodoItemType &todoItem,
+		    const TimeConvType &timeConv) {
+    std::string utf8;
+
+    todoItem.SetAttribute((unsigned char)0);
+    todoItem.SetCreatedTime(timeConv.ToTime_t(fields.created));
+    todoItem.SetModifiedTime(fields.lastModified);
+    todoItem.SetSyncID((unsigned long int)fields.pilotId);
+
+    TodoConvUtf8(fields.pUid, fields.uidSize, utf8);
+    todoItem.SetAppID(utf8);
+    todoItem.SetCategory(fields.category);
+
+    if (fields.hasStartDate)
+	todoItem.SetStartDate(timeConv.ToTime_t(fields.dtStart));
+    else
+	todoItem.SetStartDate(0);
+
+    if (fields.hasDueDate)
+	todoItem.SetDueDate(timeConv.ToTime_t(fields.dtDue));
+    else
+	todoItem.SetDueDate(0);
+
+    if (fields.hasCompletedDate)
+	todoItem.SetCompletedDate(timeConv.ToTime_t(fields.completed));
+    else
+	todoItem.SetCompletedDate(0);
+
+    if (fields.isCompleted)
+	todoItem.SetProgressStatus(0);
+    else
+	todoItem.SetProgressStatus(1);
+
+    todoItem.SetPriority((unsigned char)fields.priority);
+
+    TodoConvUtf8(fields.pSummary, fields.summarySize, utf8);
+    todoItem.SetDescription(utf8);
+    TodoConvUtf8(fields.pDescription, fields.descriptionSize, utf8);
+    todoItem.SetNotes(utf8);
+}
+
+/**
+ * Encode UTF-16 as UTF-8 into a buffer.
+ *
+ * Encode a string of UTF-16 code units as UTF-8, producing the same bytes
+ * as QString::utf8() followed by the conversion to std::string, which stops
+ * at the first NUL character. Surrogate pairs become one four byte sequence
+ * and unpaired surrogates are encoded as they are, as Qt does. Where SSE2 is
+ * available, runs of ASCII are narrowed eight code units at a time.
+ * @param pUnits The UTF-16 code units to encode.
+ * @param numUnits The number of code units.
+ * @param pUtf8 The buffer to encode into, which has to hold three bytes for
+ * each code unit.
+ * @return The number of bytes of the UTF-8 encoding.
+ */
+size_t TodoConvUtf8(const unsigned short *pUnits, size_t numUnits,
+		    char *pUtf8) {
+    char *pOut = pUtf8;
+    size_t i = 0;
+    size_t blockEnd;
+    unsigned int u;
+    unsigned short low;
+#if defined(__SSE2__)
+    const __m128i nonAsciiBits = _mm_set1_epi16((short)0xff80);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i block, ascii;
+#endif
+
+    while (i < numUnits) {
+	blockEnd = numUnits;
+#if defined(__SSE2__)
+	// A block of eight code units that are all ASCII, and not NUL, is
+	// narrowed in one go. Any other block is encoded one code unit at a
+	// time below, before trying the next block.
+	if ((numUnits - i) >= 8) {
+	    block = _mm_loadu_si128((const __m128i *)(pUnits + i));
+	    ascii = _mm_cmpeq_epi16(_mm_and_si128(block, nonAsciiBits), zero);
+	    ascii = _mm_andnot_si128(_mm_cmpeq_epi16(block, zero), ascii);
+	    if (_mm_movemask_epi8(ascii) == 0xffff) {
+		_mm_storel_epi64((__m128i *)pOut,
+				 _mm_packus_epi16(block, block));
+		pOut += 8;
+		i += 8;
+		continue;
+	    }
+	    blockEnd = i + 8;
+	}
+#endif
+
+	for (; i < blockEnd; i++) {
+	    u = pUnits[i];
+	    if (u == 0)
+		return pOut - pUtf8;
+
+	    if (u < 0x80) {
+		*pOut++ = (char)u;
+		continue;
+	    }
+
+	    if (u < 0x0800) {
+		*pOut++ = (char)(0xc0 | (u >> 6));
+	    } else {
+		if ((u >= 0xd800) && (u < 0xdc00) && (i < (numUnits - 1))) {
+		    low = pUnits[i + 1];
+		    if ((low >= 0xdc00) && (low < 0xe000)) {
+			i++;
+			u = ((u - 0xd800) * 0x400) + (low - 0xdc00) +
+			    0x10000;
+		    }
+		}
+		if (u > 0xffff) {
+		    // Qt maps the bytes of invalid UTF-8 it decoded into
+		    // this range, and turns them back into those bytes.
+		    if ((u > 0x10fe00) && (u < 0x10ff00)) {
+			*pOut++ = (char)(u - 0x10fe00);
+			continue;
+		    }
+		    *pOut++ = (char)(0xf0 | (u >> 18));
+		    *pOut++ = (char)(0x80 | ((u >> 12) & 0x3f));
+		} else {
+		    *pOut++ = (char)(0xe0 | (u >> 12));
+		}
+		*pOut++ = (char)(0x80 | ((u >> 6) & 0x3f));
+	    }
+	    *pOut++ = (char)(0x80 | (u & 0x3f));
+	}
+    }
+
+    return pOut - pUtf8;
+}
+
+/**
+ * Encode UTF-16 as UTF-8.
+ *
+ * Encode a string of UTF-16 code units as UTF-8, the same way as encoding
+ * them into a buffer does.
+ * @param pUnits The UTF-16 code units to encode.
+ * @param numUnits The number of code units.
+ * @param utf8 Set to the UTF-8 encoding.
+ */
+void TodoConvUtf8(const unsigned short *pUnits, size_t numUnits,
+		  std::string &utf8) {
+    utf8.resize(numUnits * 3);
+    if (numUnits != 0)
+	utf8.resize(TodoConvUtf8(pUnits, numUnits, &utf8[0]));
+}
+
+/**
+ * Decode UTF-8 into a QString.
+ *
+ * Decode a string of UTF-8 the same way as QString::fromUtf8() does, up to
+ * the first NUL character. Text that is all ASCII, as most is, is widened
+ * straight into UTF-16, sixteen bytes at a time where SSE2 is available,
+ * and anything else is handed to Qt's decoder.
+ * @param utf8 The UTF-8 to decode.
+ * @param arena The arena to take the UTF-16 buffer from. Whatever is taken
+ * from it is no longer needed once this returns.
+ * @param str Set to the decoded string.
+ */
+void TodoConvFromUtf8(const std::string &utf8, ArenaType &arena,
+		      QString &str) {
+    const char *pData = utf8.data();
+    size_t size = utf8.size();
+    unsigned short *pUnits;
+    unsigned char c;
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    __m128i block;
+#endif
+
+    pUnits = (unsigned short *)arena.Alloc(size * sizeof(unsigned short));
+    if (!pUnits) {
+	str = QString::fromUtf8(utf8.c_str());
+	return;
+    }
+
+#if defined(__SSE2__)
+    // The top bit of every byte, and a byte set for every NUL, shows up in
+    // the mask of a block that isn't plain ASCII.
+    for (; (size - i) >= 16; i += 16) {
+	block = _mm_loadu_si128((const __m128i *)(pData + i));
+	if (_mm_movemask_epi8(_mm_or_si128(block,
+					   _mm_cmpeq_epi8(block, zero))) != 0)
+	    break;
+	_mm_storeu_si128((__m128i *)(pUnits + i),
+			 _mm_unpacklo_epi8(block, zero));
+	_mm_storeu_si128((__m128i *)(pUnits + i + 8),
+			 _mm_unpackhi_epi8(block, zero));
+    }
+#endif
+    for (; i < size; i++) {
+	c = (unsigned char)pData[i];
+	if ((c == 0) || (c >= 0x80))
+	    break;
+	pUnits[i] = c;
+    }
+
+    // QChar holds nothing but its UTF-16 code unit.
+    if (i == size)
+	str.setUnicode((const QChar *)pUnits, size);
+    else
+	str = QString::fromUtf8(utf8.c_str());
+}
+
+static uint64_t HashBytes(uint64_t hash, const void *pData, size_t dataSize) {
+    const unsigned char *pBytes = (const unsigned char *)pData;
+    size_t i;
+
+    for (i = 0; i < dataSize; i++) {
+	hash ^= pBytes[i];
+	hash *= FINGERPRINT_PRIME;
+    }
+    return hash;
+}
+
+static uint64_t HashValue(uint64_t hash, int64_t value) {
+    unsigned char bytes[8];
+    int i;
+
+    // Hashed in a fixed byte order so the fingerprint doesn't depend on the
+    // host.
+    for (i = 0; i < 8; i++)
+	bytes[i] = (unsigned char)((uint64_t)value >> (i * 8));
+    return HashBytes(hash, bytes, sizeof(bytes));
+}
+
+static uint64_t HashString(uint64_t hash, const char *pStr, size_t strSize) {
+    // The length goes first so that moving text from one field into the
+    // next changes the fingerprint.
+    hash = HashValue(hash, (int64_t)strSize);
+    return HashBytes(hash, pStr, strSize);
+}
+
+/**
+ * Fingerprint a todo item.
+ *
+ * Calculate a 64 bit fingerprint over the fields of a todo item that are
+ * synchronized with the Zaurus. The created and modified times, the SyncID
+ * and the KOrganizer UID are left out, so the fingerprint only changes when
+ * the content the Zaurus would receive does.
+ * @param todoItem The todo item to fingerprint.
+ * @return The fingerprint, which is never zero.
+ */
+uint64_t TodoConvFingerprint(const TodoItemType &todoItem) {
+    std::string category = todoItem.GetCategory();
+    std::string description = todoItem.GetDescription();
+    std::string notes = todoItem.GetNotes();
+
+    return TodoConvFingerprint(category.data(), category.size(),
+			       todoItem.GetStartDate(),
+			       todoItem.GetDueDate(),
+			       todoItem.GetCompletedDate(),
+			       todoItem.GetProgressStatus(),
+			       todoItem.GetPriority(), description.data(),
+			       description.size(), notes.data(),
+			       notes.size());
+}
+
+/**
+ * Fingerprint the synchronized fields of a todo item.
+ *
+ * Calculate the same fingerprint as TodoConvFingerprint() does for a
+ * TodoItemType, from the synchronized fields as they would be converted,
+ * with the text given as UTF-8.
+ * @param pCategory The category.
+ * @param categorySize The size of the category, in bytes.
+ * @param startDate The start date, or zero.
+ * @param dueDate The due date, or zero.
+ * @param completedDate The completed date, or zero.
+ * @param progressStatus The progress status.
+ * @param priority The priority.
+ * @param pDescription The description (the KOrganizer summary).
+ * @param descriptionSize The size of the description, in bytes.
+ * @param pNotes The notes (the KOrganizer description).
+ * @param notesSize The size of the notes, in bytes.
+ * @return The fingerprint, which is never zero.
+ */
+uint64_t TodoConvFingerprint(const char *pCategory, size_t categorySize,
+			     time_t startDate, time_t dueDate,
+			     time_t completedDate, int progressStatus,
+			     int priority, const char *pDescription,
+			     size_t descriptionSize, const char *pNotes,
+			     size_t notesSize) {
+    uint64_t hash = FINGERPRINT_BASIS;
+
+    hash = HashString(hash, pCategory, categorySize);
+    hash = HashValue(hash, (int64_t)startDate);
+    hash = HashValue(hash, (int64_t)dueDate);
+    hash = HashValue(hash, (int64_t)completedDate);
+    hash = HashValue(hash, (int64_t)progressStatus);
+    hash = HashValue(hash, (int64_t)priority);
+    hash = HashString(hash, pDescription, descriptionSize);
+    hash = HashString(hash, pNotes, notesSize);
+
+    // Zero is kept for a fingerprint that isn't known.
+    if (hash == 0)
+	hash = 1;
+    return hash;
+}
+
+/**
+ * Construct a TodoConvTaskType object.
+ *
+ * @param fields The fields of the todo items to convert.
+ * @param todoItems Pointers to the TodoItemType objects to convert them
+ * into, at the same indexes.
+ * @param timeConv The time zone transition table to convert the times with.
+ */
+TodoConvTaskType::TodoConvTaskType(const std::vector<TodoFieldsType> &fields,
+				   const std::vector<TodoItemType *> &todoItems,
+				   const TimeConvType &timeConv)
+    : taskFields(fields), taskTodoItems(todoItems), taskTimeConv(timeConv) {
+}
+
+/**
+ * Convert a chunk of todo items.
+ *
+ * @param begin The index of the first todo item to convert.
+ * @param end The index one past the last todo item to convert.
+ */
+void TodoConvTaskType::RunChunk(size_t begin, size_t end) {
+    size_t i;
+
+    for (i = begin; i < end; i++)
+	TodoConvFields(taskFields[i], *taskTodoItems[i], taskTimeConv);
+}
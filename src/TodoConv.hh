@@ -0,0 +1,125 @@
+/*
+ * Copyright 2004, 2005 Andrew De Ponte
+ *
+ * This file is part of zsrep.
+ *
+ * zsrep is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * zsrep is distributed in the hopes that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with zsrep; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @file TodoConv.hh
+ * @brief A specifications file for the parallel todo item conversion.
+ * @author Andrew De Ponte
+ *
+ * A specifications file for converting KOrganizer todo items into
+ * TodoItemType objects on the threads of a WorkPoolType.
+ */
+
+#ifndef TODOCONV_H
+#define TODOCONV_H
+
+#include <zync/TodoPluginType.hh>
+
+#include <qstring.h>
+#include <qdatetime.h>
+#include <libkcal/todo.h>
+
+#include <time.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "WorkPool.hh"
+#include "TimeConv.hh"
+#include "CategoryTable.hh"
+#include "Arena.hh"
+
+// The number of todo items converted by each RunChunk() call.
+#define TODOCONV_CHUNK_SIZE 256
+
+/**
+ * @struct TodoFieldsType
+ * @brief The fields of a todo item needed to convert it.
+ *
+ * The fields of a KCal::Todo needed to convert it into a TodoItemType. The
+ * strings are copied out as UTF-16, as QString shares its data without
+ * locking and can't be handed to another thread. They are placed in the
+ * session arena, which has to outlive the fields. The category is taken
+ * already converted from the category table.
+ */
+struct TodoFieldsType {
+    const unsigned short *pUid;
+    size_t uidSize;
+    std::string category;
+    const unsigned short *pSummary;
+    size_t summarySize;
+    const unsigned short *pDescription;
+    size_t descriptionSize;
+    QDateTime created;
+    QDateTime dtStart;
+    QDateTime dtDue;
+    QDateTime completed;
+    time_t lastModified;
+    bool hasStartDate;
+    bool hasDueDate;
+    bool hasCompletedDate;
+    bool isCompleted;
+    int priority;
+    int pilotId;
+};
+
+bool TodoConvSnapshot(KCal::Todo *pKcalTodo, time_t lastModified,
+		      CategoryTableType &categories, ArenaType &arena,
+		      TodoFieldsType &fields);
+void TodoConvFields(const TodoFieldsType &fields, TodoItemType &todoItem,
+		    const TimeConvType &timeConv);
+bool TodoConvUnits(const QString &str, ArenaType &arena,
+		   const unsigned short *&pUnits, size_t &numUnits);
+size_t TodoConvUtf8(const unsigned short *pUnits, size_t numUnits,
+		    char *pUtf8);
+void TodoConvUtf8(const unsigned short *pUnits, size_t numUnits,
+		  std::string &utf8);
+void TodoConvFromUtf8(const std::string &utf8, ArenaType &arena,
+		      QString &str);
+uint64_t TodoConvFingerprint(const TodoItemType &todoItem);
+uint64_t TodoConvFingerprint(const char *pCategory, size_t categorySize,
+			     time_t startDate, time_t dueDate,
+			     time_t completedDate, int progressStatus,
+			     int priority, const char *pDescription,
+			     size_t descriptionSize, const char *pNotes,
+			     size_t notesSize);
+
+/**
+ * @class TodoConvTaskType
+ * @brief A type converting snapshotted todo items on a WorkPoolType.
+ *
+ * The TodoConvTaskType class converts the todo item fields at each index
+ * into the TodoItemType pointed to at the same index.
+ */
+class TodoConvTaskType : public WorkPoolTaskType {
+public:
+    TodoConvTaskType(const std::vector<TodoFieldsType> &fields,
+		     const std::vector<TodoItemType *> &todoItems,
+		     const TimeConvType &timeConv);
+
+    void RunChunk(size_t begin, size_t end);
+private:
+    const std::vector<TodoFieldsType> &taskFields;
+    const std::vector<TodoItemType *> &taskTodoItems;
+    const TimeConvType &taskTimeConv;
+};
+
+#endif
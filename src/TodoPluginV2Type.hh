@@ -0,0 +1,90 @@
+/*
+ * Copyright 2004, 2005 Andrew De Ponte
+ *
+ * This file is part of zsrep.
+ *
+ * zsrep is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * zsrep is distributed in the hopes that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with zsrep; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @file TodoPluginV2Type.hh
+ * @brief A specifications file for the second version of the TodoPlugin
+ * interface.
+ * @author Andrew De Ponte
+ *
+ * A specifications file for the second version of the TodoPlugin interface,
+ * which passes todo items across the plugin boundary without copying them.
+ */
+
+#ifndef TODOPLUGINV2TYPE_H
+#define TODOPLUGINV2TYPE_H
+
+#include <zync/TodoPluginType.hh>
+
+/**
+ * @class TodoItemVisitorType
+ * @brief A type receiving todo items one at a time.
+ *
+ * The TodoItemVisitorType class is implemented by the application to receive
+ * todo items from a plugin one at a time, instead of as a list holding all
+ * of them at once.
+ */
+class TodoItemVisitorType {
+public:
+    virtual ~TodoItemVisitorType(void) {}
+
+    /**
+     * Visit a todo item.
+     *
+     * @param todoItem The todo item. It is only valid for the duration of
+     * the call, so anything needed later has to be copied out of it.
+     * @return A boolean representing whether to go on to the next todo item
+     * (true) or to stop (false).
+     */
+    virtual bool VisitTodoItem(const TodoItemType &todoItem) = 0;
+};
+
+/**
+ * @class TodoPluginV2Type
+ * @brief A type providing the second version of the TodoPlugin interface.
+ *
+ * The TodoPluginV2Type class extends the TodoPlugin interface with calls
+ * that take their todo items by const reference, that hand their results
+ * over by swapping them into a list owned by the caller, and that visit the
+ * todo items one at a time. A plugin implementing it still provides the
+ * original interface through createTodoPlugin(), and provides this one
+ * through createTodoPluginV2().
+ */
+class TodoPluginV2Type : public TodoPluginType {
+public:
+    virtual int VisitAllTodoItems(TodoItemVisitorType &visitor) = 0;
+
+    virtual int TakeNewTodoItems(time_t lastTimeSynced,
+				 TodoItemType::List &todoItems) = 0;
+    virtual int TakeModTodoItems(time_t lastTimeSynced,
+				 TodoItemType::List &todoItems) = 0;
+    virtual int TakeDelTodoItemIDs(time_t lastTimeSynced,
+				   SyncIDListType &todoItemIDs) = 0;
+
+    virtual int AddTodoItemsRef(const TodoItemType::List &todoItems) = 0;
+    virtual int ModTodoItemsRef(const TodoItemType::List &todoItems) = 0;
+    virtual int DelTodoItemsRef(const SyncIDListType &todoItemIDs) = 0;
+    virtual int MapItemIDsRef(const TodoItemType::List &todoItems) = 0;
+};
+
+extern "C" TodoPluginV2Type *createTodoPluginV2(void);
+extern "C" void destroyTodoPluginV2(TodoPluginV2Type *pTodoPlugin);
+
+#endif
@@ -0,0 +1,268 @@
+/*
+ * Copyright 2004, 2005 Andrew De Ponte
+ *
+ * This file is part of zsrep.
+ *
+ * zsrep is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * zsrep is distributed in the hopes that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with zsrep; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @file TodoStore.cc
+ * @brief An implementation file for the compact todo item store.
+ * @author Andrew De Ponte
+ *
+ * An implementation file for the compact todo item store, which holds the
+ * SyncIDs and times of the todo items of the calendars in column arrays so
+ * that classifying and diffing them is a scan over those.
+ */
+
+#include "TodoStore.hh"
+#include "TodoConv.hh"
+
+/**
+ * Construct a TodoStoreType object.
+ *
+ * Construct an empty store.
+ */
+TodoStoreType::TodoStoreType(void) {
+}
+
+/**
+ * Clear the store.
+ *
+ * Remove every row from the store and give back the memory the columns
+ * held, as the store is only needed while the todo items are scanned.
+ */
+void TodoStoreType::Clear(void) {
+    std::vector<KCal::Todo *>().swap(todos);
+    std::vector<uint32_t>().swap(syncIDs);
+    std::vector<uint>().swap(created);
+    std::vector<uint>().swap(lastModified);
+    std::vector<char>().swap(textBuf);
+}
+
+/**
+ * Reset the store.
+ *
+ * Remove every row from the store, keeping the memory the columns hold for
+ * the rows added next.
+ */
+void TodoStoreType::Reset(void) {
+    todos.clear();
+    syncIDs.clear();
+    created.clear();
+    lastModified.clear();
+}
+
+/**
+ * Reserve room in the store.
+ *
+ * @param numTodos The number of rows the store will hold.
+ */
+void TodoStoreType::Reserve(size_t numTodos) {
+    todos.reserve(numTodos);
+    syncIDs.reserve(numTodos);
+    created.reserve(numTodos);
+    lastModified.reserve(numTodos);
+}
+
+/**
+ * Fill the store with todo items.
+ *
+ * Replace the rows of the store with the given todo items, in the same
+ * order. The times of all of them are converted in one go for each field,
+ * so the transition table is walked without libc in between.
+ * @param kcalTodos The todo items to hold.
+ * @param timeConv The time zone transition table to convert the times with.
+ */
+void TodoStoreType::Build(const std::vector<KCal::Todo *> &kcalTodos,
+			  const TimeConvType &timeConv) {
+    std::vector<QDateTime> kcalTimes;
+    size_t numTodos = kcalTodos.size();
+    size_t i;
+
+    Clear();
+    if (numTodos == 0)
+	return;
+
+    Reserve(numTodos);
+    for (i = 0; i < numTodos; i++) {
+	todos.push_back(kcalTodos[i]);
+	syncIDs.push_back((uint32_t)kcalTodos[i]->pilotId());
+    }
+
+    created.resize(numTodos);
+    lastModified.resize(numTodos);
+    kcalTimes.resize(numTodos);
+    for (i = 0; i < numTodos; i++)
+	kcalTimes[i] = kcalTodos[i]->created();
+    timeConv.ToTime_t(&kcalTimes[0], &created[0], numTodos);
+    for (i = 0; i < numTodos; i++)
+	kcalTimes[i] = kcalTodos[i]->lastModified();
+    timeConv.ToTime_t(&kcalTimes[0], &lastModified[0], numTodos);
+}
+
+/**
+ * Add a todo item to the store.
+ *
+ * @param pKCalTodo Pointer to the todo item to add.
+ * @param timeConv The time zone transition table to convert the times with.
+ * @return The row of the todo item.
+ */
+size_t TodoStoreType::Add(KCal::Todo *pKCalTodo,
+			  const TimeConvType &timeConv) {
+    todos.push_back(pKCalTodo);
+    syncIDs.push_back((uint32_t)pKCalTodo->pilotId());
+    created.push_back(timeConv.ToTime_t(pKCalTodo->created()));
+    lastModified.push_back(timeConv.ToTime_t(pKCalTodo->lastModified()));
+    return todos.size() - 1;
+}
+
+/**
+ * Get the number of todo items in the store.
+ *
+ * @return The number of rows of the store.
+ */
+size_t TodoStoreType::GetNumTodos(void) const {
+    return todos.size();
+}
+
+/**
+ * Get the todo item of a row.
+ *
+ * @param row The row of the todo item.
+ * @return Pointer to the KCal::Todo the row was taken from.
+ */
+KCal::Todo *TodoStoreType::GetTodo(size_t row) const {
+    return todos[row];
+}
+
+/**
+ * Get the SyncID of a row.
+ *
+ * @param row The row of the todo item.
+ * @return The SyncID of the todo item, zero when it has none.
+ */
+uint32_t TodoStoreType::GetSyncID(size_t row) const {
+    return syncIDs[row];
+}
+
+/**
+ * Get the created time of a row.
+ *
+ * @param row The row of the todo item.
+ * @return The time the todo item was created.
+ */
+time_t TodoStoreType::GetCreated(size_t row) const {
+    return (time_t)created[row];
+}
+
+/**
+ * Get the last modified time of a row.
+ *
+ * @param row The row of the todo item.
+ * @return The time the todo item was last modified.
+ */
+time_t TodoStoreType::GetLastModified(size_t row) const {
+    return (time_t)lastModified[row];
+}
+
+/**
+ * Get the SyncIDs in the store.
+ *
+ * @param todoSyncIDs Set to the SyncIDs of the todo items that have one, in
+ * the order of their rows.
+ */
+void TodoStoreType::GetSyncIDs(std::vector<uint64_t> &todoSyncIDs) const {
+    size_t i;
+
+    todoSyncIDs.clear();
+    todoSyncIDs.reserve(syncIDs.size());
+    for (i = 0; i < syncIDs.size(); i++) {
+	if (syncIDs[i] != 0)
+	    todoSyncIDs.push_back(syncIDs[i]);
+    }
+}
+
+/**
+ * Fingerprint a row.
+ *
+ * Calculate the fingerprint TodoConvFingerprint() would give the todo item
+ * of a row once it is converted, without converting it. Only the fields
+ * the fingerprint covers are read from the todo item.
+ * @param row The row of the todo item.
+ * @param timeConv The time zone transition table to convert the times with.
+ * @param categories The table to intern the category in.
+ * @return The fingerprint, which is never zero.
+ */
+uint64_t TodoStoreType::Fingerprint(size_t row, const TimeConvType &timeConv,
+				    CategoryTableType &categories) {
+    KCal::Todo *pKCalTodo = todos[row];
+    QStringList kOrgCatList;
+    uint32_t categoryID = CATEGORYTABLE_NO_CATEGORY;
+    const char *pText;
+    size_t summarySize;
+    uint startDate, dueDate, completedDate;
+
+    // Only the first of the KOrganizer categories is synchronized.
+    kOrgCatList = pKCalTodo->categories();
+    if (!kOrgCatList.isEmpty())
+	categoryID = categories.Intern(*kOrgCatList.begin());
+    const std::string &category = categories.GetUtf8(categoryID);
+
+    startDate = pKCalTodo->hasStartDate() ?
+	timeConv.ToTime_t(pKCalTodo->dtStart()) : 0;
+    dueDate = pKCalTodo->hasDueDate() ?
+	timeConv.ToTime_t(pKCalTodo->dtDue()) : 0;
+    completedDate = pKCalTodo->hasCompletedDate() ?
+	timeConv.ToTime_t(pKCalTodo->completed()) : 0;
+
+    textBuf.clear();
+    AddText(pKCalTodo->summary());
+    summarySize = textBuf.size();
+    AddText(pKCalTodo->description());
+    pText = textBuf.empty() ? "" : &textBuf[0];
+
+    return TodoConvFingerprint(category.data(), category.size(),
+			       (time_t)startDate, (time_t)dueDate,
+			       (time_t)completedDate,
+			       pKCalTodo->isCompleted() ? 0 : 1,
+			       (unsigned char)pKCalTodo->priority(),
+			       pText, summarySize, pText + summarySize,
+			       textBuf.size() - summarySize);
+}
+
+/**
+ * Add a text field to the text buffer.
+ *
+ * Add the UTF-8 encoding of a string to the text buffer, up to its first
+ * NUL character, the same as converting it to a std::string does. The
+ * string is encoded straight into the buffer by TodoConvUtf8(), rather than
+ * through the QCString QString::utf8() allocates.
+ * @param str The string to add.
+ */
+void TodoStoreType::AddText(const QString &str) {
+    size_t numUnits = str.length();
+    size_t offset = textBuf.size();
+
+    if (numUnits == 0)
+	return;
+
+    // QChar holds nothing but its UTF-16 code unit.
+    textBuf.resize(offset + (numUnits * 3));
+    textBuf.resize(offset +
+		   TodoConvUtf8((const unsigned short *)str.unicode(),
+				numUnits, &textBuf[offset]));
+}
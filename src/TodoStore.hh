@@ -0,0 +1,94 @@
+/*
+ * Copyright 2004, 2005 Andrew De Ponte
+ *
+ * This file is part of zsrep.
+ *
+ * zsrep is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * zsrep is distributed in the hopes that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with zsrep; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @file TodoStore.hh
+ * @brief A specifications file for the compact todo item store.
+ * @author Andrew De Ponte
+ *
+ * A specifications file for the compact todo item store, which holds the
+ * SyncIDs and times of the todo items of the calendars in column arrays so
+ * that classifying and diffing them is a scan over those.
+ */
+
+#ifndef TODOSTORE_H
+#define TODOSTORE_H
+
+#include <qstring.h>
+#include <qdatetime.h>
+#include <libkcal/todo.h>
+
+#include <time.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#include "TimeConv.hh"
+#include "CategoryTable.hh"
+
+/**
+ * @class TodoStoreType
+ * @brief A type holding the classifying fields of todo items in columns.
+ *
+ * The TodoStoreType class holds, for each todo item added to it, the fields
+ * the plugin classifies the todo items by: the SyncID and the created and
+ * last modified times already converted to seconds since the epoch. Each
+ * field is kept in an array of its own, indexed by the row of the todo item,
+ * so a pass over one field touches only that field and no todo item needs
+ * allocations of its own. The KCal::Todo each row was taken from is kept as
+ * well. The rest of the synchronized fields are only read from it for the
+ * few rows that are fingerprinted, and for converting the rows that are
+ * sent to the Zaurus.
+ */
+class TodoStoreType {
+public:
+    TodoStoreType(void);
+
+    void Clear(void);
+    void Reset(void);
+    void Reserve(size_t numTodos);
+    void Build(const std::vector<KCal::Todo *> &kcalTodos,
+	       const TimeConvType &timeConv);
+    size_t Add(KCal::Todo *pKCalTodo, const TimeConvType &timeConv);
+
+    size_t GetNumTodos(void) const;
+    KCal::Todo *GetTodo(size_t row) const;
+    uint32_t GetSyncID(size_t row) const;
+    time_t GetCreated(size_t row) const;
+    time_t GetLastModified(size_t row) const;
+    void GetSyncIDs(std::vector<uint64_t> &todoSyncIDs) const;
+    uint64_t Fingerprint(size_t row, const TimeConvType &timeConv,
+			 CategoryTableType &categories);
+private:
+    void AddText(const QString &str);
+
+    std::vector<KCal::Todo *> todos;
+    std::vector<uint32_t> syncIDs;
+    std::vector<uint> created;
+    std::vector<uint> lastModified;
+
+    // The UTF-8 summary and description of the row being fingerprinted,
+    // one after the other.
+    std::vector<char> textBuf;
+};
+
+#endif
@@ -0,0 +1,300 @@
+/*
+ * Copyright 2004, 2005 Andrew De Ponte
+ *
+ * This file is part of zsrep.
+ *
+ * zsrep is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * zsrep is distributed in the hopes that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with zsrep; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @file WorkPool.cc
+ * @brief An implementation file for the work-stealing thread pool.
+ * @author Andrew De Ponte
+ *
+ * An implementation file for the thread pool that spreads the chunks of a
+ * task over several threads, letting idle threads steal chunks from busy
+ * ones.
+ */
+
+#include "WorkPool.hh"
+
+/**
+ * Construct a default WorkPoolType object.
+ *
+ * Construct a WorkPoolType object without any threads. Until Start() is
+ * called tasks are run entirely on the calling thread.
+ */
+WorkPoolType::WorkPoolType(void) {
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&jobCond, NULL);
+    pthread_cond_init(&doneCond, NULL);
+    pTask = NULL;
+    taskItems = 0;
+    taskChunkSize = 0;
+    jobGen = 0;
+    numBusy = 0;
+    stopFlag = false;
+}
+
+/**
+ * Destruct the WorkPoolType object.
+ *
+ * Destruct the WorkPoolType object, stopping its threads first.
+ */
+WorkPoolType::~WorkPoolType(void) {
+    Stop();
+    pthread_cond_destroy(&doneCond);
+    pthread_cond_destroy(&jobCond);
+    pthread_mutex_destroy(&mutex);
+}
+
+/**
+ * Start the threads of the pool.
+ *
+ * Start the given number of threads, in addition to the thread that will
+ * call Run(). Any threads started earlier are stopped first.
+ * @param numThreads The number of threads to start.
+ * @return An integer representing success (zero) or failure (non-zero).
+ * @retval 0 Success.
+ * @retval 1 Failed to create one of the threads. None are left running.
+ */
+int WorkPoolType::Start(unsigned int numThreads) {
+    size_t i;
+
+    Stop();
+
+    queues.resize(numThreads + 1);
+    for (i = 0; i < queues.size(); i++) {
+	queues[i] = new QueueType;
+	pthread_mutex_init(&queues[i]->mutex, NULL);
+    }
+
+    // The workers are sized up front as the threads keep pointers to them.
+    workers.resize(numThreads);
+    threads.reserve(numThreads);
+    for (i = 0; i < workers.size(); i++) {
+	pthread_t thread;
+
+	workers[i].pPool = this;
+	workers[i].queueIdx = i + 1;
+	if (pthread_create(&thread, NULL, WorkerMain, &workers[i]) != 0) {
+	    Stop();
+	    return 1;
+	}
+	threads.push_back(thread);
+    }
+
+    return 0;
+}
+
+/**
+ * Stop the threads of the pool.
+ *
+ * Stop the threads of the pool and wait for them to exit. Tasks run
+ * afterwards are run entirely on the calling thread.
+ */
+void WorkPoolType::Stop(void) {
+    size_t i;
+
+    pthread_mutex_lock(&mutex);
+    stopFlag = true;
+    pthread_cond_broadcast(&jobCond);
+    pthread_mutex_unlock(&mutex);
+
+    for (i = 0; i < threads.size(); i++)
+	pthread_join(threads[i], NULL);
+    threads.clear();
+    workers.clear();
+
+    for (i = 0; i < queues.size(); i++) {
+	pthread_mutex_destroy(&queues[i]->mutex);
+	delete queues[i];
+    }
+    queues.clear();
+
+    stopFlag = false;
+}
+
+/**
+ * Get the number of threads.
+ *
+ * @return The number of threads started, not counting the thread calling
+ * Run().
+ */
+unsigned int WorkPoolType::GetNumThreads(void) const {
+    return (unsigned int)threads.size();
+}
+
+/**
+ * Run a task.
+ *
+ * Run the given task over numItems items, in chunks of chunkSize items, on
+ * the threads of the pool and the calling thread. It returns once every
+ * chunk is done. Only one thread may run tasks on a pool at a time.
+ * @param task The task to run.
+ * @param numItems The number of items of the task.
+ * @param chunkSize The number of items handed to each RunChunk() call.
+ */
+void WorkPoolType::Run(WorkPoolTaskType &task, size_t numItems,
+		       size_t chunkSize) {
+    size_t numChunks;
+    size_t chunk;
+    size_t i;
+
+    if (numItems == 0)
+	return;
+
+    if (threads.empty()) {
+	task.RunChunk(0, numItems);
+	return;
+    }
+
+    if (chunkSize == 0)
+	chunkSize = 1;
+    numChunks = (numItems + chunkSize - 1) / chunkSize;
+
+    // Deal each queue a contiguous run of chunks, so the threads start out
+    // on neighbouring items.
+    chunk = 0;
+    for (i = 0; i < queues.size(); i++) {
+	size_t share = (numChunks / queues.size()) +
+	    ((i < (numChunks % queues.size())) ? 1 : 0);
+
+	pthread_mutex_lock(&queues[i]->mutex);
+	while (share-- > 0)
+	    queues[i]->chunks.push_back(chunk++);
+	pthread_mutex_unlock(&queues[i]->mutex);
+    }
+
+    pthread_mutex_lock(&mutex);
+    pTask = &task;
+    taskItems = numItems;
+    taskChunkSize = chunkSize;
+    jobGen++;
+    pthread_cond_broadcast(&jobCond);
+    pthread_mutex_unlock(&mutex);
+
+    WorkLoop(0);
+
+    // Every chunk has been taken once the queues are empty, wait for the
+    // threads still working on theirs. Clearing the task under the same lock
+    // keeps threads that wake up late from joining it.
+    pthread_mutex_lock(&mutex);
+    while (numBusy > 0)
+	pthread_cond_wait(&doneCond, &mutex);
+    pTask = NULL;
+    pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * Run a thread of the pool.
+ *
+ * Wait for tasks to be handed to the pool and work on each of them until
+ * the pool is stopped.
+ * @param pArg Pointer to the WorkerType of the thread.
+ * @return NULL.
+ */
+void *WorkPoolType::WorkerMain(void *pArg) {
+    WorkerType *pWorker = (WorkerType *)pArg;
+    WorkPoolType *pPool = pWorker->pPool;
+    unsigned long seenGen;
+
+    pthread_mutex_lock(&pPool->mutex);
+    seenGen = pPool->jobGen;
+    for (;;) {
+	while (!pPool->stopFlag && (pPool->jobGen == seenGen))
+	    pthread_cond_wait(&pPool->jobCond, &pPool->mutex);
+	if (pPool->stopFlag)
+	    break;
+
+	seenGen = pPool->jobGen;
+	if (!pPool->pTask)
+	    continue;
+
+	pPool->numBusy++;
+	pthread_mutex_unlock(&pPool->mutex);
+
+	pPool->WorkLoop(pWorker->queueIdx);
+
+	pthread_mutex_lock(&pPool->mutex);
+	pPool->numBusy--;
+	if (pPool->numBusy == 0)
+	    pthread_cond_signal(&pPool->doneCond);
+    }
+    pthread_mutex_unlock(&pPool->mutex);
+
+    return NULL;
+}
+
+/**
+ * Work on the current task.
+ *
+ * Run chunks of the current task, from the given queue first and then
+ * stolen from the others, until no chunks are left. The task doesn't change
+ * while any thread is in here.
+ * @param queueIdx The index of the queue of the calling thread.
+ */
+void WorkPoolType::WorkLoop(size_t queueIdx) {
+    size_t chunk;
+    size_t begin;
+    size_t end;
+
+    while (TakeChunk(queueIdx, chunk)) {
+	begin = chunk * taskChunkSize;
+	end = begin + taskChunkSize;
+	if (end > taskItems)
+	    end = taskItems;
+	pTask->RunChunk(begin, end);
+    }
+}
+
+/**
+ * Take a chunk to work on.
+ *
+ * Take the next chunk from the front of the given queue, or when it is
+ * empty steal the last chunk from the back of another queue.
+ * @param queueIdx The index of the queue of the calling thread.
+ * @param chunk Set to the index of the chunk taken.
+ * @return A boolean representing whether a chunk was taken (true) or all
+ * the queues are empty (false).
+ */
+bool WorkPoolType::TakeChunk(size_t queueIdx, size_t &chunk) {
+    QueueType *pQueue;
+    size_t i;
+
+    pQueue = queues[queueIdx];
+    pthread_mutex_lock(&pQueue->mutex);
+    if (!pQueue->chunks.empty()) {
+	chunk = pQueue->chunks.front();
+	pQueue->chunks.pop_front();
+	pthread_mutex_unlock(&pQueue->mutex);
+	return true;
+    }
+    pthread_mutex_unlock(&pQueue->mutex);
+
+    for (i = 1; i < queues.size(); i++) {
+	pQueue = queues[(queueIdx + i) % queues.size()];
+	pthread_mutex_lock(&pQueue->mutex);
+	if (!pQueue->chunks.empty()) {
+	    chunk = pQueue->chunks.back();
+	    pQueue->chunks.pop_back();
+	    pthread_mutex_unlock(&pQueue->mutex);
+	    return true;
+	}
+	pthread_mutex_unlock(&pQueue->mutex);
+    }
+
+    return false;
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright 2004, 2005 Andrew De Ponte
+ *
+ * This file is part of zsrep.
+ *
+ * zsrep is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * zsrep is distributed in the hopes that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with zsrep; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @file WorkPool.hh
+ * @brief A specifications file for the work-stealing thread pool.
+ * @author Andrew De Ponte
+ *
+ * A specifications file for the thread pool that spreads the chunks of a
+ * task over several threads, letting idle threads steal chunks from busy
+ * ones.
+ */
+
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#include <vector>
+#include <deque>
+
+/**
+ * @class WorkPoolTaskType
+ * @brief A type holding work that can be split into chunks.
+ *
+ * The WorkPoolTaskType class is implemented by the work handed to a
+ * WorkPoolType. RunChunk() is called from several threads at once, each
+ * time for a different range of items, so it may only touch the items of
+ * its own range.
+ */
+class WorkPoolTaskType {
+public:
+    virtual ~WorkPoolTaskType(void) {}
+
+    virtual void RunChunk(size_t begin, size_t end) = 0;
+};
+
+/**
+ * @class WorkPoolType
+ * @brief A type providing a work-stealing thread pool.
+ *
+ * The WorkPoolType class runs tasks on a fixed set of threads plus the
+ * thread calling Run(). Each thread is dealt an equal share of the chunks of
+ * a task up front and works through them from the front of its queue. Once
+ * its queue is empty it steals chunks from the back of the queues of the
+ * other threads, so a thread that was dealt slow chunks doesn't hold up the
+ * rest.
+ */
+class WorkPoolType {
+public:
+    WorkPoolType(void);
+    ~WorkPoolType(void);
+
+    int Start(unsigned int numThreads);
+    void Stop(void);
+    unsigned int GetNumThreads(void) const;
+
+    void Run(WorkPoolTaskType &task, size_t numItems, size_t chunkSize);
+private:
+    struct QueueType {
+	pthread_mutex_t mutex;
+	std::deque<size_t> chunks;
+    };
+
+    struct WorkerType {
+	WorkPoolType *pPool;
+	size_t queueIdx;
+    };
+
+    static void *WorkerMain(void *pArg);
+    void WorkLoop(size_t queueIdx);
+    bool TakeChunk(size_t queueIdx, size_t &chunk);
+
+    pthread_mutex_t mutex;
+    pthread_cond_t jobCond;
+    pthread_cond_t doneCond;
+    std::vector<pthread_t> threads;
+    std::vector<WorkerType> workers;
+    std::vector<QueueType *> queues;
+
+    // The task being run, the generation of it so each thread joins it only
+    // once, and the number of threads still working on it.
+    WorkPoolTaskType *pTask;
+    size_t taskItems;
+    size_t taskChunkSize;
+    unsigned long jobGen;
+    unsigned int numBusy;
+    bool stopFlag;
+};
+
+#endif
@@ -0,0 +1,161 @@
+/*
+ * Copyright 2004, 2005 Andrew De Ponte
+ *
+ * This file is part of zsrep.
+ *
+ * zsrep is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * zsrep is distributed in the hopes that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with zsrep; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @file IcsGen.cc
+ * @brief An implementation file for the synthetic calendar generator.
+ * @author Andrew De Ponte
+ *
+ * An implementation file for the generator of synthetic KOrganizer calendar
+ * files used by the benchmarks.
+ */
+
+#include "IcsGen.hh"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static void FormatTime(char *pBuff, size_t buffSize, time_t when) {
+    struct tm brTime;
+
+    gmtime_r(&when, &brTime);
+    strftime(pBuff, buffSize, "%Y%m%dT%H%M%SZ", &brTime);
+}
+
+/**
+ * Fill in the default options.
+ *
+ * Fill in the options of a calendar of 1000 todo items and 1000 events,
+ * with short notes, 8 categories and half the todo items synchronized.
+ * @param options The options to fill in.
+ */
+void IcsGenDefaults(IcsGenOptions &options) {
+    options.numTodos = 1000;
+    options.numEvents = 1000;
+    options.noteSize = 64;
+    options.numCategories = 8;
+    options.pilotIdEvery = 2;
+    options.baseTime = time(NULL);
+    options.seed = 1;
+}
+
+/**
+ * Write a synthetic calendar file.
+ *
+ * Write a calendar file shaped by the given options, in the form KOrganizer
+ * writes them. Lines are folded at 75 characters as iCalendar requires.
+ * @param icsPath The path of the calendar file to write.
+ * @param options The shape of the calendar.
+ * @return An integer representing success (zero) or failure (non-zero).
+ * @retval 0 Success.
+ * @retval 1 Failed to open the calendar file for output.
+ * @retval 2 Failed to write the calendar file.
+ */
+int IcsGenWrite(const std::string &icsPath, const IcsGenOptions &options) {
+    std::string note;
+    char created[32], modified[32], start[32], end[32];
+    time_t createdTime, modifiedTime;
+    unsigned long i, j;
+    FILE *pFile;
+
+    pFile = fopen(icsPath.c_str(), "w");
+    if (!pFile)
+	return 1;
+
+    srand(options.seed);
+
+    fprintf(pFile, "BEGIN:VCALENDAR\r\n"
+	    "PRODID:-//K Desktop Environment//NONSGML libkcal 3.2//EN\r\n"
+	    "VERSION:2.0\r\n");
+
+    // The events are written first, as KOrganizer does, so that a loader
+    // has to get past all of them to reach the todo items.
+    for (i = 0; i < options.numEvents; i++) {
+	createdTime = options.baseTime - (rand() % (30 * 24 * 3600));
+	FormatTime(created, sizeof(created), createdTime);
+	FormatTime(start, sizeof(start), createdTime + (rand() % 86400));
+	FormatTime(end, sizeof(end), createdTime + 90000);
+	fprintf(pFile, "BEGIN:VEVENT\r\n"
+		"DTSTAMP:%s\r\n"
+		"ORGANIZER;CN=Bench:MAILTO:bench@example.org\r\n"
+		"CREATED:%s\r\n"
+		"UID:libkcal-bench-event-%lu\r\n"
+		"SEQUENCE:0\r\n"
+		"LAST-MODIFIED:%s\r\n"
+		"SUMMARY:Event %lu\r\n"
+		"CLASS:PUBLIC\r\n"
+		"PRIORITY:3\r\n"
+		"DTSTART:%s\r\n"
+		"DTEND:%s\r\n"
+		"TRANSP:OPAQUE\r\n"
+		"END:VEVENT\r\n",
+		created, created, i, created, i, start, end);
+    }
+
+    for (i = 0; i < options.numTodos; i++) {
+	createdTime = options.baseTime - (rand() % (30 * 24 * 3600));
+	modifiedTime = createdTime + (rand() % (options.baseTime -
+						createdTime + 1));
+	FormatTime(created, sizeof(created), createdTime);
+	FormatTime(modified, sizeof(modified), modifiedTime);
+
+	// The notes are folded onto continuation lines of 74 characters.
+	note.clear();
+	for (j = 0; j < options.noteSize; j++) {
+	    if ((j > 0) && ((j % 74) == 0))
+		note.append("\r\n ");
+	    note.push_back((char)('a' + (rand() % 26)));
+	}
+
+	fprintf(pFile, "BEGIN:VTODO\r\n"
+		"DTSTAMP:%s\r\n"
+		"ORGANIZER;CN=Bench:MAILTO:bench@example.org\r\n"
+		"CREATED:%s\r\n"
+		"UID:libkcal-bench-todo-%lu\r\n"
+		"SEQUENCE:0\r\n"
+		"LAST-MODIFIED:%s\r\n"
+		"DESCRIPTION:\r\n %s\r\n"
+		"SUMMARY:Todo %lu\r\n"
+		"CLASS:PUBLIC\r\n"
+		"PRIORITY:%d\r\n"
+		"CATEGORIES:Category %lu\r\n",
+		modified, created, i, modified, note.c_str(), i,
+		1 + (rand() % 5),
+		options.numCategories ? (i % options.numCategories) : 0);
+	if (options.pilotIdEvery && ((i % options.pilotIdEvery) == 0)) {
+	    fprintf(pFile, "X-PILOTID:%lu\r\n"
+		    "X-PILOTSTAT:0\r\n", i + 1);
+	}
+	fprintf(pFile, "PERCENT-COMPLETE:%d\r\n"
+		"END:VTODO\r\n", (rand() % 2) * 100);
+    }
+
+    fprintf(pFile, "END:VCALENDAR\r\n");
+
+    if (ferror(pFile)) {
+	fclose(pFile);
+	return 2;
+    }
+
+    if (fclose(pFile) != 0)
+	return 2;
+
+    return 0;
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright 2004, 2005 Andrew De Ponte
+ *
+ * This file is part of zsrep.
+ *
+ * zsrep is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * zsrep is distributed in the hopes that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with zsrep; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @file IcsGen.hh
+ * @brief A specifications file for the synthetic calendar generator.
+ * @author Andrew De Ponte
+ *
+ * A specifications file for the generator of synthetic KOrganizer calendar
+ * files used by the benchmarks.
+ */
+
+#ifndef ICSGEN_H
+#define ICSGEN_H
+
+#include <time.h>
+
+#include <string>
+
+/**
+ * @struct IcsGenOptions
+ * @brief The shape of a generated calendar.
+ *
+ * The numTodos and numEvents fields give the number of todo items and events
+ * to generate. Each todo item has notes of noteSize bytes and one of
+ * numCategories categories. Every todo item whose index is a multiple of
+ * pilotIdEvery has a pilotId (SyncID) as if it had been synchronized before,
+ * the others have none. The items are spread over the 30 days before
+ * baseTime, with seed making the generated calendar repeatable.
+ */
+struct IcsGenOptions {
+    unsigned long numTodos;
+    unsigned long numEvents;
+    unsigned long noteSize;
+    unsigned long numCategories;
+    unsigned long pilotIdEvery;
+    time_t baseTime;
+    unsigned int seed;
+};
+
+void IcsGenDefaults(IcsGenOptions &options);
+int IcsGenWrite(const std::string &icsPath, const IcsGenOptions &options);
+
+#endif
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2004, 2005 Andrew De Ponte
+ *
+ * This file is part of zsrep.
+ *
+ * zsrep is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * zsrep is distributed in the hopes that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with zsrep; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @file IcsGenMain.cc
+ * @brief A command line front end of the synthetic calendar generator.
+ * @author Andrew De Ponte
+ *
+ * A command line program writing a synthetic KOrganizer calendar file, for
+ * benchmarking by hand.
+ */
+
+#include "IcsGen.hh"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <iostream>
+
+static void PrintUsage(const char *pProgName) {
+    std::cerr << "Usage: " << pProgName << " [-t todos] [-e events] " \
+	"[-n note bytes] [-c categories] [-p pilotId every nth todo] " \
+	"[-s seed] calendar.ics\n";
+}
+
+int main(int argc, char *argv[]) {
+    IcsGenOptions options;
+    int opt;
+    int retval;
+
+    IcsGenDefaults(options);
+
+    while ((opt = getopt(argc, argv, "t:e:n:c:p:s:")) != -1) {
+	switch (opt) {
+	case 't':
+	    options.numTodos = strtoul(optarg, NULL, 10);
+	    break;
+	case 'e':
+	    options.numEvents = strtoul(optarg, NULL, 10);
+	    break;
+	case 'n':
+	    options.noteSize = strtoul(optarg, NULL, 10);
+	    break;
+	case 'c':
+	    options.numCategories = strtoul(optarg, NULL, 10);
+	    break;
+	case 'p':
+	    options.pilotIdEvery = strtoul(optarg, NULL, 10);
+	    break;
+	case 's':
+	    options.seed = (unsigned int)strtoul(optarg, NULL, 10);
+	    break;
+	default:
+	    PrintUsage(argv[0]);
+	    return 1;
+	}
+    }
+
+    if (optind != (argc - 1)) {
+	PrintUsage(argv[0]);
+	return 1;
+    }
+
+    retval = IcsGenWrite(argv[optind], options);
+    if (retval != 0) {
+	std::cerr << "IcsGen: Error: Failed to write " << argv[optind] <<
+	    " (" << retval << ").\n";
+	return 1;
+    }
+
+    return 0;
+}
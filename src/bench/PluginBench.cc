@@ -0,0 +1,389 @@
+/*
+ * Copyright 2004, 2005 Andrew De Ponte
+ *
+ * This file is part of zsrep.
+ *
+ * zsrep is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * zsrep is distributed in the hopes that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with zsrep; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @file PluginBench.cc
+ * @brief A benchmark of the KOrganizer todo plugin as a whole.
+ * @author Andrew De Ponte
+ *
+ * A benchmark that loads the plugin the way zync does and times a complete
+ * synchronization session against generated calendars of 1k to 1M todo
+ * items, counting the calls of operator new made by each plugin call.
+ */
+
+#include "IcsGen.hh"
+
+#include <zync/TodoPluginType.hh>
+
+#include <sys/time.h>
+#include <dlfcn.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <new>
+
+typedef TodoPluginType *(*CreateTodoPluginFunc)(void);
+typedef void (*DestroyTodoPluginFunc)(TodoPluginType *);
+
+#define BENCH_NUM_PHASES 10
+
+static const char *phaseNames[BENCH_NUM_PHASES] = {
+    "initialize", "get_all", "get_new", "get_mod", "get_del", "add", "mod",
+    "del", "map", "clean_up"
+};
+
+// The files a session leaves in the home directory.
+static const char *homeFiles[] = {
+    ".KOrgTodoPlugin.conf", ".KOrgTodoPlugin.log", ".KOrgTodoPlugin.journal",
+    ".KOrgTodoPlugin.stats", ".KOrgTodoPlugin.convcache",
+    ".KOrgTodoPlugin.idmap", ".KOrgTodoPlugin.calcache", "std.ics",
+    "std.ics.tmp", "korganizerrc", NULL
+};
+
+// The number of calls of operator new so far. The plugin is linked against
+// the operator new defined below, so its allocations, and those of Qt and
+// libkcal, are counted as well.
+static volatile unsigned long numNews = 0;
+
+// C++17 no longer allows the exception specifications C++98 declares the
+// replaceable allocation functions with.
+#if __cplusplus >= 201103L
+#define BENCH_THROW_BAD_ALLOC
+#define BENCH_THROW_NOTHING noexcept
+#else
+#define BENCH_THROW_BAD_ALLOC throw (std::bad_alloc)
+#define BENCH_THROW_NOTHING throw ()
+#endif
+
+void *operator new(size_t size) BENCH_THROW_BAD_ALLOC {
+    void *pMem;
+
+    __sync_fetch_and_add(&numNews, 1);
+    pMem = malloc(size ? size : 1);
+    if (!pMem)
+	throw std::bad_alloc();
+    return pMem;
+}
+
+void *operator new[](size_t size) BENCH_THROW_BAD_ALLOC {
+    return operator new(size);
+}
+
+void operator delete(void *pMem) BENCH_THROW_NOTHING {
+    free(pMem);
+}
+
+void operator delete[](void *pMem) BENCH_THROW_NOTHING {
+    free(pMem);
+}
+
+static double GetTimeSecs(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (double)tv.tv_sec + ((double)tv.tv_usec / 1000000.0);
+}
+
+static void RemoveHome(const std::string &homeDir) {
+    std::string filePath;
+    int i;
+
+    for (i = 0; homeFiles[i]; i++) {
+	filePath = homeDir + "/" + homeFiles[i];
+	unlink(filePath.c_str());
+    }
+    rmdir(homeDir.c_str());
+}
+
+/**
+ * Set up a home directory for a session.
+ *
+ * Create a temporary home directory holding a plugin config file and a
+ * generated calendar of the given number of todo items, and point HOME at
+ * it.
+ */
+static int SetUpHome(std::string &homeDir, const IcsGenOptions &options) {
+    char dirTemplate[] = "/tmp/PluginBench.XXXXXX";
+    std::ofstream confFile;
+    std::ofstream korgConfFile;
+
+    if (!mkdtemp(dirTemplate))
+	return 1;
+    homeDir = dirTemplate;
+
+    confFile.open((homeDir + "/.KOrgTodoPlugin.conf").c_str());
+    confFile << "korg_cal_path=" << homeDir << "/std.ics\n";
+    confFile << "korg_conf_path=" << homeDir << "/korganizerrc\n";
+    confFile << "log_level=error\n";
+    confFile.close();
+
+    korgConfFile.open((homeDir + "/korganizerrc").c_str());
+    korgConfFile << "[Time & Date]\nTimeZoneId=UTC\n";
+    korgConfFile.close();
+
+    if (IcsGenWrite(homeDir + "/std.ics", options) != 0) {
+	RemoveHome(homeDir);
+	return 2;
+    }
+
+    setenv("HOME", homeDir.c_str(), 1);
+
+    return 0;
+}
+
+/**
+ * Time a synchronization session.
+ *
+ * Time each call of a session that pulls the changes out of the calendar
+ * and then pushes a tenth of the items back in as new, modified and deleted
+ * items, mapping the SyncIDs of the new items at the end. Along with the
+ * time, the calls of operator new made by each call are counted, and the
+ * free bytes left scattered through the heap are taken after CleanUp(), as
+ * a measure of its fragmentation.
+ */
+static int RunSession(CreateTodoPluginFunc createPlugin,
+		      DestroyTodoPluginFunc destroyPlugin,
+		      const IcsGenOptions &options, double *pPhaseSecs,
+		      unsigned long *pPhaseNews, unsigned long &heapFreeBytes) {
+    TodoPluginType *pPlugin;
+    TodoItemType::List allItems, newItems, modItems, addItems, changeItems;
+    TodoItemType::List mapItems;
+    TodoItemType::List::iterator it;
+    SyncIDListType delItems, delIDs;
+    TodoItemType item;
+    time_t lastTimeSynced;
+    unsigned long numChanges, i;
+    double startTime;
+    unsigned long startNews;
+    int retval;
+
+    lastTimeSynced = options.baseTime - (15 * 24 * 3600);
+    numChanges = options.numTodos / 10;
+
+    pPlugin = createPlugin();
+    if (!pPlugin)
+	return 1;
+
+    startNews = numNews;
+    startTime = GetTimeSecs();
+    retval = pPlugin->Initialize();
+    pPhaseSecs[0] = GetTimeSecs() - startTime;
+    pPhaseNews[0] = numNews - startNews;
+    if (retval != 0) {
+	std::cerr << "PluginBench: Error: Initialize() returned (" <<
+	    retval << ").\n";
+	destroyPlugin(pPlugin);
+	return 2;
+    }
+
+    startNews = numNews;
+    startTime = GetTimeSecs();
+    allItems = pPlugin->GetAllTodoItems();
+    pPhaseSecs[1] = GetTimeSecs() - startTime;
+    pPhaseNews[1] = numNews - startNews;
+
+    startNews = numNews;
+    startTime = GetTimeSecs();
+    newItems = pPlugin->GetNewTodoItems(lastTimeSynced);
+    pPhaseSecs[2] = GetTimeSecs() - startTime;
+    pPhaseNews[2] = numNews - startNews;
+
+    startNews = numNews;
+    startTime = GetTimeSecs();
+    modItems = pPlugin->GetModTodoItems(lastTimeSynced);
+    pPhaseSecs[3] = GetTimeSecs() - startTime;
+    pPhaseNews[3] = numNews - startNews;
+
+    startNews = numNews;
+    startTime = GetTimeSecs();
+    delItems = pPlugin->GetDelTodoItemIDs(lastTimeSynced);
+    pPhaseSecs[4] = GetTimeSecs() - startTime;
+    pPhaseNews[4] = numNews - startNews;
+
+    // New items coming from the Zaurus, with SyncIDs beyond any in the
+    // generated calendar.
+    for (i = 0; i < numChanges; i++) {
+	item = TodoItemType();
+	item.SetCreatedTime(options.baseTime);
+	item.SetModifiedTime(options.baseTime);
+	item.SetSyncID((options.numTodos * 2) + i + 1);
+	item.SetCategory("Zaurus");
+	item.SetPriority(3);
+	item.SetDescription("Added by the benchmark");
+	item.SetNotes("Notes of an item added by the benchmark");
+	addItems.push_back(item);
+    }
+
+    // Modify the first synchronized items and delete the ones after them.
+    for (it = allItems.begin(); it != allItems.end(); it++) {
+	if (it->GetSyncID() == 0)
+	    continue;
+	if (changeItems.size() < numChanges) {
+	    item = *it;
+	    item.SetModifiedTime(options.baseTime);
+	    item.SetDescription("Modified by the benchmark");
+	    changeItems.push_back(item);
+	} else if (delIDs.size() < numChanges) {
+	    delIDs.push_back(it->GetSyncID());
+	} else {
+	    break;
+	}
+    }
+
+    // Map the items that were new on the desktop side to fresh SyncIDs.
+    i = 0;
+    for (it = newItems.begin(); it != newItems.end(); it++) {
+	item = *it;
+	item.SetSyncID((options.numTodos * 4) + (++i));
+	mapItems.push_back(item);
+    }
+
+    startNews = numNews;
+    startTime = GetTimeSecs();
+    pPlugin->AddTodoItems(addItems);
+    pPhaseSecs[5] = GetTimeSecs() - startTime;
+    pPhaseNews[5] = numNews - startNews;
+
+    startNews = numNews;
+    startTime = GetTimeSecs();
+    pPlugin->ModTodoItems(changeItems);
+    pPhaseSecs[6] = GetTimeSecs() - startTime;
+    pPhaseNews[6] = numNews - startNews;
+
+    startNews = numNews;
+    startTime = GetTimeSecs();
+    pPlugin->DelTodoItems(delIDs);
+    pPhaseSecs[7] = GetTimeSecs() - startTime;
+    pPhaseNews[7] = numNews - startNews;
+
+    startNews = numNews;
+    startTime = GetTimeSecs();
+    pPlugin->MapItemIDs(mapItems);
+    pPhaseSecs[8] = GetTimeSecs() - startTime;
+    pPhaseNews[8] = numNews - startNews;
+
+    startNews = numNews;
+    startTime = GetTimeSecs();
+    retval = pPlugin->CleanUp();
+    pPhaseSecs[9] = GetTimeSecs() - startTime;
+    pPhaseNews[9] = numNews - startNews;
+    heapFreeBytes = (unsigned long)mallinfo().fordblks;
+
+    destroyPlugin(pPlugin);
+
+    if (retval != 0) {
+	std::cerr << "PluginBench: Error: CleanUp() returned (" << retval <<
+	    ").\n";
+	return 3;
+    }
+
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    std::vector<unsigned long> numTodos;
+    std::string pluginPath = "./KOrgTodoPlugin.so";
+    std::string homeDir;
+    IcsGenOptions options;
+    CreateTodoPluginFunc createPlugin;
+    DestroyTodoPluginFunc destroyPlugin;
+    double phaseSecs[BENCH_NUM_PHASES];
+    unsigned long phaseNews[BENCH_NUM_PHASES];
+    unsigned long heapFreeBytes;
+    void *pHandle;
+    size_t sizeIdx;
+    int opt, i;
+
+    while ((opt = getopt(argc, argv, "p:")) != -1) {
+	if (opt != 'p') {
+	    std::cerr << "Usage: " << argv[0] << " [-p plugin.so] " \
+		"[number of todos ...]\n";
+	    return 1;
+	}
+	pluginPath = optarg;
+    }
+    for (i = optind; i < argc; i++)
+	numTodos.push_back(strtoul(argv[i], NULL, 10));
+    if (numTodos.empty()) {
+	numTodos.push_back(1000);
+	numTodos.push_back(10000);
+	numTodos.push_back(100000);
+	numTodos.push_back(1000000);
+    }
+
+    pHandle = dlopen(pluginPath.c_str(), RTLD_NOW);
+    if (!pHandle) {
+	std::cerr << "PluginBench: Error: " << dlerror() << "\n";
+	return 1;
+    }
+    createPlugin = (CreateTodoPluginFunc)dlsym(pHandle, "createTodoPlugin");
+    destroyPlugin = (DestroyTodoPluginFunc)dlsym(pHandle,
+						 "destroyTodoPlugin");
+    if (!createPlugin || !destroyPlugin) {
+	std::cerr << "PluginBench: Error: " << pluginPath << " is not a " \
+	    "todo plugin.\n";
+	dlclose(pHandle);
+	return 1;
+    }
+
+    std::cout << "items";
+    for (i = 0; i < BENCH_NUM_PHASES; i++)
+	std::cout << "," << phaseNames[i] << "_secs";
+    for (i = 0; i < BENCH_NUM_PHASES; i++)
+	std::cout << "," << phaseNames[i] << "_news";
+    std::cout << ",heap_free_bytes\n";
+
+    for (sizeIdx = 0; sizeIdx < numTodos.size(); sizeIdx++) {
+	IcsGenDefaults(options);
+	options.numTodos = numTodos[sizeIdx];
+	options.numEvents = numTodos[sizeIdx];
+
+	if (SetUpHome(homeDir, options) != 0) {
+	    std::cerr << "PluginBench: Error: Failed to set up a calendar " \
+		"of " << numTodos[sizeIdx] << " todo items.\n";
+	    dlclose(pHandle);
+	    return 1;
+	}
+
+	if (RunSession(createPlugin, destroyPlugin, options, phaseSecs,
+		       phaseNews, heapFreeBytes) != 0) {
+	    RemoveHome(homeDir);
+	    dlclose(pHandle);
+	    return 1;
+	}
+	RemoveHome(homeDir);
+
+	std::cout << numTodos[sizeIdx];
+	for (i = 0; i < BENCH_NUM_PHASES; i++)
+	    std::cout << "," << phaseSecs[i];
+	for (i = 0; i < BENCH_NUM_PHASES; i++)
+	    std::cout << "," << phaseNews[i];
+	std::cout << "," << heapFreeBytes << std::endl;
+    }
+
+    dlclose(pHandle);
+
+    return 0;
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright 2004, 2005 Andrew De Ponte
+ *
+ * This file is part of zsrep.
+ *
+ * zsrep is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * zsrep is distributed in the hopes that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with zsrep; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @file SyncIDDiffBench.cc
+ * @brief A micro-benchmark of the SyncID set difference engine.
+ * @author Andrew De Ponte
+ *
+ * A micro-benchmark that times sorting and diffing SyncID sets of 1k to 1M
+ * items, and checks the result against std::set_difference.
+ */
+
+#include "SyncIDDiff.hh"
+
+#include <sys/time.h>
+#include <stdlib.h>
+
+#include <iostream>
+#include <algorithm>
+#include <iterator>
+
+static double GetTimeSecs(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (double)tv.tv_sec + ((double)tv.tv_usec / 1000000.0);
+}
+
+int main(void) {
+    const size_t setSizes[] = { 1000, 10000, 100000, 1000000 };
+    const int numRuns = 5;
+    size_t sizeIdx, i;
+    int run;
+    std::vector<uint64_t> oldIDs, curIDs, removedIDs, expectedIDs;
+    double startTime, sortTime, diffTime;
+
+    srand(1);
+
+    std::cout << "ids,removed,sort_secs,diff_secs\n";
+
+    for (sizeIdx = 0; sizeIdx < (sizeof(setSizes) / sizeof(size_t));
+	 sizeIdx++) {
+	// Build the set of the last synchronization from random SyncIDs and
+	// derive the current set by dropping about one percent of them and
+	// adding a few new ones, as a typical session would.
+	oldIDs.clear();
+	curIDs.clear();
+	for (i = 0; i < setSizes[sizeIdx]; i++) {
+	    oldIDs.push_back(((uint64_t)rand() << 16) ^ (uint64_t)rand());
+	    if ((rand() % 100) != 0)
+		curIDs.push_back(oldIDs.back());
+	    if ((rand() % 200) == 0)
+		curIDs.push_back(((uint64_t)rand() << 16) ^ (uint64_t)rand());
+	}
+	for (i = curIDs.size(); i > 1; i--)
+	    std::swap(curIDs[i - 1], curIDs[rand() % i]);
+
+	sortTime = 0.0;
+	diffTime = 0.0;
+	for (run = 0; run < numRuns; run++) {
+	    std::vector<uint64_t> oldCopy(oldIDs), curCopy(curIDs);
+
+	    startTime = GetTimeSecs();
+	    SyncIDDiff::Sort(oldCopy);
+	    SyncIDDiff::Sort(curCopy);
+	    sortTime += GetTimeSecs() - startTime;
+
+	    removedIDs.clear();
+	    startTime = GetTimeSecs();
+	    SyncIDDiff::Difference(&oldCopy[0], oldCopy.size(),
+				   &curCopy[0], curCopy.size(), removedIDs);
+	    diffTime += GetTimeSecs() - startTime;
+
+	    if (run == 0) {
+		expectedIDs.clear();
+		std::set_difference(oldCopy.begin(), oldCopy.end(),
+				    curCopy.begin(), curCopy.end(),
+				    std::back_inserter(expectedIDs));
+		if (expectedIDs != removedIDs) {
+		    std::cerr << "SyncIDDiffBench: Error: Difference() " \
+			"disagrees with std::set_difference for " <<
+			setSizes[sizeIdx] << " ids.\n";
+		    return 1;
+		}
+	    }
+	}
+
+	std::cout << setSizes[sizeIdx] << "," << removedIDs.size() << "," <<
+	    (sortTime / numRuns) << "," << (diffTime / numRuns) << "\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,254 @@
+/*
+ * Copyright 2004, 2005 Andrew De Ponte
+ *
+ * This file is part of zsrep.
+ *
+ * zsrep is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * zsrep is distributed in the hopes that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with zsrep; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @file TimeConvCheck.cc
+ * @brief A check of the time zone transition table against Qt.
+ * @author Andrew De Ponte
+ *
+ * A program checking that TimeConvType::ToTime_t() and
+ * TimeConvType::FromTime_t() give exactly what QDateTime::toTime_t() and
+ * QDateTime::setTime_t() give, in several time zones. Every transition
+ * between 1970 and 2106 is checked on both sides, through the skipped and
+ * repeated hours, along with a time of every day. That range goes well past
+ * the last transition zone files list, after which the rule at their end is
+ * expanded.
+ */
+
+#include "TimeConv.hh"
+
+#include <qdatetime.h>
+
+#include <time.h>
+#include <stdlib.h>
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+
+// The time zones checked: both hemispheres, half hour offsets and a half
+// hour transition, zones that stopped changing their clocks, and UTC.
+static const char *zones[] = {
+    "America/New_York", "Europe/London", "Europe/Berlin", "Australia/Sydney",
+    "Pacific/Auckland", "America/St_Johns", "Australia/Lord_Howe",
+    "America/Sao_Paulo", "Asia/Kolkata", "UTC", NULL
+};
+
+// The end of the times a QDateTime converts to, as seconds since the epoch.
+#define CHECK_RANGE_END ((int64_t)1 << 32)
+
+// The steps, in seconds, of the scan for transitions and of the checks
+// spread over the whole range. The latter isn't a whole number of days, so
+// that it falls on every time of the day in turn.
+#define CHECK_SCAN_STEP (6 * 3600)
+#define CHECK_SPREAD_STEP (86400 + 3607)
+
+// How far either side of a transition, in seconds, every minute is checked.
+#define CHECK_AROUND_SECS (2 * 3600)
+
+// The number of mismatches reported for each time zone.
+#define CHECK_MAX_REPORTS 10
+
+struct ResultsType {
+    unsigned long numChecks;
+    unsigned long numMismatches;
+};
+
+static long UTCOffset(int64_t utcSecs) {
+    time_t secs = (time_t)utcSecs;
+    struct tm brokenDown;
+
+    localtime_r(&secs, &brokenDown);
+    return brokenDown.tm_gmtoff;
+}
+
+static QDateTime LocalDateTime(int64_t localSecs) {
+    time_t secs = (time_t)localSecs;
+    struct tm brokenDown;
+
+    gmtime_r(&secs, &brokenDown);
+    return QDateTime(QDate(brokenDown.tm_year + 1900, brokenDown.tm_mon + 1,
+			   brokenDown.tm_mday),
+		     QTime(brokenDown.tm_hour, brokenDown.tm_min,
+			   brokenDown.tm_sec));
+}
+
+static void CheckInstant(const TimeConvType &timeConv, int64_t utcSecs,
+			 ResultsType &results) {
+    QDateTime expected;
+    QDateTime converted;
+
+    if ((utcSecs < 0) || (utcSecs >= CHECK_RANGE_END))
+	return;
+
+    expected.setTime_t((uint)utcSecs);
+    converted = timeConv.FromTime_t((uint)utcSecs);
+    results.numChecks++;
+    if (converted == expected)
+	return;
+
+    if (results.numMismatches++ < CHECK_MAX_REPORTS) {
+	std::cerr << "TimeConvCheck: Error: FromTime_t(" << utcSecs <<
+	    ") gives " << converted.toString(Qt::ISODate).latin1() <<
+	    ", setTime_t() gives " <<
+	    expected.toString(Qt::ISODate).latin1() << ".\n";
+    }
+}
+
+static void CheckLocal(const TimeConvType &timeConv, int64_t localSecs,
+		       ResultsType &results) {
+    QDateTime dateTime;
+    uint expected;
+    uint converted;
+    uint batchConverted;
+
+    if ((localSecs < 0) || (localSecs >= CHECK_RANGE_END))
+	return;
+
+    dateTime = LocalDateTime(localSecs);
+    expected = dateTime.toTime_t();
+    converted = timeConv.ToTime_t(dateTime);
+    timeConv.ToTime_t(&dateTime, &batchConverted, 1);
+    results.numChecks++;
+    if ((converted == expected) && (batchConverted == expected))
+	return;
+
+    if (results.numMismatches++ < CHECK_MAX_REPORTS) {
+	std::cerr << "TimeConvCheck: Error: ToTime_t(" <<
+	    dateTime.toString(Qt::ISODate).latin1() << ") gives " <<
+	    converted << " (" << batchConverted << " in a batch), " \
+	    "toTime_t() gives " << expected << ".\n";
+    }
+}
+
+/**
+ * Find the transitions of the local time zone.
+ *
+ * Find the instants at which libc changes the UTC offset of the local time
+ * zone, by scanning the range in steps and narrowing each change down to
+ * the second.
+ * @param transitions Set to the instants of the transitions.
+ */
+static void FindTransitions(std::vector<int64_t> &transitions) {
+    int64_t secs, low, high, mid;
+    long prevOffset;
+
+    transitions.clear();
+    prevOffset = UTCOffset(0);
+    for (secs = CHECK_SCAN_STEP; secs < CHECK_RANGE_END;
+	 secs += CHECK_SCAN_STEP) {
+	if (UTCOffset(secs) == prevOffset)
+	    continue;
+
+	low = secs - CHECK_SCAN_STEP;
+	high = secs;
+	while ((high - low) > 1) {
+	    mid = low + ((high - low) / 2);
+	    if (UTCOffset(mid) == prevOffset)
+		low = mid;
+	    else
+		high = mid;
+	}
+	transitions.push_back(high);
+	prevOffset = UTCOffset(secs);
+    }
+}
+
+int main(void) {
+    std::vector<int64_t> transitions;
+    ResultsType results;
+    int64_t trans, secs, localStart, localEnd;
+    long before, after;
+    size_t zoneIdx, i;
+    int numFailed = 0;
+    int retval;
+
+    std::cout << "zone,transitions,checks,mismatches\n";
+
+    for (zoneIdx = 0; zones[zoneIdx]; zoneIdx++) {
+	TimeConvType timeConv;
+
+	setenv("TZ", zones[zoneIdx], 1);
+	tzset();
+
+	// Without its zone file a zone can't be checked, and the plugin would
+	// hand every conversion to Qt anyway.
+	retval = timeConv.Load();
+	if (retval == 1) {
+	    std::cerr << "TimeConvCheck: Warning: Skipped " <<
+		zones[zoneIdx] << ", its zone file isn't installed.\n";
+	    continue;
+	} else if (retval != 0) {
+	    std::cerr << "TimeConvCheck: Error: Failed to load the " \
+		"transition table of " << zones[zoneIdx] << " (" << retval <<
+		").\n";
+	    numFailed++;
+	    continue;
+	}
+
+	results.numChecks = 0;
+	results.numMismatches = 0;
+	FindTransitions(transitions);
+
+	for (i = 0; i < transitions.size(); i++) {
+	    trans = transitions[i];
+	    before = UTCOffset(trans - 1);
+	    after = UTCOffset(trans);
+
+	    // Every minute either side of the transition, and the seconds
+	    // next to it.
+	    for (secs = trans - CHECK_AROUND_SECS;
+		 secs <= trans + CHECK_AROUND_SECS; secs += 60)
+		CheckInstant(timeConv, secs, results);
+	    CheckInstant(timeConv, trans - 1, results);
+	    CheckInstant(timeConv, trans + 1, results);
+
+	    // The local times the clocks skip over when they go forward, or
+	    // go through twice when they go back, and either side of them.
+	    localStart = trans + std::min(before, after) - CHECK_AROUND_SECS;
+	    localEnd = trans + std::max(before, after) + CHECK_AROUND_SECS;
+	    for (secs = localStart; secs <= localEnd; secs += 60)
+		CheckLocal(timeConv, secs, results);
+	    CheckLocal(timeConv, trans + before - 1, results);
+	    CheckLocal(timeConv, trans + before, results);
+	    CheckLocal(timeConv, trans + after - 1, results);
+	    CheckLocal(timeConv, trans + after, results);
+	}
+
+	// A time of every day, up to the end of the range.
+	for (secs = 0; secs < CHECK_RANGE_END; secs += CHECK_SPREAD_STEP) {
+	    CheckInstant(timeConv, secs, results);
+	    CheckLocal(timeConv, secs, results);
+	}
+
+	std::cout << zones[zoneIdx] << "," << transitions.size() << "," <<
+	    results.numChecks << "," << results.numMismatches << "\n";
+	if (results.numMismatches != 0)
+	    numFailed++;
+    }
+
+    if (numFailed != 0) {
+	std::cerr << "TimeConvCheck: Error: " << numFailed << " time " \
+	    "zones don't convert the same as Qt.\n";
+	return 1;
+    }
+
+    return 0;
+}